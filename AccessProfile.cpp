@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include "AccessProfile.h"
+
+const size_t AccessProfile::PREFETCH_READ_SIZE;
+
+namespace {
+
+uint64_t now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+} // namespace
+
+AccessProfile::AccessProfile(const unsigned char *disc)
+    : mRecording(true), mDeadline(0), mCancelled(false) {
+  memcpy(mDisc, disc, sizeof(mDisc));
+}
+
+bool AccessProfile::load(const char *path) {
+  FILE *const file = fopen(path, "rb");
+  struct access_profile_header header;
+
+  if (file == nullptr) {
+    return false;
+  }
+  bool loaded = fread(&header, sizeof(header), 1, file) == 1 &&
+                !memcmp(header.magic, ACCESS_PROFILE_MAGIC,
+                        sizeof(ACCESS_PROFILE_MAGIC)) &&
+                header.version == ACCESS_PROFILE_VERSION &&
+                header.extents <= MAX_EXTENTS &&
+                !memcmp(header.disc, mDisc, sizeof(mDisc));
+  if (loaded) {
+    mLoaded.resize(header.extents);
+    loaded = mLoaded.empty() ||
+             fread(mLoaded.data(), sizeof(access_profile_extent),
+                   mLoaded.size(), file) == mLoaded.size();
+  }
+  if (!loaded) {
+    mLoaded.clear();
+  }
+  fclose(file);
+  return loaded;
+}
+
+bool AccessProfile::save(const char *path) {
+  const std::string temporary = std::string(path) + ".tmp";
+  struct access_profile_header header;
+  std::lock_guard<std::mutex> guard(mLock);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ACCESS_PROFILE_MAGIC, sizeof(ACCESS_PROFILE_MAGIC));
+  header.version = ACCESS_PROFILE_VERSION;
+  header.extents = mRecorded.size();
+  memcpy(header.disc, mDisc, sizeof(mDisc));
+
+  FILE *const file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool saved = fwrite(&header, sizeof(header), 1, file) == 1 &&
+               (mRecorded.empty() ||
+                fwrite(mRecorded.data(), sizeof(access_profile_extent),
+                       mRecorded.size(), file) == mRecorded.size());
+  saved = fclose(file) == 0 && saved;
+  // a mount reading the old profile never sees half of the new one
+  if (!saved || rename(temporary.c_str(), path)) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+size_t AccessProfile::getRecordedExtents() {
+  std::lock_guard<std::mutex> guard(mLock);
+  return mRecorded.size();
+}
+
+void AccessProfile::recordSlow(uint64_t offset, size_t length) {
+  const uint64_t time = now();
+  std::lock_guard<std::mutex> guard(mLock);
+
+  if (mDeadline == 0) {
+    mDeadline = time + RECORD_SECONDS * 1000000000;
+  } else if (time >= mDeadline) {
+    mRecording = false;
+    return;
+  }
+
+  const uint64_t last = (offset + length - 1) / GRANULE_SIZE;
+  for (uint64_t granule = offset / GRANULE_SIZE; granule <= last; ++granule) {
+    if (!mSeen.insert(granule).second) {
+      continue;
+    }
+    const uint64_t start = granule * GRANULE_SIZE;
+    if (!mRecorded.empty()) {
+      access_profile_extent &previous = mRecorded.back();
+      if (previous.offset + previous.length == start &&
+          previous.length + GRANULE_SIZE <= MAX_EXTENT_LENGTH) {
+        previous.length += GRANULE_SIZE;
+        continue;
+      }
+    }
+    if (mRecorded.size() == MAX_EXTENTS) {
+      mRecording = false;
+      return;
+    }
+    mRecorded.push_back({start, static_cast<uint32_t>(GRANULE_SIZE)});
+  }
+}
+
+uint64_t AccessProfile::prefetch(BinaryReader *reader) {
+  std::vector<unsigned char> buf(PREFETCH_READ_SIZE);
+  uint64_t total = 0;
+  size_t i = 0;
+
+  while (i < mLoaded.size() && !mCancelled) {
+    // extents read one after the other that lie close together on the
+    // image become one read, skipping over the gaps is cheaper than seeking
+    const uint64_t start = mLoaded[i].offset;
+    uint64_t end = start + mLoaded[i].length;
+    for (++i; i < mLoaded.size(); ++i) {
+      const access_profile_extent &next = mLoaded[i];
+      if (next.offset < end || next.offset - end > PREFETCH_GAP ||
+          next.offset + next.length - start > PREFETCH_READ_SIZE) {
+        break;
+      }
+      end = next.offset + next.length;
+    }
+
+    for (uint64_t position = start; position < end && !mCancelled;) {
+      const size_t size =
+          std::min<uint64_t>(end - position, PREFETCH_READ_SIZE);
+      const int read = reader->read(buf.data(), size, position);
+      if (read <= 0) {
+        // past the end of the image or an error, nothing more to get here
+        break;
+      }
+      total += read;
+      position += read;
+    }
+  }
+  return total;
+}
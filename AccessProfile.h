@@ -0,0 +1,95 @@
+#ifndef __ACCESS_PROFILE__H_
+#define __ACCESS_PROFILE__H_
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include "BinaryReader.h"
+
+// Profile files are an access_profile_header followed by extents of the
+// image in the order they were first read. Everything is in host byte
+// order.
+#define ACCESS_PROFILE_MAGIC "GCPROF"
+#define ACCESS_PROFILE_VERSION 1
+// how much of the start of the image identifies it
+#define ACCESS_PROFILE_DISC_SIZE 32
+
+#pragma pack(1)
+struct access_profile_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t extents;
+  unsigned char disc[ACCESS_PROFILE_DISC_SIZE];
+};
+
+struct access_profile_extent {
+  uint64_t offset;
+  uint32_t length;
+};
+#pragma pack()
+
+// Remembers which parts of the image are read while a game boots and reads
+// them back ahead of time on the next mount. Booting reads the apploader,
+// boot.dol and then much the same files in much the same order every time,
+// so a profile recorded once turns lots of small scattered reads into a few
+// large sequential ones before the game asks for the data.
+//
+// Reads are recorded in granules, each granule only the first time it's
+// read, and granules following on from the previous one extend its extent.
+// Recording stops RECORD_SECONDS after the first read or once there are
+// MAX_EXTENTS extents, whichever comes first, so a long session doesn't
+// turn the whole image into the profile.
+class AccessProfile {
+public:
+  static const size_t GRANULE_SIZE = 64 * 1024;
+  static const size_t MAX_EXTENTS = 16384;
+  static const size_t MAX_EXTENT_LENGTH = 64 * 1024 * 1024;
+  static const uint64_t RECORD_SECONDS = 120;
+  // prefetch reads extents up to this far apart as one
+  static const size_t PREFETCH_GAP = 1024 * 1024;
+  static const size_t PREFETCH_READ_SIZE = 4 * 1024 * 1024;
+
+private:
+  unsigned char mDisc[ACCESS_PROFILE_DISC_SIZE];
+
+  std::mutex mLock;
+  std::atomic<bool> mRecording;
+  uint64_t mDeadline; // 0 until the first read
+  std::unordered_set<uint64_t> mSeen;
+  std::vector<access_profile_extent> mRecorded;
+
+  std::vector<access_profile_extent> mLoaded;
+  std::atomic<bool> mCancelled;
+
+public:
+  // disc is the first ACCESS_PROFILE_DISC_SIZE bytes of the image
+  explicit AccessProfile(const unsigned char *disc);
+
+  // loads the profile at path if it was recorded for the same image
+  bool load(const char *path);
+  // writes what was recorded to path, replacing it at once
+  bool save(const char *path);
+
+  // notes a read of the image
+  void record(uint64_t offset, size_t length) {
+    if (mRecording.load(std::memory_order_relaxed) && length > 0) {
+      recordSlow(offset, length);
+    }
+  }
+
+  size_t getLoadedExtents() const { return mLoaded.size(); }
+  size_t getRecordedExtents();
+
+  // Reads every loaded extent through reader in the recorded order, which
+  // fills its block cache or the page cache. Returns the bytes read.
+  uint64_t prefetch(BinaryReader *reader);
+  // makes a running prefetch return early
+  void cancel() { mCancelled = true; }
+
+private:
+  void recordSlow(uint64_t offset, size_t length);
+};
+
+#endif
@@ -0,0 +1,242 @@
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include "AsyncLog.h"
+
+namespace {
+
+enum Field { FIELD_TEXT = 1, FIELD_INODE = 2, FIELD_RANGE = 4 };
+
+struct op_format {
+  const char *name;
+  unsigned int fields;
+};
+
+const op_format op_formats[AsyncLog::OP_COUNT] = {
+    {"statfs", FIELD_TEXT},
+    {"getattr", FIELD_TEXT},
+    {"fgetattr", FIELD_TEXT | FIELD_INODE},
+    {"opendir", FIELD_TEXT},
+    {"releasedir", FIELD_TEXT},
+    {"readdir", FIELD_TEXT | FIELD_INODE},
+    {"open", FIELD_TEXT},
+    {"release", FIELD_TEXT},
+    {"read", FIELD_INODE | FIELD_RANGE},
+    {"read_buf", FIELD_INODE | FIELD_RANGE},
+    {"not found", FIELD_TEXT},
+    {"filler buffer full", 0},
+    {"ll_lookup", FIELD_INODE | FIELD_TEXT},
+    {"ll_opendir", FIELD_INODE},
+    {"ll_releasedir", FIELD_INODE},
+    {"ll_readdir", FIELD_INODE | FIELD_RANGE},
+    {"ll_open", FIELD_INODE},
+    {"ll_release", FIELD_INODE},
+    {"ll_read", FIELD_INODE | FIELD_RANGE},
+};
+
+} // namespace
+
+AsyncLog::AsyncLog() : mFile(nullptr), mStopping(false) {}
+
+AsyncLog::~AsyncLog() {
+  if (mDrainer.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(mLock);
+      mStopping = true;
+    }
+    mWake.notify_one();
+    mDrainer.join();
+  }
+  drain();
+
+  if (mFile) {
+    const uint64_t dropped = getDropped();
+    if (dropped > 0) {
+      fprintf(mFile, "dropped %llu records in total\n",
+              static_cast<unsigned long long>(dropped));
+    }
+    fclose(mFile);
+  }
+}
+
+bool AsyncLog::open(const char *path) {
+  mFile = fopen(path, "w");
+  return mFile != nullptr;
+}
+
+void AsyncLog::start() {
+  if (!mDrainer.joinable()) {
+    mDrainer = std::thread(&AsyncLog::run, this);
+  }
+}
+
+uint64_t AsyncLog::now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+AsyncLog::Ring *AsyncLog::getRing() {
+  return mRings.get([](size_t index) {
+    Ring *const ring = new Ring();
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->reported = 0;
+    ring->index = index;
+    return ring;
+  });
+}
+
+void AsyncLog::record(Op op, const char *text, uint64_t inode, int64_t offset,
+                      uint64_t size) {
+  Ring *const ring = getRing();
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+  if (head - ring->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+    ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    return;
+  }
+
+  Record &record = ring->records[head & (RING_SIZE - 1)];
+  record.timestamp = now();
+  record.inode = inode;
+  record.offset = offset;
+  record.size = size;
+  record.op = op;
+  record.truncated = 0;
+  if (text) {
+    // the end of a path says more than its start
+    const size_t length = strlen(text);
+    if (length > sizeof(record.text)) {
+      text += length - sizeof(record.text);
+      record.truncated = 1;
+    }
+    strncpy(record.text, text, sizeof(record.text));
+  } else {
+    record.text[0] = '\0';
+  }
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void AsyncLog::message(const char *format, va_list ap) {
+  Message message;
+  va_list copy;
+
+  va_copy(copy, ap);
+  const int length = vsnprintf(nullptr, 0, format, copy);
+  va_end(copy);
+  if (length < 0) {
+    return;
+  }
+  message.text.resize(length + 1);
+  vsnprintf(&message.text[0], length + 1, format, ap);
+  message.text.resize(length);
+  message.timestamp = now();
+
+  std::lock_guard<std::mutex> guard(mLock);
+  mMessages.push_back(std::move(message));
+}
+
+uint64_t AsyncLog::getDropped() {
+  uint64_t dropped = 0;
+
+  for (const Ring *ring : mRings.getAll()) {
+    dropped += ring->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+void AsyncLog::run() {
+  const std::chrono::milliseconds interval(
+      static_cast<unsigned int>(DRAIN_INTERVAL_MS));
+  std::unique_lock<std::mutex> guard(mLock);
+  while (!mStopping) {
+    mWake.wait_for(guard, interval);
+    guard.unlock();
+    drain();
+    guard.lock();
+  }
+}
+
+// Only ever runs on one thread at a time, the drainer or the destructor once
+// the drainer is gone
+void AsyncLog::drain() {
+  const std::vector<Ring *> rings = mRings.getAll();
+  std::vector<Message> messages;
+  {
+    std::lock_guard<std::mutex> guard(mLock);
+    messages.swap(mMessages);
+  }
+
+  // copy the records out first so the rings are freed up right away
+  std::vector<Record> records;
+  for (Ring *ring : rings) {
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    for (; tail != head; ++tail) {
+      records.push_back(ring->records[tail & (RING_SIZE - 1)]);
+    }
+    ring->tail.store(tail, std::memory_order_release);
+  }
+  if (mFile == nullptr) {
+    return;
+  }
+
+  // every ring is in order on its own, merge them and the messages
+  std::stable_sort(records.begin(), records.end(),
+                   [](const Record &a, const Record &b) {
+                     return a.timestamp < b.timestamp;
+                   });
+  std::vector<Message>::const_iterator message = messages.begin();
+  for (const Record &record : records) {
+    for (; message != messages.end() &&
+           message->timestamp <= record.timestamp;
+         ++message) {
+      fputs(message->text.c_str(), mFile);
+    }
+    writeRecord(record);
+  }
+  for (; message != messages.end(); ++message) {
+    fputs(message->text.c_str(), mFile);
+  }
+
+  for (Ring *ring : rings) {
+    const uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+    if (dropped != ring->reported) {
+      fprintf(mFile, "dropped %llu records from thread %u\n",
+              static_cast<unsigned long long>(dropped - ring->reported),
+              ring->index);
+      ring->reported = dropped;
+    }
+  }
+  fflush(mFile);
+}
+
+void AsyncLog::writeRecord(const Record &record) {
+  const op_format &format = op_formats[record.op];
+  const time_t seconds = record.timestamp / 1000000000;
+  struct tm tm;
+  char timestamp[16];
+
+  localtime_r(&seconds, &tm);
+  strftime(timestamp, sizeof(timestamp), "%H:%M:%S", &tm);
+  fprintf(mFile, "%s.%06u %s", timestamp,
+          static_cast<unsigned int>(record.timestamp % 1000000000 / 1000),
+          format.name);
+  if (format.fields & FIELD_INODE) {
+    fprintf(mFile, " %llu", static_cast<unsigned long long>(record.inode));
+  }
+  if ((format.fields & FIELD_TEXT) && record.text[0] != '\0') {
+    fprintf(mFile, " %s%.*s", record.truncated ? "..." : "",
+            static_cast<int>(sizeof(record.text)), record.text);
+  }
+  if (format.fields & FIELD_RANGE) {
+    fprintf(mFile, " %lld+%llu", static_cast<long long>(record.offset),
+            static_cast<unsigned long long>(record.size));
+  }
+  fputc('\n', mFile);
+}
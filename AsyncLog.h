@@ -0,0 +1,114 @@
+#ifndef __ASYNC_LOG__H_
+#define __ASYNC_LOG__H_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PerThread.h"
+
+// Debug log that stays off the request path. Every thread appends compact
+// binary records to a ring of its own, without locks or system calls, and a
+// drainer thread formats and writes them out in timestamp order. A record
+// that doesn't fit in its ring is dropped and counted, the caller never
+// waits for the file.
+class AsyncLog {
+public:
+  enum Op : uint16_t {
+    OP_STATFS,
+    OP_GETATTR,
+    OP_FGETATTR,
+    OP_OPENDIR,
+    OP_RELEASEDIR,
+    OP_READDIR,
+    OP_OPEN,
+    OP_RELEASE,
+    OP_READ,
+    OP_READ_BUF,
+    OP_NOT_FOUND,
+    OP_FILLER_FULL,
+    OP_LL_LOOKUP,
+    OP_LL_OPENDIR,
+    OP_LL_RELEASEDIR,
+    OP_LL_READDIR,
+    OP_LL_OPEN,
+    OP_LL_RELEASE,
+    OP_LL_READ,
+    OP_COUNT
+  };
+
+  // one cache line
+  struct Record {
+    uint64_t timestamp; // CLOCK_REALTIME in nanoseconds
+    uint64_t inode;
+    int64_t offset;
+    uint64_t size;
+    uint16_t op;
+    uint8_t truncated; // text holds only the end of a longer path
+    char text[29];     // path or name, not terminated when it's full
+  };
+
+  // records per thread, a power of two
+  static const size_t RING_SIZE = 8192;
+  static const unsigned int DRAIN_INTERVAL_MS = 50;
+
+private:
+  // Single producer, single consumer. The indices only ever grow, the
+  // padding keeps the producer's and the drainer's on separate cache lines.
+  struct Ring {
+    std::atomic<uint64_t> head; // next record the thread writes
+    char padding1[56];
+    std::atomic<uint64_t> tail; // next record the drainer reads
+    char padding2[56];
+    std::atomic<uint64_t> dropped;
+    uint64_t reported; // drops already written out, drainer only
+    unsigned int index;
+    Record records[RING_SIZE];
+  };
+
+  struct Message {
+    uint64_t timestamp;
+    std::string text;
+  };
+
+  FILE *mFile;
+  std::mutex mLock;
+  std::condition_variable mWake;
+  PerThread<Ring> mRings;
+  std::vector<Message> mMessages;
+  std::thread mDrainer;
+  bool mStopping;
+
+public:
+  AsyncLog();
+  // stops the drainer and writes out whatever is left
+  ~AsyncLog();
+
+  bool open(const char *path);
+  // Starts the drainer. Until then records pile up in the rings, so it can
+  // wait until the process has daemonized.
+  void start();
+
+  void record(Op op, const char *text, uint64_t inode = 0, int64_t offset = 0,
+              uint64_t size = 0);
+  // Free form text for rare events, formatted by the caller and queued
+  // under a lock
+  void message(const char *format, va_list ap);
+
+  // records dropped so far because a ring was full
+  uint64_t getDropped();
+
+private:
+  Ring *getRing();
+  void run();
+  void drain();
+  void writeRecord(const Record &record);
+  static uint64_t now();
+};
+
+#endif
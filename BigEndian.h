@@ -0,0 +1,38 @@
+#ifndef __BIG_ENDIAN__H_
+#define __BIG_ENDIAN__H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// An N byte big-endian integer as laid out on disc. Converts to and from T on
+// access, so on-disc structures can be read in place without a swap pass.
+// Byte storage keeps it unaligned-safe; the compiler turns the shifts into a
+// single load and bswap.
+template <typename T, size_t N = sizeof(T)> class big_endian {
+private:
+  uint8_t bytes[N];
+
+public:
+  operator T() const {
+    T value = 0;
+    for (size_t i = 0; i < N; ++i) {
+      value = static_cast<T>((value << 8) | bytes[i]);
+    }
+    return value;
+  }
+
+  big_endian &operator=(T value) {
+    for (size_t i = N; i-- > 0;) {
+      bytes[i] = static_cast<uint8_t>(value & 0xff);
+      value = static_cast<T>(value >> 8);
+    }
+    return *this;
+  }
+};
+
+typedef big_endian<uint16_t> be16_t;
+typedef big_endian<uint32_t, 3> be24_t;
+typedef big_endian<uint32_t> be32_t;
+typedef big_endian<uint64_t> be64_t;
+
+#endif
@@ -1,5 +1,10 @@
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include "BinaryReader.h"
 
 BinaryFILEReader::BinaryFILEReader() : mFile(nullptr) {}
@@ -18,3 +23,81 @@ bool BinaryFILEReader::open(const char *path) {
 int BinaryFILEReader::read(void *buf, int size, size_t offset) {
   return pread(fileno(mFile), buf, size, offset);
 }
+
+void BinaryFILEReader::advise(size_t offset, size_t size, Advice advice) {
+  static const int fadvice[] = {POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL,
+                                POSIX_FADV_RANDOM};
+
+  posix_fadvise(fileno(mFile), offset, size, fadvice[advice]);
+}
+
+BinaryMmapReader::BinaryMmapReader() : mData(nullptr), mSize(0), mFd(-1) {}
+
+BinaryMmapReader::~BinaryMmapReader() {
+  if (mData != nullptr) {
+    munmap(const_cast<unsigned char *>(mData), mSize);
+  }
+  if (mFd >= 0) {
+    close(mFd);
+  }
+}
+
+bool BinaryMmapReader::open(const char *path) {
+  struct stat statbuf;
+  const int fd = ::open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &statbuf) != 0 || statbuf.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+
+  void *const data =
+      mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  // kept open so large reads can still be spliced
+  mFd = fd;
+  mData = reinterpret_cast<const unsigned char *>(data);
+  mSize = statbuf.st_size;
+  // FUSE reads hop around the image, don't let the kernel read ahead blindly
+  madvise(data, mSize, MADV_RANDOM);
+  return true;
+}
+
+int BinaryMmapReader::read(void *buf, int size, size_t offset) {
+  if (size <= 0 || offset >= mSize) {
+    return 0;
+  }
+
+  const size_t length = std::min(static_cast<size_t>(size), mSize - offset);
+  memcpy(buf, mData + offset, length);
+  return length;
+}
+
+const void *BinaryMmapReader::map(size_t offset, size_t size) {
+  if (offset > mSize || size > mSize - offset) {
+    return nullptr;
+  }
+  return mData + offset;
+}
+
+void BinaryMmapReader::advise(size_t offset, size_t size, Advice advice) {
+  static const int madvice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM};
+  static const size_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+
+  if (offset >= mSize) {
+    return;
+  }
+  size = std::min(size, mSize - offset);
+
+  // madvise wants a page aligned start
+  const size_t start = offset & ~pageMask;
+  madvise(const_cast<unsigned char *>(mData) + start, size + offset - start,
+          madvice[advice]);
+}
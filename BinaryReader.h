@@ -1,11 +1,43 @@
 #ifndef __BINARY_READER__H_
 #define __BINARY_READER__H_
 
+#include <stdio.h>
+#include <stddef.h>
+
 class BinaryReader {
 public:
+  enum Advice { ADVICE_NORMAL, ADVICE_SEQUENTIAL, ADVICE_RANDOM };
+
+  struct Request {
+    void *buf;
+    size_t size;
+    size_t offset;
+    int result; // what read() would have returned
+  };
+
   BinaryReader() {}
   virtual ~BinaryReader() {}
   virtual int read(void *buf, int size, size_t offset) = 0;
+
+  // Reads every request, readers that can keep several reads in flight
+  // serve them concurrently
+  virtual void readBatch(Request *requests, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      requests[i].result =
+          read(requests[i].buf, requests[i].size, requests[i].offset);
+    }
+  }
+
+  // Returns a pointer to size bytes at offset if the reader can hand them out
+  // without copying, nullptr otherwise. Valid for the life of the reader.
+  virtual const void *map(size_t offset, size_t size) { return nullptr; }
+
+  // Hints how the given range is about to be accessed
+  virtual void advise(size_t offset, size_t size, Advice advice) {}
+
+  // Returns a descriptor whose file offsets are the reader's offsets, so
+  // reads may be spliced straight from it, or -1 if there isn't one
+  virtual int getFileDescriptor() const { return -1; }
 };
 
 class BinaryFILEReader : public BinaryReader {
@@ -19,6 +51,26 @@ public:
   bool open(const char *path);
 
   virtual int read(void *buf, int size, size_t offset);
+  virtual void advise(size_t offset, size_t size, Advice advice);
+  virtual int getFileDescriptor() const { return fileno(mFile); }
+};
+
+class BinaryMmapReader : public BinaryReader {
+private:
+  const unsigned char *mData;
+  size_t mSize;
+  int mFd;
+
+public:
+  BinaryMmapReader();
+  virtual ~BinaryMmapReader();
+
+  bool open(const char *path);
+
+  virtual int read(void *buf, int size, size_t offset);
+  virtual const void *map(size_t offset, size_t size);
+  virtual void advise(size_t offset, size_t size, Advice advice);
+  virtual int getFileDescriptor() const { return mFd; }
 };
 
 #endif
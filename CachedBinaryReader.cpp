@@ -0,0 +1,139 @@
+#include <string.h>
+#include <algorithm>
+#include "CachedBinaryReader.h"
+
+CachedBinaryReader::CachedBinaryReader(BinaryReader *reader, size_t budget,
+                                       size_t blockSize, unsigned int shards)
+    : mReader(reader), mBlockSize(blockSize), mShards(shards), mHits(0),
+      mMisses(0) {
+  // every shard holds at least a couple of blocks so 2Q still has a FIFO
+  mShardBlocks = std::max<size_t>(budget / mBlockSize / shards, 2);
+  // the sizes the 2Q paper recommends: a quarter for first touches and
+  // ghosts for half the cache
+  mInBlocks = std::max<size_t>(mShardBlocks / 4, 1);
+  mOutBlocks = std::max<size_t>(mShardBlocks / 2, 1);
+}
+
+CachedBinaryReader::~CachedBinaryReader() { delete mReader; }
+
+int CachedBinaryReader::read(void *buf, int size, size_t offset) {
+  unsigned char *const out = reinterpret_cast<unsigned char *>(buf);
+  int done = 0;
+
+  while (done < size) {
+    const size_t position = offset + done;
+    const size_t within = position % mBlockSize;
+    const std::shared_ptr<const Block> block =
+        getBlock(position / mBlockSize);
+
+    if (!block) {
+      return done > 0 ? done : -1;
+    }
+    if (within >= block->length) {
+      // past the end of the image
+      break;
+    }
+
+    const size_t length =
+        std::min(static_cast<size_t>(size - done), block->length - within);
+    memcpy(out + done, block->data.get() + within, length);
+    done += length;
+  }
+  return done;
+}
+
+std::shared_ptr<const CachedBinaryReader::Block>
+CachedBinaryReader::getBlock(uint64_t index) {
+  Shard &shard = mShards[index % mShards.size()];
+  {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto iter = shard.entries.find(index);
+    if (iter != shard.entries.end() && iter->second.block) {
+      Entry &entry = iter->second;
+      if (entry.queue == QUEUE_MAIN) {
+        shard.main.splice(shard.main.begin(), shard.main, entry.position);
+      }
+      // a hit in the FIFO doesn't promote, that's what makes it scan proof
+      ++mHits;
+      return entry.block;
+    }
+  }
+
+  // read without holding the lock, racing readers of the same block both
+  // load it and the second insert is dropped
+  ++mMisses;
+  const std::shared_ptr<const Block> block = loadBlock(index);
+  if (block && block->length > 0) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    insert(shard, index, block);
+  }
+  return block;
+}
+
+std::shared_ptr<const CachedBinaryReader::Block>
+CachedBinaryReader::loadBlock(uint64_t index) {
+  std::shared_ptr<Block> block(new Block());
+
+  block->data.reset(new unsigned char[mBlockSize]);
+  const int read =
+      mReader->read(block->data.get(), mBlockSize, index * mBlockSize);
+  if (read < 0) {
+    return nullptr;
+  }
+  block->length = read;
+  return block;
+}
+
+void CachedBinaryReader::insert(Shard &shard, uint64_t index,
+                                const std::shared_ptr<const Block> &block) {
+  auto iter = shard.entries.find(index);
+
+  if (iter != shard.entries.end()) {
+    Entry &entry = iter->second;
+    if (entry.block) {
+      // someone else loaded it first
+      return;
+    }
+    // remembered from a recent stay in the FIFO, so it's hot: go to main
+    shard.out.erase(entry.position);
+    evict(shard);
+    shard.main.push_front(index);
+    entry.queue = QUEUE_MAIN;
+    entry.position = shard.main.begin();
+    entry.block = block;
+    return;
+  }
+
+  evict(shard);
+  shard.in.push_front(index);
+  Entry &entry = shard.entries[index];
+  entry.queue = QUEUE_IN;
+  entry.position = shard.in.begin();
+  entry.block = block;
+}
+
+// Makes room for one more resident block
+void CachedBinaryReader::evict(Shard &shard) {
+  if (shard.in.size() + shard.main.size() < mShardBlocks) {
+    return;
+  }
+
+  if (shard.in.size() > mInBlocks || shard.main.empty()) {
+    // the oldest first touch leaves, but is remembered as a ghost
+    const uint64_t victim = shard.in.back();
+    shard.in.pop_back();
+    shard.out.push_front(victim);
+    Entry &entry = shard.entries[victim];
+    entry.queue = QUEUE_OUT;
+    entry.position = shard.out.begin();
+    entry.block.reset();
+
+    if (shard.out.size() > mOutBlocks) {
+      shard.entries.erase(shard.out.back());
+      shard.out.pop_back();
+    }
+  } else {
+    shard.entries.erase(shard.main.back());
+    shard.main.pop_back();
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef __CACHED_BINARY_READER__H_
+#define __CACHED_BINARY_READER__H_
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "BinaryReader.h"
+#include "GamecubeFilesystemTable.h"
+
+// Caches aligned blocks of another reader. The cache is split into shards,
+// each with its own lock, so concurrent FUSE threads rarely contend. Each
+// shard runs 2Q: blocks seen once sit in a small FIFO and only blocks that
+// are asked for again after leaving it get into the main LRU. A streaming
+// read of a big file can therefore never flush the hot apploader, boot.dol
+// and config file blocks.
+class CachedBinaryReader : public BinaryReader {
+public:
+  static const size_t DEFAULT_BLOCK_SIZE = 16 * GC_DVD_SECTOR_SIZE;
+  static const unsigned int DEFAULT_SHARDS = 16;
+
+private:
+  struct Block {
+    size_t length;
+    std::unique_ptr<unsigned char[]> data;
+  };
+
+  enum Queue { QUEUE_IN, QUEUE_MAIN, QUEUE_OUT };
+
+  struct Entry {
+    Queue queue;
+    std::list<uint64_t>::iterator position;
+    std::shared_ptr<const Block> block; // null while only remembered in OUT
+  };
+
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::list<uint64_t> in;   // first touch FIFO, front is newest
+    std::list<uint64_t> main; // LRU, front is most recent
+    std::list<uint64_t> out;  // ghosts of blocks evicted from in
+  };
+
+  BinaryReader *mReader;
+  const size_t mBlockSize;
+  size_t mShardBlocks;
+  size_t mInBlocks;
+  size_t mOutBlocks;
+  std::vector<Shard> mShards;
+  std::atomic<uint64_t> mHits;
+  std::atomic<uint64_t> mMisses;
+
+public:
+  // Takes ownership of reader. blockSize must be a multiple of the sector size
+  CachedBinaryReader(BinaryReader *reader, size_t budget,
+                     size_t blockSize = DEFAULT_BLOCK_SIZE,
+                     unsigned int shards = DEFAULT_SHARDS);
+  virtual ~CachedBinaryReader();
+
+  virtual int read(void *buf, int size, size_t offset);
+  virtual void advise(size_t offset, size_t size, Advice advice) {
+    mReader->advise(offset, size, advice);
+  }
+
+  // the cached reader, for bulk reads that shouldn't go through the cache
+  BinaryReader *getReader() const { return mReader; }
+  uint64_t getHits() const { return mHits; }
+  uint64_t getMisses() const { return mMisses; }
+
+private:
+  std::shared_ptr<const Block> getBlock(uint64_t index);
+  std::shared_ptr<const Block> loadBlock(uint64_t index);
+  void insert(Shard &shard, uint64_t index,
+              const std::shared_ptr<const Block> &block);
+  void evict(Shard &shard);
+};
+
+#endif
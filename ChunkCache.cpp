@@ -0,0 +1,62 @@
+#include <algorithm>
+#include "ChunkCache.h"
+
+ChunkCache::ChunkCache(size_t budget, unsigned int shards)
+    : mBudget(budget), mShardBudget(budget / (shards ? shards : 1)),
+      mShards(shards ? shards : 1) {
+  for (Shard &shard : mShards) {
+    shard.bytes = 0;
+  }
+}
+
+void ChunkCache::setChunkSize(size_t chunkSize) {
+  const size_t shardBudget = MIN_SHARD_CHUNKS * chunkSize;
+  if (shardBudget == 0 || mShardBudget >= shardBudget) {
+    return;
+  }
+
+  const size_t shards =
+      std::max<size_t>(1, std::min(mShards.size(), mBudget / shardBudget));
+  if (shards != mShards.size()) {
+    std::vector<Shard> resized(shards);
+    for (Shard &shard : resized) {
+      shard.bytes = 0;
+    }
+    mShards.swap(resized);
+  }
+  mShardBudget = std::max(mBudget / shards, shardBudget);
+}
+
+std::shared_ptr<const ChunkCache::Chunk> ChunkCache::get(uint64_t index) {
+  Shard &shard = getShard(index);
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  const auto it = shard.entries.find(index);
+  if (it == shard.entries.end()) {
+    return nullptr;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second.position);
+  return it->second.chunk;
+}
+
+void ChunkCache::put(uint64_t index,
+                     const std::shared_ptr<const Chunk> &chunk) {
+  Shard &shard = getShard(index);
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  // two threads may have decoded the same chunk, keep the first one
+  if (shard.entries.count(index) != 0 || chunk->size() > mShardBudget) {
+    return;
+  }
+
+  while (!shard.lru.empty() && shard.bytes + chunk->size() > mShardBudget) {
+    const auto victim = shard.entries.find(shard.lru.back());
+    shard.bytes -= victim->second.chunk->size();
+    shard.entries.erase(victim);
+    shard.lru.pop_back();
+  }
+
+  shard.lru.push_front(index);
+  shard.entries[index] = Entry{shard.lru.begin(), chunk};
+  shard.bytes += chunk->size();
+}
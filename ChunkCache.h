@@ -0,0 +1,58 @@
+#ifndef __CHUNK_CACHE__H_
+#define __CHUNK_CACHE__H_
+
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Bounded LRU of decoded chunks keyed by chunk index, shared by the readers
+// of compressed images so every chunk is only decompressed once while it's
+// hot. Chunks are handed out as shared pointers, so one being evicted while
+// a reader still copies out of it is harmless.
+class ChunkCache {
+public:
+  typedef std::vector<unsigned char> Chunk;
+
+  static const unsigned int DEFAULT_SHARDS = 8;
+  // chunks every shard can hold at least, so a shard isn't thrashed by the
+  // next chunk that maps to it
+  static const size_t MIN_SHARD_CHUNKS = 2;
+
+private:
+  struct Entry {
+    std::list<uint64_t>::iterator position;
+    std::shared_ptr<const Chunk> chunk;
+  };
+
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::list<uint64_t> lru; // front is most recent
+    size_t bytes;
+  };
+
+  size_t mBudget;
+  size_t mShardBudget;
+  std::vector<Shard> mShards;
+
+public:
+  // budget is the total bytes of chunk data kept across all shards
+  explicit ChunkCache(size_t budget, unsigned int shards = DEFAULT_SHARDS);
+
+  // Fits the shards to chunks of up to chunkSize bytes, which the image
+  // only tells once it's opened: fewer shards when the budget can't give
+  // each MIN_SHARD_CHUNKS of them, then a larger budget if not even one
+  // shard could. Only before the first put.
+  void setChunkSize(size_t chunkSize);
+
+  std::shared_ptr<const Chunk> get(uint64_t index);
+  void put(uint64_t index, const std::shared_ptr<const Chunk> &chunk);
+
+private:
+  Shard &getShard(uint64_t index) { return mShards[index % mShards.size()]; }
+};
+
+#endif
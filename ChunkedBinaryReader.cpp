@@ -0,0 +1,117 @@
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include "ChunkedBinaryReader.h"
+
+ChunkedBinaryReader::ChunkedBinaryReader(BinaryReader *reader,
+                                         ThreadPool *pool, size_t cacheSize)
+    : mReader(reader), mPool(pool), mCache(cacheSize), mDataSize(0),
+      mChunkSize(1), mDecoded(0) {}
+
+ChunkedBinaryReader::~ChunkedBinaryReader() { delete mReader; }
+
+int ChunkedBinaryReader::read(void *buf, int size, size_t offset) {
+  if (size <= 0 || offset >= mDataSize) {
+    return 0;
+  }
+
+  const size_t length =
+      std::min(static_cast<uint64_t>(size), mDataSize - offset);
+  const uint64_t first = offset / mChunkSize;
+  const uint64_t last = (offset + length - 1) / mChunkSize;
+  std::vector<std::shared_ptr<const ChunkCache::Chunk>> chunks;
+
+  if (!getChunks(first, last - first + 1, &chunks)) {
+    return -1;
+  }
+
+  unsigned char *const out = reinterpret_cast<unsigned char *>(buf);
+  size_t done = 0;
+  for (const auto &chunk : chunks) {
+    const size_t within = (offset + done) % mChunkSize;
+    if (within >= chunk->size()) {
+      break;
+    }
+    const size_t count = std::min(length - done, chunk->size() - within);
+    memcpy(out + done, chunk->data() + within, count);
+    done += count;
+  }
+  return done;
+}
+
+std::shared_ptr<const ChunkCache::Chunk>
+ChunkedBinaryReader::getChunk(uint64_t index) {
+  std::shared_ptr<const ChunkCache::Chunk> chunk = mCache.get(index);
+
+  if (chunk) {
+    return chunk;
+  }
+
+  // decode without holding anything, racing readers of the same chunk both
+  // decode it and the cache keeps whichever lands first
+  std::shared_ptr<ChunkCache::Chunk> decoded(new ChunkCache::Chunk());
+  if (!decodeChunk(index, decoded.get())) {
+    return nullptr;
+  }
+  ++mDecoded;
+  mCache.put(index, decoded);
+  return decoded;
+}
+
+bool ChunkedBinaryReader::getChunks(
+    uint64_t first, size_t count,
+    std::vector<std::shared_ptr<const ChunkCache::Chunk>> *chunks) {
+  if (count == 1 || mPool == nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      chunks->push_back(getChunk(first + i));
+      if (!chunks->back()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Workers and the calling thread all claim chunks from the same counter.
+  // The caller only ever waits for chunks somebody is already decoding, so
+  // this can't deadlock when it's called from a pool thread itself, and
+  // helpers that start after everything is claimed just return.
+  struct Batch {
+    std::mutex lock;
+    std::condition_variable finished;
+    std::atomic<size_t> next;
+    size_t remaining;
+    std::vector<std::shared_ptr<const ChunkCache::Chunk>> chunks;
+  };
+  const std::shared_ptr<Batch> batch(new Batch());
+  batch->next = 0;
+  batch->remaining = count;
+  batch->chunks.resize(count);
+
+  const auto work = [this, batch, first, count]() {
+    size_t i;
+    while ((i = batch->next++) < count) {
+      batch->chunks[i] = getChunk(first + i);
+      std::lock_guard<std::mutex> guard(batch->lock);
+      if (--batch->remaining == 0) {
+        batch->finished.notify_one();
+      }
+    }
+  };
+
+  const size_t helpers = std::min<size_t>(count - 1, mPool->size());
+  for (size_t i = 0; i < helpers; ++i) {
+    mPool->submit(work);
+  }
+  work();
+
+  std::unique_lock<std::mutex> guard(batch->lock);
+  batch->finished.wait(guard, [&batch] { return batch->remaining == 0; });
+  for (const auto &chunk : batch->chunks) {
+    if (!chunk) {
+      return false;
+    }
+  }
+  chunks->swap(batch->chunks);
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef __CHUNKED_BINARY_READER__H_
+#define __CHUNKED_BINARY_READER__H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include "BinaryReader.h"
+#include "ChunkCache.h"
+#include "ThreadPool.h"
+
+// Base of the readers for images stored as independently decoded chunks,
+// e.g. compressed ones. Decoded chunks are kept in a ChunkCache and a read
+// spanning several missing chunks decodes them in parallel on the pool.
+class ChunkedBinaryReader : public BinaryReader {
+public:
+  static const size_t DEFAULT_CACHE_SIZE = 32 * 1024 * 1024;
+
+protected:
+  BinaryReader *mReader; // the container the chunks are stored in
+
+private:
+  ThreadPool *mPool;
+  ChunkCache mCache;
+  uint64_t mDataSize;
+  size_t mChunkSize;
+  std::atomic<uint64_t> mDecoded;
+
+public:
+  // Takes ownership of reader, pool may be null to decode on the calling
+  // thread only
+  ChunkedBinaryReader(BinaryReader *reader, ThreadPool *pool,
+                      size_t cacheSize = DEFAULT_CACHE_SIZE);
+  virtual ~ChunkedBinaryReader();
+
+  virtual int read(void *buf, int size, size_t offset);
+
+  // size of the image the chunks decode to
+  uint64_t getDataSize() const { return mDataSize; }
+  size_t getChunkSize() const { return mChunkSize; }
+  uint64_t getDecodedChunks() const { return mDecoded; }
+
+protected:
+  // called by subclasses once they know the layout
+  void setGeometry(uint64_t dataSize, size_t chunkSize) {
+    mDataSize = dataSize;
+    mChunkSize = chunkSize;
+    // WIA takes its chunk size from the image, it may be any size
+    mCache.setChunkSize(chunkSize);
+  }
+
+  // Decodes the bytes at index * chunkSize into chunk, which is only shorter
+  // than chunkSize at the end of the image. Called from several threads.
+  virtual bool decodeChunk(uint64_t index, ChunkCache::Chunk *chunk) = 0;
+
+private:
+  std::shared_ptr<const ChunkCache::Chunk> getChunk(uint64_t index);
+  bool getChunks(uint64_t first, size_t count,
+                 std::vector<std::shared_ptr<const ChunkCache::Chunk>> *chunks);
+};
+
+#endif
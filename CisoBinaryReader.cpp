@@ -0,0 +1,118 @@
+#include <endian.h>
+#include <string.h>
+#include <algorithm>
+#include "CisoBinaryReader.h"
+
+static const char CISO_MAGIC[4] = {'C', 'I', 'S', 'O'};
+
+CisoBinaryReader::CisoBinaryReader(BinaryReader *reader)
+    : mReader(reader), mBlockSize(0) {}
+
+CisoBinaryReader::~CisoBinaryReader() { delete mReader; }
+
+bool CisoBinaryReader::detect(BinaryReader *reader) {
+  char magic[sizeof(CISO_MAGIC)];
+
+  return reader->read(magic, sizeof(magic), 0) ==
+             static_cast<int>(sizeof(magic)) &&
+         memcmp(magic, CISO_MAGIC, sizeof(magic)) == 0;
+}
+
+bool CisoBinaryReader::open() {
+  std::vector<unsigned char> buffer(sizeof(struct ciso_header));
+  const struct ciso_header *const header =
+      reinterpret_cast<const struct ciso_header *>(buffer.data());
+
+  if (mReader->read(buffer.data(), buffer.size(), 0) !=
+          static_cast<int>(buffer.size()) ||
+      memcmp(header->magic, CISO_MAGIC, sizeof(CISO_MAGIC)) != 0) {
+    return false;
+  }
+  mBlockSize = le32toh(header->block_size);
+  if (mBlockSize == 0) {
+    return false;
+  }
+
+  // like Dolphin, the image covers every block the map can describe
+  mPresentBefore.resize(sizeof(header->map) + 1);
+  mPresentBefore[0] = 0;
+  for (size_t i = 0; i < sizeof(header->map); ++i) {
+    mPresentBefore[i + 1] = mPresentBefore[i] + (header->map[i] ? 1 : 0);
+  }
+  return true;
+}
+
+int CisoBinaryReader::read(void *buf, int size, size_t offset) {
+  unsigned char *const out = reinterpret_cast<unsigned char *>(buf);
+  const uint64_t dataSize = getDataSize();
+  size_t done = 0;
+
+  if (size <= 0 || offset >= dataSize) {
+    return 0;
+  }
+
+  const size_t length = std::min<uint64_t>(size, dataSize - offset);
+  while (done < length) {
+    const size_t position = offset + done;
+    size_t block = position / mBlockSize;
+    const bool present = isPresent(block);
+
+    // gather the run of blocks that are all stored or all absent, stored
+    // runs are contiguous in the image and take a single read
+    do {
+      ++block;
+    } while (block * mBlockSize < position + (length - done) &&
+             isPresent(block) == present);
+    const size_t count =
+        std::min<uint64_t>(block * mBlockSize, offset + length) - position;
+
+    if (!present) {
+      memset(out + done, 0, count);
+    } else {
+      const int read =
+          mReader->read(out + done, count, getPhysicalOffset(position));
+      if (read < 0) {
+        return done > 0 ? done : -1;
+      }
+      if (static_cast<size_t>(read) < count) {
+        return done + read;
+      }
+    }
+    done += count;
+  }
+  return done;
+}
+
+const void *CisoBinaryReader::map(size_t offset, size_t size) {
+  if (size == 0 || offset + size > getDataSize()) {
+    return nullptr;
+  }
+
+  // only a range of stored blocks is laid out contiguously in the image
+  const size_t first = offset / mBlockSize;
+  const size_t last = (offset + size - 1) / mBlockSize;
+  if (mPresentBefore[last + 1] - mPresentBefore[first] != last - first + 1) {
+    return nullptr;
+  }
+  return mReader->map(getPhysicalOffset(offset), size);
+}
+
+void CisoBinaryReader::advise(size_t offset, size_t size, Advice advice) {
+  const uint64_t dataSize = getDataSize();
+
+  if (size == 0 || offset >= dataSize) {
+    return;
+  }
+
+  // the stored blocks of the range are contiguous in the image, absent ones
+  // simply take no space
+  const size_t end = std::min<uint64_t>(offset + size, dataSize);
+  const uint64_t first = sizeof(struct ciso_header) +
+                         mPresentBefore[offset / mBlockSize] * mBlockSize;
+  const uint64_t last =
+      sizeof(struct ciso_header) +
+      mPresentBefore[(end + mBlockSize - 1) / mBlockSize] * mBlockSize;
+  if (last > first) {
+    mReader->advise(first, last - first, advice);
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef __CISO_BINARY_READER__H_
+#define __CISO_BINARY_READER__H_
+
+#include <stdint.h>
+#include <vector>
+#include "BinaryReader.h"
+
+// CISO images: a little endian block size and a presence map in a 32 KiB
+// header, followed by only the blocks that aren't entirely zero.
+#pragma pack(1)
+struct ciso_header {
+  char magic[4];
+  uint32_t block_size;
+  uint8_t map[0x8000 - 8];
+};
+#pragma pack()
+
+// Reads a CISO image as the ISO it was made from. Absent blocks read as
+// zeros without touching the image.
+class CisoBinaryReader : public BinaryReader {
+private:
+  BinaryReader *mReader;
+  uint64_t mBlockSize;
+  // mPresentBefore[i] is the number of stored blocks before block i, which
+  // is block i's position in the image if it's stored at all
+  std::vector<uint32_t> mPresentBefore;
+
+public:
+  // Takes ownership of reader
+  explicit CisoBinaryReader(BinaryReader *reader);
+  virtual ~CisoBinaryReader();
+
+  bool open();
+
+  // true if the reader's contents start with the CISO magic
+  static bool detect(BinaryReader *reader);
+
+  virtual int read(void *buf, int size, size_t offset);
+  virtual const void *map(size_t offset, size_t size);
+  virtual void advise(size_t offset, size_t size, Advice advice);
+
+  uint64_t getDataSize() const {
+    return (mPresentBefore.size() - 1) * mBlockSize;
+  }
+
+private:
+  bool isPresent(size_t block) const {
+    return mPresentBefore[block + 1] != mPresentBefore[block];
+  }
+  uint64_t getPhysicalOffset(size_t offset) const {
+    return sizeof(struct ciso_header) +
+           mPresentBefore[offset / mBlockSize] * mBlockSize +
+           offset % mBlockSize;
+  }
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include <zlib.h>
+#include "Crc32.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_PCLMUL 1
+#endif
+
+#ifdef CRC32_PCLMUL
+namespace {
+
+// Folding constants for the bit reflected polynomial 0xEDB88320, x^n mod P
+// for the distances folded over, the same ones the Linux kernel and zlib-ng
+// use
+const uint64_t k1 = 0x154442bd4; // fold by 4, 512 bits
+const uint64_t k2 = 0x1c6e41596;
+const uint64_t k3 = 0x1751997d0; // fold by 1, 128 bits
+const uint64_t k4 = 0x0ccaa009e;
+const uint64_t k5 = 0x163cd6124; // 64 to 32 bits
+const uint64_t poly = 0x1db710641; // P'
+const uint64_t mu = 0x1f7011641;   // Barrett constant
+
+// one 128 bit lane folded forward over distance and xored with data
+__attribute__((target("pclmul,sse4.1"))) inline __m128i
+fold(__m128i lane, __m128i constants, __m128i data) {
+  const __m128i low = _mm_clmulepi64_si128(lane, constants, 0x00);
+  const __m128i high = _mm_clmulepi64_si128(lane, constants, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(low, high), data);
+}
+
+// Takes and returns the CRC register without zlib's final inversion. size
+// must be a multiple of 16 and at least 64.
+__attribute__((target("pclmul,sse4.1"))) uint32_t
+crc32_pclmul(uint32_t crc, const unsigned char *buf, size_t size) {
+  const __m128i *p = reinterpret_cast<const __m128i *>(buf);
+  __m128i x1 = _mm_loadu_si128(p);
+  __m128i x2 = _mm_loadu_si128(p + 1);
+  __m128i x3 = _mm_loadu_si128(p + 2);
+  __m128i x4 = _mm_loadu_si128(p + 3);
+  __m128i constants = _mm_set_epi64x(k2, k1);
+
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  p += 4;
+  size -= 64;
+
+  // four independent lanes keep the multipliers busy
+  while (size >= 64) {
+    x1 = fold(x1, constants, _mm_loadu_si128(p));
+    x2 = fold(x2, constants, _mm_loadu_si128(p + 1));
+    x3 = fold(x3, constants, _mm_loadu_si128(p + 2));
+    x4 = fold(x4, constants, _mm_loadu_si128(p + 3));
+    p += 4;
+    size -= 64;
+  }
+
+  constants = _mm_set_epi64x(k4, k3);
+  x1 = fold(x1, constants, x2);
+  x1 = fold(x1, constants, x3);
+  x1 = fold(x1, constants, x4);
+  while (size >= 16) {
+    x1 = fold(x1, constants, _mm_loadu_si128(p));
+    ++p;
+    size -= 16;
+  }
+
+  // 128 bits down to 64
+  const __m128i mask32 = _mm_set_epi32(0, 0, 0, ~0);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, constants, 0x10),
+                     _mm_srli_si128(x1, 8));
+  // then to 32
+  constants = _mm_set_epi64x(0, k5);
+  x1 = _mm_xor_si128(
+      _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), constants, 0x00),
+      _mm_srli_si128(x1, 4));
+  // Barrett reduction to the remainder
+  constants = _mm_set_epi64x(mu, poly);
+  __m128i quotient = _mm_and_si128(x1, mask32);
+  quotient = _mm_clmulepi64_si128(quotient, constants, 0x10);
+  quotient = _mm_and_si128(quotient, mask32);
+  x1 = _mm_xor_si128(x1, _mm_clmulepi64_si128(quotient, constants, 0x00));
+  return _mm_extract_epi32(x1, 1);
+}
+
+// static initializers may run before the runtime's own CPU detection
+bool detect() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+const bool accelerated = detect();
+
+} // namespace
+#endif
+
+bool crc32_is_accelerated() {
+#ifdef CRC32_PCLMUL
+  return accelerated;
+#else
+  return false;
+#endif
+}
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t size) {
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(buf);
+
+#ifdef CRC32_PCLMUL
+  if (accelerated && size >= 64) {
+    const size_t bulk = size & ~static_cast<size_t>(15);
+    crc = ~crc32_pclmul(~crc, data, bulk);
+    data += bulk;
+    size -= bulk;
+  }
+#endif
+  // zlib takes sizes as uInt
+  while (size > 0) {
+    const uInt length = size > 0x40000000 ? 0x40000000 : size;
+    crc = crc32(crc, data, length);
+    data += length;
+    size -= length;
+  }
+  return crc;
+}
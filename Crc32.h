@@ -0,0 +1,19 @@
+#ifndef __CRC32__H_
+#define __CRC32__H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 as zlib and redump compute it. On x86 processors with carry-less
+// multiplication the bulk of the data is folded 64 bytes at a time with
+// PCLMULQDQ, several times faster than zlib's table driven loop, which
+// handles everything else.
+//
+// Like zlib's crc32(), start with 0 and pass the previous result to
+// continue a checksum.
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t size);
+
+// whether crc32_update runs on PCLMULQDQ
+bool crc32_is_accelerated();
+
+#endif
@@ -0,0 +1,296 @@
+#include <openssl/evp.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "Crc32.h"
+#include "DiscVerifier.h"
+
+namespace {
+
+void appendHex(std::string *out, const unsigned char *bytes, size_t length) {
+  static const char digits[] = "0123456789abcdef";
+
+  for (size_t i = 0; i < length; ++i) {
+    out->push_back(digits[bytes[i] >> 4]);
+    out->push_back(digits[bytes[i] & 15]);
+  }
+}
+
+// Hashes every file as the chunks it lies in go by. Files are started in
+// disc order once the chunks reach them and finished once their last byte
+// went by, so only the few files spanning a chunk are ever being hashed.
+class FileHasher {
+private:
+  struct Active {
+    size_t file;
+    uint64_t done;
+    uint32_t crc32;
+    EVP_MD_CTX *sha1;
+  };
+
+  std::vector<DiscVerifier::FileDigests> &mFiles;
+  std::vector<size_t> mOrder;
+  size_t mNext;
+  std::vector<Active> mActive;
+
+public:
+  explicit FileHasher(std::vector<DiscVerifier::FileDigests> &files)
+      : mFiles(files), mNext(0) {
+    for (size_t i = 0; i < files.size(); ++i) {
+      mOrder.push_back(i);
+    }
+    std::stable_sort(mOrder.begin(), mOrder.end(),
+                     [&files](size_t a, size_t b) {
+                       return files[a].offset < files[b].offset;
+                     });
+  }
+
+  // files cut short by the end of the image keep what they got
+  ~FileHasher() {
+    for (Active &active : mActive) {
+      finish(active);
+    }
+  }
+
+  void update(uint64_t offset, const unsigned char *data, size_t length) {
+    const uint64_t end = offset + length;
+
+    while (mNext < mOrder.size() && mFiles[mOrder[mNext]].offset < end) {
+      Active active = {mOrder[mNext++], 0, 0, EVP_MD_CTX_new()};
+      EVP_DigestInit_ex(active.sha1, EVP_sha1(), nullptr);
+      mActive.push_back(active);
+    }
+
+    for (size_t i = 0; i < mActive.size();) {
+      Active &active = mActive[i];
+      const DiscVerifier::FileDigests &file = mFiles[active.file];
+      const uint64_t from = file.offset + active.done;
+      const uint64_t to = std::min(file.offset + file.length, end);
+      if (from < to) {
+        active.crc32 = crc32_update(active.crc32, data + (from - offset),
+                                    to - from);
+        EVP_DigestUpdate(active.sha1, data + (from - offset), to - from);
+        active.done += to - from;
+      }
+      if (active.done == file.length) {
+        finish(active);
+        mActive[i] = mActive.back();
+        mActive.pop_back();
+      } else {
+        ++i;
+      }
+    }
+  }
+
+private:
+  void finish(Active &active) {
+    DiscVerifier::FileDigests &file = mFiles[active.file];
+
+    file.crc32 = active.crc32;
+    EVP_DigestFinal_ex(active.sha1, file.sha1, nullptr);
+    EVP_MD_CTX_free(active.sha1);
+  }
+};
+
+} // namespace
+
+DiscVerifier::DiscVerifier(BinaryReader *reader,
+                           const GamecubeFilesystemTable &fst)
+    : mReader(reader), mChunksRead(0), mEnd(false), mHashed(0),
+      mCancelled(false), mDone(false), mFailed(false), mSeconds(0) {
+  memset(&mDigests, 0, sizeof(mDigests));
+  collectFiles(fst, &mFiles);
+}
+
+void DiscVerifier::collectFiles(const GamecubeFilesystemTable &fst,
+                                std::vector<FileDigests> *files) {
+  const gc_dvdfs_file_entry *const root = fst.getRoot();
+  // directories being walked, the index their entries end at and their path
+  std::vector<std::pair<uint32_t, std::string>> directories;
+
+  directories.push_back(std::make_pair(fst.getEntryCount(), ""));
+  for (uint32_t i = 1; i < fst.getEntryCount(); ++i) {
+    const gc_dvdfs_file_entry *const pfe = root + i;
+    while (directories.size() > 1 && i >= directories.back().first) {
+      directories.pop_back();
+    }
+    const std::string path =
+        directories.back().second + fst.getFileName(pfe);
+    if (fst.isDirectory(pfe)) {
+      directories.push_back(std::make_pair(fst.getNext(pfe), path + "/"));
+      continue;
+    }
+    FileDigests file;
+    memset(file.sha1, 0, sizeof(file.sha1));
+    file.path = path;
+    file.offset = fst.getFileOffset(pfe);
+    file.length = fst.getFileLength(pfe);
+    file.crc32 = 0;
+    files->push_back(file);
+  }
+}
+
+bool DiscVerifier::run() {
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> hashers;
+
+  for (Buffer &buffer : mBuffers) {
+    buffer.data.resize(CHUNK_SIZE);
+    buffer.pending = 0;
+  }
+  for (unsigned int i = 0; i < HASH_COUNT; ++i) {
+    hashers.emplace_back(&DiscVerifier::hash, this, static_cast<Hasher>(i));
+  }
+  readChunks();
+  for (std::thread &hasher : hashers) {
+    hasher.join();
+  }
+  for (Buffer &buffer : mBuffers) {
+    std::vector<unsigned char>().swap(buffer.data);
+  }
+
+  mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           start)
+                 .count();
+  if (mCancelled) {
+    mFailed = true;
+  }
+  mDone = true;
+  return !mFailed;
+}
+
+void DiscVerifier::readChunks() {
+  const size_t reads = CHUNK_SIZE / READ_SIZE;
+  BinaryReader::Request requests[reads];
+  bool end = false;
+
+  for (uint64_t chunk = 0; !end; ++chunk) {
+    Buffer &buffer = mBuffers[chunk % BUFFERS];
+    {
+      std::unique_lock<std::mutex> guard(mLock);
+      mReleased.wait(guard, [&buffer] { return buffer.pending == 0; });
+    }
+
+    const uint64_t offset = chunk * CHUNK_SIZE;
+    for (size_t i = 0; i < reads; ++i) {
+      requests[i].buf = buffer.data.data() + i * READ_SIZE;
+      requests[i].size = READ_SIZE;
+      requests[i].offset = offset + i * READ_SIZE;
+    }
+    mReader->readBatch(requests, reads);
+
+    // the image ends at the first short read
+    size_t length = 0;
+    for (size_t i = 0; i < reads && !end; ++i) {
+      if (requests[i].result < 0) {
+        mFailed = true;
+        end = true;
+      } else {
+        length += requests[i].result;
+        end = static_cast<size_t>(requests[i].result) < READ_SIZE;
+      }
+    }
+    end = end || mCancelled;
+
+    std::lock_guard<std::mutex> guard(mLock);
+    if (length > 0) {
+      buffer.offset = offset;
+      buffer.length = length;
+      buffer.pending = HASH_COUNT;
+      ++mChunksRead;
+      mDigests.size += length;
+    }
+    mEnd = end;
+    mRead.notify_all();
+  }
+}
+
+void DiscVerifier::hash(Hasher hasher) {
+  EVP_MD_CTX *context = nullptr;
+  uint32_t crc32 = 0;
+  std::unique_ptr<FileHasher> files;
+
+  if (hasher == HASH_FILES) {
+    files.reset(new FileHasher(mFiles));
+  } else if (hasher == HASH_MD5 || hasher == HASH_SHA1) {
+    context = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(context, hasher == HASH_MD5 ? EVP_md5() : EVP_sha1(),
+                      nullptr);
+  }
+
+  for (uint64_t chunk = 0;; ++chunk) {
+    Buffer &buffer = mBuffers[chunk % BUFFERS];
+    {
+      std::unique_lock<std::mutex> guard(mLock);
+      mRead.wait(guard, [this, chunk] { return mChunksRead > chunk || mEnd; });
+      if (mChunksRead <= chunk) {
+        break;
+      }
+    }
+
+    switch (hasher) {
+    case HASH_CRC32:
+      crc32 = crc32_update(crc32, buffer.data.data(), buffer.length);
+      break;
+    case HASH_MD5:
+    case HASH_SHA1:
+      EVP_DigestUpdate(context, buffer.data.data(), buffer.length);
+      break;
+    case HASH_FILES:
+      files->update(buffer.offset, buffer.data.data(), buffer.length);
+      break;
+    case HASH_COUNT:
+      break;
+    }
+
+    std::lock_guard<std::mutex> guard(mLock);
+    if (--buffer.pending == 0) {
+      mHashed += buffer.length;
+      mReleased.notify_all();
+    }
+  }
+
+  if (hasher == HASH_CRC32) {
+    mDigests.crc32 = crc32;
+  } else if (context) {
+    EVP_DigestFinal_ex(context,
+                       hasher == HASH_MD5 ? mDigests.md5 : mDigests.sha1,
+                       nullptr);
+    EVP_MD_CTX_free(context);
+  }
+}
+
+void DiscVerifier::writeReport(std::string *out, bool files) const {
+  char line[128];
+
+  if (mFailed) {
+    out->append("verification failed\n");
+    return;
+  }
+  snprintf(line, sizeof(line), "size %llu\ncrc32 %08x\n",
+           static_cast<unsigned long long>(mDigests.size), mDigests.crc32);
+  out->append(line);
+  out->append("md5 ");
+  appendHex(out, mDigests.md5, sizeof(mDigests.md5));
+  out->append("\nsha1 ");
+  appendHex(out, mDigests.sha1, sizeof(mDigests.sha1));
+  snprintf(line, sizeof(line), "\nseconds %.3f\nspeed %.2f GB/s\n", mSeconds,
+           mSeconds > 0 ? mDigests.size / mSeconds / 1e9 : 0);
+  out->append(line);
+
+  if (!files) {
+    return;
+  }
+  out->append("\n");
+  for (const FileDigests &file : mFiles) {
+    snprintf(line, sizeof(line), "%08x ", file.crc32);
+    out->append(line);
+    appendHex(out, file.sha1, sizeof(file.sha1));
+    out->append(" data/");
+    out->append(file.path);
+    out->append("\n");
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef __DISC_VERIFIER__H_
+#define __DISC_VERIFIER__H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "BinaryReader.h"
+#include "GamecubeFilesystemTable.h"
+
+// Hashes a whole image the way redump lists discs, CRC-32, MD5 and SHA-1,
+// plus a CRC-32 and SHA-1 of every file in the FST, in one pass over the
+// image.
+//
+// One thread reads the image in large chunks, as a batch of reads so
+// readers that can keep several in flight do, into a few buffers that take
+// turns. Each hash runs on a thread of its own over the same buffers while
+// the next chunks are being read, so the pass runs as fast as the slowest
+// of the reads and the hashes rather than their sum.
+class DiscVerifier {
+public:
+  static const size_t CHUNK_SIZE = 8 * 1024 * 1024;
+  static const size_t READ_SIZE = 1024 * 1024;
+  // chunks being read or hashed at once
+  static const unsigned int BUFFERS = 4;
+
+  struct Digests {
+    uint64_t size;
+    uint32_t crc32;
+    unsigned char md5[16];
+    unsigned char sha1[20];
+  };
+
+  struct FileDigests {
+    std::string path; // below data/
+    uint64_t offset;
+    uint32_t length;
+    uint32_t crc32;
+    unsigned char sha1[20];
+  };
+
+private:
+  // what each hashing thread does with the chunks
+  enum Hasher { HASH_CRC32, HASH_MD5, HASH_SHA1, HASH_FILES, HASH_COUNT };
+
+  struct Buffer {
+    std::vector<unsigned char> data;
+    uint64_t offset;
+    size_t length;
+    unsigned int pending; // hashers not done with it yet
+  };
+
+  BinaryReader *mReader;
+  Digests mDigests;
+  std::vector<FileDigests> mFiles;
+
+  std::mutex mLock;
+  std::condition_variable mRead;     // a chunk was read
+  std::condition_variable mReleased; // a chunk was hashed by everyone
+  Buffer mBuffers[BUFFERS];
+  uint64_t mChunksRead;
+  bool mEnd;
+
+  std::atomic<uint64_t> mHashed; // bytes the slowest hasher is done with
+  std::atomic<bool> mCancelled;
+  std::atomic<bool> mDone;
+  std::atomic<bool> mFailed;
+  double mSeconds;
+
+public:
+  DiscVerifier(BinaryReader *reader, const GamecubeFilesystemTable &fst);
+
+  // hashes the image, returns false if it couldn't be read or was cancelled
+  bool run();
+  // makes run return early
+  void cancel() { mCancelled = true; }
+
+  // whether run has returned, successfully or not
+  bool isDone() const { return mDone; }
+  bool hasFailed() const { return mFailed; }
+  uint64_t getHashed() const { return mHashed; }
+  // only valid once done
+  const Digests &getDigests() const { return mDigests; }
+  const std::vector<FileDigests> &getFiles() const { return mFiles; }
+  double getSeconds() const { return mSeconds; }
+
+  // Appends the results as text, the image's hashes and speed, then if
+  // files is set one line per file with its CRC-32, SHA-1 and path
+  void writeReport(std::string *out, bool files) const;
+
+private:
+  void readChunks();
+  void hash(Hasher hasher);
+  static void collectFiles(const GamecubeFilesystemTable &fst,
+                           std::vector<FileDigests> *files);
+};
+
+#endif
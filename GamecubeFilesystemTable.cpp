@@ -1,38 +1,24 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <utility>
 #include "GamecubeFilesystemTable.h"
+#include "NameCompare.h"
 
-#define be32_to_cpu(x) be32toh(x)
-
-static inline uint32_t directoryEntries(struct gc_dvdfs_file_entry *root) {
+static inline uint32_t
+directoryEntries(const struct gc_dvdfs_file_entry *root) {
   return root->dir.offset_next;
 }
 
-static void gc_dvdfs_fix_raw_dol_header(struct gc_dvdfs_dol_header *pdh) {
-#define SWAP(a) (a) = be32_to_cpu(a)
-  unsigned int i;
-
-  for (i = 0; i < 7; ++i) {
-    SWAP(pdh->text_file_pos[i]);
-    SWAP(pdh->text_mem_pos[i]);
-    SWAP(pdh->text_section_size[i]);
-  }
-
-  for (i = 0; i < 11; ++i) {
-    SWAP(pdh->data_file_pos[i]);
-    SWAP(pdh->data_mem_pos[i]);
-    SWAP(pdh->data_section_size[i]);
-  }
-
-  SWAP(pdh->bss_mem_address);
-  SWAP(pdh->bss_size);
-  SWAP(pdh->entry_point);
-}
-
-static uint32_t gc_dvdfs_get_dol_file_size(struct gc_dvdfs_dol_header *pdh) {
+static uint32_t
+gc_dvdfs_get_dol_file_size(const struct gc_dvdfs_dol_header *pdh) {
   uint32_t tmp;
   uint32_t i;
   uint32_t max = 0;
@@ -50,24 +36,115 @@ static uint32_t gc_dvdfs_get_dol_file_size(struct gc_dvdfs_dol_header *pdh) {
   return max;
 }
 
-GamecubeFilesystemTable::GamecubeFilesystemTable()
-    : root(nullptr), str_table(nullptr), size(0), str_table_size(0),
-      dol_length(0), dol_offset(0), total_files(0), total_directories(0),
-      total_file_size(0)
+/* the tables and sections of index files start 8 byte aligned */
+static uint64_t alignIndexSection(uint64_t offset) {
+  return (offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+/* the tables open builds are its own, only mapped ones are read only */
+template <typename T> static T *writable(const T *table) {
+  return const_cast<T *>(table);
+}
 
-{
+GamecubeFilesystemTable::GamecubeFilesystemTable()
+    : root(nullptr), fst_copy(nullptr), str_table(nullptr), size(0),
+      str_table_size(0), dol_length(0), dol_offset(0), total_files(0),
+      total_directories(0), total_file_size(0), types(nullptr),
+      parents(nullptr), nexts(nullptr), offsets(nullptr), lengths(nullptr),
+      name_offsets(nullptr), name_lengths(nullptr), name_hashes(nullptr),
+      directory_info(nullptr), first_children(nullptr), children(nullptr),
+      child_keys(nullptr), folded_children(nullptr), folded_keys(nullptr),
+      index_file(nullptr), index_file_size(0) {
   memset(&apploader, 0, sizeof(apploader));
   memset(&dol_header, 0, sizeof(dol_header));
 }
 
-GamecubeFilesystemTable::~GamecubeFilesystemTable() {
-  if (root) {
-    delete[] reinterpret_cast<unsigned char *>(root);
+GamecubeFilesystemTable::~GamecubeFilesystemTable() { close(); }
+
+void GamecubeFilesystemTable::close() {
+  pointTables(nullptr, 0);
+  std::vector<uint64_t>().swap(tables_storage);
+  if (fst_copy) {
+    delete[] fst_copy;
+    fst_copy = nullptr;
   }
+  if (index_file) {
+    munmap(index_file, index_file_size);
+    index_file = nullptr;
+  }
+  root = nullptr;
+}
+
+size_t GamecubeFilesystemTable::getMemoryUsage() const {
+  return (fst_copy ? size : 0) +
+         tables_storage.capacity() * sizeof(tables_storage[0]);
+}
+
+GamecubeFilesystemTable::table_layout
+GamecubeFilesystemTable::layoutTables(uint32_t entries) {
+  table_layout layout;
+  uint64_t offset = 0;
+  auto place = [&offset, entries](uint64_t element) {
+    const uint64_t at = offset;
+    offset = alignIndexSection(offset + entries * element);
+    return at;
+  };
+
+  layout.types = place(sizeof(uint8_t));
+  layout.parents = place(sizeof(uint32_t));
+  layout.nexts = place(sizeof(uint32_t));
+  layout.offsets = place(sizeof(uint32_t));
+  layout.lengths = place(sizeof(uint32_t));
+  layout.name_offsets = place(sizeof(uint32_t));
+  layout.name_lengths = place(sizeof(uint32_t));
+  layout.name_hashes = place(sizeof(uint32_t));
+  layout.directory_info = place(sizeof(gc_dvdfs_directory_info));
+  layout.first_children = place(sizeof(uint32_t));
+  /* room for every entry, only the root and invalid ones go unused */
+  layout.children = place(sizeof(uint32_t));
+  layout.child_keys = place(sizeof(uint64_t));
+  layout.folded_children = place(sizeof(uint32_t));
+  layout.folded_keys = place(sizeof(uint64_t));
+  layout.size = offset;
+  return layout;
+}
+
+void GamecubeFilesystemTable::pointTables(const unsigned char *block,
+                                          uint32_t entries) {
+  if (block == nullptr) {
+    types = nullptr;
+    parents = nexts = offsets = lengths = nullptr;
+    name_offsets = name_lengths = name_hashes = nullptr;
+    directory_info = nullptr;
+    first_children = children = folded_children = nullptr;
+    child_keys = folded_keys = nullptr;
+    return;
+  }
+
+  const table_layout layout = layoutTables(entries);
+  types = block + layout.types;
+  parents = reinterpret_cast<const uint32_t *>(block + layout.parents);
+  nexts = reinterpret_cast<const uint32_t *>(block + layout.nexts);
+  offsets = reinterpret_cast<const uint32_t *>(block + layout.offsets);
+  lengths = reinterpret_cast<const uint32_t *>(block + layout.lengths);
+  name_offsets =
+      reinterpret_cast<const uint32_t *>(block + layout.name_offsets);
+  name_lengths =
+      reinterpret_cast<const uint32_t *>(block + layout.name_lengths);
+  name_hashes = reinterpret_cast<const uint32_t *>(block + layout.name_hashes);
+  directory_info = reinterpret_cast<const gc_dvdfs_directory_info *>(
+      block + layout.directory_info);
+  first_children =
+      reinterpret_cast<const uint32_t *>(block + layout.first_children);
+  children = reinterpret_cast<const uint32_t *>(block + layout.children);
+  child_keys = reinterpret_cast<const uint64_t *>(block + layout.child_keys);
+  folded_children =
+      reinterpret_cast<const uint32_t *>(block + layout.folded_children);
+  folded_keys = reinterpret_cast<const uint64_t *>(block + layout.folded_keys);
 }
 
 bool GamecubeFilesystemTable::isValidFileEntry(
-    struct gc_dvdfs_file_entry *pfe) const {
+    const struct gc_dvdfs_file_entry *pfe) const {
   const unsigned int foffset = filenameOffset(pfe);
 
   if (((pfe->type != FST_FILE) && (pfe->type != FST_DIRECTORY)) ||
@@ -78,77 +155,281 @@ bool GamecubeFilesystemTable::isValidFileEntry(
 }
 
 int GamecubeFilesystemTable::enumerate(
-    struct gc_dvdfs_file_entry *root,
-    int (*callback)(struct gc_dvdfs_file_entry *pfe, void *param),
-    void *param) const {
-  /* get the filename */
-  uintptr_t i;
+    const struct gc_dvdfs_file_entry *root,
+    int (*callback)(const struct gc_dvdfs_file_entry *pfe, void *param),
+    void *param, uint32_t from) const {
+  const uint32_t dir = entryIndex(root);
+  uint32_t i = dir + 1;
   int r;
 
   /* only enumerate directories */
-  if (root->type != FST_DIRECTORY) {
+  if (types[dir] != FST_DIRECTORY) {
     return -EINVAL;
   }
 
-  const uintptr_t entries = directoryEntries(root);
-  i = ((uintptr_t)root - (uintptr_t) this->root) /
-          sizeof(struct gc_dvdfs_file_entry) +
-      1;
+  const uint32_t entries = nexts[dir];
   /* check if out of bounds */
-  const uint32_t rootDirEntries = directoryEntries(this->root);
+  const uint32_t rootDirEntries = nexts[0];
   if (i >= rootDirEntries || entries > rootDirEntries) {
     return -EINVAL;
   }
+  if (from != 0) {
+    if (from == entries) {
+      return 0;
+    }
+    /* only ever one of the directory's own entries */
+    if (from < i || from > entries || parents[from] != dir) {
+      return -EINVAL;
+    }
+    i = from;
+  }
 
-  /* loop through the files */
+  /* loop through the files, only the type and next tables are read */
   while (i < entries) {
-    struct gc_dvdfs_file_entry *pfe = this->root + i;
     /* verify the file is proper */
-    if (!isValidFileEntry(pfe)) {
+    if (types[i] == FST_INVALID) {
       return 0;
     }
 
     /* do the callback */
-    if ((r = callback(pfe, param)) < 0) {
+    if ((r = callback(this->root + i, param)) < 0) {
       return r;
     }
 
-    if (pfe->type == FST_DIRECTORY) {
-      if (pfe->dir.offset_next <= i) {
-        /* we're going backwards or looping, abort */
-        return -EINVAL;
-      }
-      i = pfe->dir.offset_next;
-    } else {
-      ++i;
+    if (nexts[i] <= i) {
+      /* we're going backwards or looping, abort */
+      return -EINVAL;
     }
+    i = nexts[i];
   }
   return 0;
 }
 
-static int gc_dvdfs_get_directory_info_callback(struct gc_dvdfs_file_entry *pfe,
-                                                void *param) {
-  struct gc_dvdfs_directory_info *const di =
-      (struct gc_dvdfs_directory_info *)param;
-
-  if (pfe->type == FST_FILE) {
-    di->total_files++;
-    di->total_file_size += pfe->file.length;
-  } else if (pfe->type == FST_DIRECTORY) {
-    di->total_directories++;
+int GamecubeFilesystemTable::getDirectoryInfo(
+    const struct gc_dvdfs_file_entry *root,
+    struct gc_dvdfs_directory_info *di) const {
+  /* only directories have directory info */
+  if (!isDirectory(root)) {
+    return -EINVAL;
   }
+
+  *di = directory_info[entryIndex(root)];
   return 0;
 }
 
-int GamecubeFilesystemTable::getDirectoryInfo(
-    struct gc_dvdfs_file_entry *root,
-    struct gc_dvdfs_directory_info *di) const {
-  memset(di, 0, sizeof(*di));
+uint32_t GamecubeFilesystemTable::hashName(const char *name, size_t length) {
+  /* FNV-1a */
+  uint32_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < length; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+  }
+  return hash;
+}
+
+uint64_t GamecubeFilesystemTable::nameKey(const char *name, size_t length,
+                                          bool fold) {
+  /* zero padded, a shorter name sorts first like it does with strcmp */
+  uint64_t key = 0;
+  size_t i;
+
+  for (i = 0; i < sizeof(key); ++i) {
+    const uint8_t c = i < length ? static_cast<uint8_t>(name[i]) : 0;
+    key = (key << 8) | (fold ? fold_name_char(c) : c);
+  }
+  return key;
+}
+
+void GamecubeFilesystemTable::buildChildren() {
+  const uint32_t entries = directoryEntries(root);
+  uint32_t *const first_child_table = writable(first_children);
+  uint32_t *const child_table = writable(children);
+  uint32_t *const folded_child_table = writable(folded_children);
+  uint32_t next = 0;
+  uint32_t i;
+
+  /* lay every directory's run out in FST order, then fill them */
+  for (i = 0; i < entries; ++i) {
+    first_child_table[i] = next;
+    next += directory_info[i].total_files + directory_info[i].total_directories;
+  }
+  std::vector<uint32_t> filled(first_child_table, first_child_table + entries);
+  for (i = 1; i < entries; ++i) {
+    if (types[i] != FST_INVALID) {
+      const uint32_t slot = filled[parents[i]]++;
+      child_table[slot] = i;
+      folded_child_table[slot] = i;
+    }
+  }
+
+  sortChildren(child_table, writable(child_keys), false);
+  sortChildren(folded_child_table, writable(folded_keys), true);
+}
+
+/* strcmp, or with ASCII case folded the way nameKey folds keys */
+static int compareNames(const char *a, const char *b, bool fold) {
+  if (!fold) {
+    return strcmp(a, b);
+  }
+  while (*a != '\0' && fold_name_char(*a) == fold_name_char(*b)) {
+    ++a;
+    ++b;
+  }
+  return fold_name_char(*a) - fold_name_char(*b);
+}
+
+void GamecubeFilesystemTable::sortChildren(uint32_t *child_table,
+                                           uint64_t *key_table, bool fold) {
+  const uint32_t entries = directoryEntries(root);
+  std::vector<std::pair<uint64_t, uint32_t>> sorted;
+  uint32_t i;
+
+  /* discs mostly list names sorted already, if case insensitively */
+  auto less = [this, fold](const std::pair<uint64_t, uint32_t> &a,
+                           const std::pair<uint64_t, uint32_t> &b) {
+    if (a.first != b.first) {
+      return a.first < b.first;
+    }
+    /* with equal keys a name shorter than the key is the same name */
+    return (a.first & 0xff) != 0 &&
+           compareNames(str_table + name_offsets[a.second] + sizeof(a.first),
+                        str_table + name_offsets[b.second] + sizeof(b.first),
+                        fold) < 0;
+  };
+  for (i = 0; i < entries; ++i) {
+    const uint32_t first = first_children[i];
+    const uint32_t count =
+        directory_info[i].total_files + directory_info[i].total_directories;
+    sorted.clear();
+    for (uint32_t j = first; j < first + count; ++j) {
+      const uint32_t child = child_table[j];
+      sorted.push_back(std::make_pair(
+          nameKey(str_table + name_offsets[child], name_lengths[child], fold),
+          child));
+    }
+    if (!std::is_sorted(sorted.begin(), sorted.end(), less)) {
+      std::sort(sorted.begin(), sorted.end(), less);
+    }
+    for (uint32_t j = 0; j < count; ++j) {
+      key_table[first + j] = sorted[j].first;
+      child_table[first + j] = sorted[j].second;
+    }
+  }
+}
 
-  return enumerate(root, gc_dvdfs_get_directory_info_callback, di);
+const uint64_t *GamecubeFilesystemTable::lowerBound(const uint64_t *keys,
+                                                    uint32_t dir,
+                                                    uint64_t key) const {
+  const uint64_t *first = keys + first_children[dir];
+  uint32_t count =
+      directory_info[dir].total_files + directory_info[dir].total_directories;
+
+  /* halves the run without branching on the comparisons */
+  while (count > 1) {
+    const uint32_t half = count / 2;
+    first += first[half - 1] < key ? half : 0;
+    count -= half;
+  }
+  return first + (count == 1 && *first < key);
+}
+
+const struct gc_dvdfs_file_entry *
+GamecubeFilesystemTable::lookup(const struct gc_dvdfs_file_entry *dir,
+                                const char *name, size_t length) const {
+  if (types == nullptr || !isDirectory(dir)) {
+    return nullptr;
+  }
+
+  const uint32_t parent = entryIndex(dir);
+  const uint64_t key = nameKey(name, length, false);
+  const uint64_t *const last =
+      child_keys + first_children[parent] + directory_info[parent].total_files +
+      directory_info[parent].total_directories;
+  uint32_t hash = 0;
+  bool hashed = false;
+
+  /* the key decides unless names are longer than it and share it */
+  for (const uint64_t *p = lowerBound(child_keys, parent, key);
+       p != last && *p == key; ++p) {
+    const uint32_t entry = children[p - child_keys];
+    if (name_lengths[entry] != length) {
+      continue;
+    }
+    if (length <= sizeof(key)) {
+      return root + entry;
+    }
+    if (!hashed) {
+      hash = hashName(name, length);
+      hashed = true;
+    }
+    if (name_hashes[entry] == hash &&
+        names_equal(str_table + name_offsets[entry] + sizeof(key),
+                    name + sizeof(key), length - sizeof(key))) {
+      return root + entry;
+    }
+  }
+  return nullptr;
+}
+
+const struct gc_dvdfs_file_entry *
+GamecubeFilesystemTable::lookupIgnoringCase(
+    const struct gc_dvdfs_file_entry *dir, const char *name,
+    size_t length) const {
+  const struct gc_dvdfs_file_entry *const exact = lookup(dir, name, length);
+
+  if (exact != nullptr || types == nullptr || !isDirectory(dir)) {
+    return exact;
+  }
+
+  /* the same search over the folded keys, without hashes to go by */
+  const uint32_t parent = entryIndex(dir);
+  const uint64_t key = nameKey(name, length, true);
+  const uint64_t *const last = folded_keys + first_children[parent] +
+                               directory_info[parent].total_files +
+                               directory_info[parent].total_directories;
+
+  for (const uint64_t *p = lowerBound(folded_keys, parent, key);
+       p != last && *p == key; ++p) {
+    const uint32_t entry = folded_children[p - folded_keys];
+    const char *const candidate = str_table + name_offsets[entry];
+    if (name_lengths[entry] == length &&
+        (length <= sizeof(key) ||
+         names_equal_ignoring_case(candidate + sizeof(key), name + sizeof(key),
+                                   length - sizeof(key)))) {
+      return root + entry;
+    }
+  }
+  return nullptr;
+}
+
+const struct gc_dvdfs_file_entry *
+GamecubeFilesystemTable::lookupPath(const char *path, bool ignoreCase) const {
+  const struct gc_dvdfs_file_entry *pfe = root;
+
+  while (pfe != nullptr) {
+    /* skip separators, empty components are ignored */
+    while (*path == '/') {
+      ++path;
+    }
+    if (*path == '\0') {
+      break;
+    }
+
+    const char *const end = strchrnul(path, '/');
+    pfe = ignoreCase ? lookupIgnoringCase(pfe, path, end - path)
+                     : lookup(pfe, path, end - path);
+    path = end;
+  }
+  return pfe;
 }
 
 bool GamecubeFilesystemTable::validate() {
+  struct open_directory {
+    uint32_t entry;
+    uint32_t end;
+  };
+  std::vector<open_directory> stack;
   unsigned int i;
 
   /* make sure the FST is completely valid */
@@ -157,23 +438,95 @@ bool GamecubeFilesystemTable::validate() {
     return false;
   }
 
-  const uint32_t entries = be32_to_cpu(root->dir.offset_next);
-  if (entries >= (size / sizeof(struct gc_dvdfs_file_entry))) {
+  const uint32_t entries = root->dir.offset_next;
+  /* every FST holds at least its root */
+  if (entries == 0) {
+    fprintf(stderr, "gcdvdfs: Root entry holds no entries!\n");
+    return false;
+  }
+  /* the entries are followed by at least the root's empty name */
+  if (static_cast<uint64_t>(entries) * sizeof(struct gc_dvdfs_file_entry) >=
+      size) {
     fprintf(stderr, "gcdvdfs: Too many entries, will overflow the FST!\n");
     return false;
   }
-  /* ok let's convert all the data to native format and compute total size*/
+
+  tables_storage.assign(layoutTables(entries).size / sizeof(uint64_t), 0);
+  pointTables(reinterpret_cast<unsigned char *>(tables_storage.data()),
+              entries);
+  uint8_t *const type_table = writable(types);
+  uint32_t *const parent_table = writable(parents);
+  uint32_t *const next_table = writable(nexts);
+  uint32_t *const offset_table = writable(offsets);
+  uint32_t *const length_table = writable(lengths);
+  uint32_t *const name_offset_table = writable(name_offsets);
+  uint32_t *const name_length_table = writable(name_lengths);
+  uint32_t *const name_hash_table = writable(name_hashes);
+  gc_dvdfs_directory_info *const directory_info_table =
+      writable(directory_info);
+  stack.push_back(open_directory{0, entries});
+
+  /* compute total size, split the entries into the tables and tally every
+   * directory's immediate children in a single pass, the entries
+   * themselves are left untouched */
   for (i = 0; i < entries; ++i) {
-    root[i].file.length = be32_to_cpu(root[i].file.length);
-    root[i].file.offset = be32_to_cpu(root[i].file.offset);
     if (root[i].type == FST_FILE) {
       total_files++;
       total_file_size += root[i].file.length;
     } else if (root[i].type == FST_DIRECTORY) {
       total_directories++;
     }
-  }
 
+    next_table[i] = i + 1;
+    /* the root's name is never used, only its type matters */
+    if (i != 0 && !isValidFileEntry(root + i)) {
+      type_table[i] = FST_INVALID;
+    } else {
+      const uint32_t foffset = i == 0 ? 0 : filenameOffset(root + i);
+      const char *const name = str_table + foffset;
+      type_table[i] = root[i].type;
+      name_offset_table[i] = foffset;
+      name_length_table[i] = strnlen(name, str_table_size - foffset);
+      name_hash_table[i] = hashName(name, name_length_table[i]);
+      if (root[i].type == FST_FILE) {
+        offset_table[i] = root[i].file.offset;
+        length_table[i] = root[i].file.length;
+      } else {
+        next_table[i] = root[i].dir.offset_next;
+      }
+    }
+
+    if (i == 0) {
+      continue;
+    }
+
+    while (stack.back().end <= i) {
+      stack.pop_back();
+    }
+    const uint32_t parent = stack.back().entry;
+    parent_table[i] = parent;
+
+    if (type_table[i] != FST_INVALID) {
+      struct gc_dvdfs_directory_info *const di = &directory_info_table[parent];
+      if (root[i].type == FST_FILE) {
+        di->total_files++;
+        di->total_file_size += root[i].file.length;
+      } else {
+        di->total_directories++;
+      }
+    }
+
+    if (root[i].type == FST_DIRECTORY) {
+      /* clamp bogus ranges so a corrupt entry can't swallow its siblings */
+      uint32_t end = root[i].dir.offset_next;
+      if (end <= i) {
+        end = i + 1;
+      } else if (end > stack.back().end) {
+        end = stack.back().end;
+      }
+      stack.push_back(open_directory{i, end});
+    }
+  }
   return true;
 }
 
@@ -187,21 +540,31 @@ bool GamecubeFilesystemTable::open(BinaryReader *in) {
   }
 
   /* read the FST into memory */
-  struct gc_dvdfs_disc_header *const dh = (struct gc_dvdfs_disc_header *)buffer;
-  const uint32_t fst_offset = be32_to_cpu(dh->offset_fst);
-  const uint32_t fst_size = be32_to_cpu(dh->fst_size);
-  const uint32_t dol_offset = be32_to_cpu(dh->offset_bootfile);
-
-  /* now allocate the fst */
-  if (!(root = reinterpret_cast<struct gc_dvdfs_file_entry *>(
-            new unsigned char[fst_size]))) {
-    return false;
-  }
+  const struct gc_dvdfs_disc_header *const dh =
+      (const struct gc_dvdfs_disc_header *)buffer;
+  const uint32_t fst_offset = dh->offset_fst;
+  const uint32_t fst_size = dh->fst_size;
+  const uint32_t dol_offset = dh->offset_bootfile;
 
   size = fst_size;
-  /* now try to read the fst */
-  if (in->read(root, fst_size, fst_offset) != static_cast<int>(fst_size)) {
-    fprintf(stderr, "gcdvdfs: Unable to read FST into memory\n");
+  /* use the FST straight from the reader if it's mapped, it's never written */
+  if ((root = reinterpret_cast<const struct gc_dvdfs_file_entry *>(
+           in->map(fst_offset, fst_size))) == nullptr) {
+    /* now allocate the fst */
+    if (!(fst_copy = new unsigned char[fst_size])) {
+      return false;
+    }
+    root = reinterpret_cast<const struct gc_dvdfs_file_entry *>(fst_copy);
+
+    /* now try to read the fst */
+    if (in->read(fst_copy, fst_size, fst_offset) !=
+        static_cast<int>(fst_size)) {
+      fprintf(stderr, "gcdvdfs: Unable to read FST into memory\n");
+      goto fst_error;
+    }
+  }
+  if (fst_size < sizeof(struct gc_dvdfs_file_entry)) {
+    fprintf(stderr, "gcdvdfs: FST is too small\n");
     goto fst_error;
   }
   /* now try to read the apploader */
@@ -210,24 +573,20 @@ bool GamecubeFilesystemTable::open(BinaryReader *in) {
     fprintf(stderr, "gcdvdfs: Unable to read apploader into memory\n");
     goto fst_error;
   }
-  /* fix up the apploader */
-  apploader.entry_point = be32_to_cpu(apploader.entry_point);
-  apploader.size = be32_to_cpu(apploader.size);
   /* now try to read the dol header */
   if (in->read(&dol_header, sizeof(struct gc_dvdfs_dol_header), dol_offset) !=
       sizeof(struct gc_dvdfs_dol_header)) {
     fprintf(stderr, "gcdvdfs: Unable to read DOL Header\n");
     goto fst_error;
   }
-  gc_dvdfs_fix_raw_dol_header(&dol_header);
 
   this->dol_offset = dol_offset;
   dol_length = gc_dvdfs_get_dol_file_size(&dol_header);
   /* compute the location of the string table */
   {
     const uint32_t str_table_offset =
-        be32_to_cpu(root->dir.offset_next) * sizeof(struct gc_dvdfs_file_entry);
-    str_table = (char *)((uintptr_t)root + str_table_offset);
+        root->dir.offset_next * sizeof(struct gc_dvdfs_file_entry);
+    str_table = (const char *)((uintptr_t)root + str_table_offset);
     str_table_size = size - str_table_offset;
   }
   total_files = 0;
@@ -237,12 +596,126 @@ bool GamecubeFilesystemTable::open(BinaryReader *in) {
   if (!validate()) {
     goto fst_error;
   }
+  buildChildren();
 
   return true;
 fst_error:
-  if (root) {
-    delete[] reinterpret_cast<unsigned char *>(root);
-    root = nullptr;
-  }
+  close();
   return false;
 }
+
+static bool writeIndexSection(FILE *file, const void *data, size_t length) {
+  static const char padding[8] = {0};
+  const size_t pad = alignIndexSection(length) - length;
+
+  return (length == 0 || fwrite(data, length, 1, file) == 1) &&
+         (pad == 0 || fwrite(padding, pad, 1, file) == 1);
+}
+
+bool GamecubeFilesystemTable::openIndex(const char *path,
+                                        const struct gc_fst_index_key &key) {
+  struct stat statbuf;
+  const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat(fd, &statbuf) ||
+      static_cast<size_t>(statbuf.st_size) < sizeof(gc_fst_index_header)) {
+    ::close(fd);
+    return false;
+  }
+  void *const map =
+      mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+  /* only enough to trust the offsets, the tables are used as they are */
+  const struct gc_fst_index_header *const header =
+      reinterpret_cast<const struct gc_fst_index_header *>(map);
+  const uint64_t entries = header->entries;
+  const uint64_t fst_offset = alignIndexSection(sizeof(*header));
+  const uint64_t tables_offset =
+      fst_offset + alignIndexSection(header->fst_size);
+  const unsigned char *const base = reinterpret_cast<unsigned char *>(map);
+  if (memcmp(header->magic, FST_INDEX_MAGIC, sizeof(header->magic)) ||
+      header->version != FST_INDEX_VERSION ||
+      header->byte_order != FST_INDEX_BYTE_ORDER ||
+      memcmp(&header->key, &key, sizeof(key)) ||
+      header->file_size != static_cast<uint64_t>(statbuf.st_size) ||
+      header->fst_offset != fst_offset ||
+      header->tables_offset != tables_offset ||
+      tables_offset + layoutTables(entries).size != header->file_size ||
+      entries == 0 ||
+      entries * sizeof(struct gc_dvdfs_file_entry) >= header->fst_size ||
+      reinterpret_cast<const struct gc_dvdfs_file_entry *>(base + fst_offset)
+              ->dir.offset_next != entries) {
+    munmap(map, statbuf.st_size);
+    return false;
+  }
+
+  index_file = map;
+  index_file_size = statbuf.st_size;
+  root =
+      reinterpret_cast<const struct gc_dvdfs_file_entry *>(base + fst_offset);
+  size = header->fst_size;
+  str_table = reinterpret_cast<const char *>(root + entries);
+  str_table_size = size - entries * sizeof(struct gc_dvdfs_file_entry);
+  pointTables(base + tables_offset, entries);
+  dol_length = header->dol_length;
+  dol_offset = header->dol_offset;
+  total_files = header->total_files;
+  total_directories = header->total_directories;
+  total_file_size = header->total_file_size;
+  apploader = header->apploader;
+  dol_header = header->dol_header;
+  return true;
+}
+
+bool GamecubeFilesystemTable::saveIndex(
+    const char *path, const struct gc_fst_index_key &key) const {
+  const std::string temporary = std::string(path) + ".tmp";
+  struct gc_fst_index_header header;
+
+  if (root == nullptr || tables_storage.empty()) {
+    return false;
+  }
+  const uint32_t entries = directoryEntries(root);
+  const uint64_t tables_size = layoutTables(entries).size;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FST_INDEX_MAGIC, sizeof(header.magic));
+  header.version = FST_INDEX_VERSION;
+  header.byte_order = FST_INDEX_BYTE_ORDER;
+  header.key = key;
+  header.fst_size = size;
+  header.entries = entries;
+  header.dol_length = dol_length;
+  header.dol_offset = dol_offset;
+  header.total_files = total_files;
+  header.total_directories = total_directories;
+  header.total_file_size = total_file_size;
+  header.fst_offset = alignIndexSection(sizeof(header));
+  header.tables_offset = header.fst_offset + alignIndexSection(size);
+  header.file_size = header.tables_offset + tables_size;
+  header.apploader = apploader;
+  header.dol_header = dol_header;
+
+  FILE *const file = fopen(temporary.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool saved =
+      writeIndexSection(file, &header, sizeof(header)) &&
+      writeIndexSection(file, root, size) &&
+      writeIndexSection(file, tables_storage.data(), tables_size);
+  saved = fclose(file) == 0 && saved;
+  /* a mount mapping the old index never sees half of the new one */
+  if (!saved || rename(temporary.c_str(), path)) {
+    remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
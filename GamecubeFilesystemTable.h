@@ -1,61 +1,74 @@
 #ifndef __fst__h
 #define __fst__h
 
+#include <stddef.h>
 #include <stdint.h>
+#include <vector>
+#include "BigEndian.h"
 #include "BinaryReader.h"
 
 #define GC_DVD_SECTOR_SIZE 2048
 
 #define FST_OFFSET 0x0424
 
+/* every disc has one of these in its header, Wii discs in wii_magic */
+#define GC_DISC_MAGIC 0xc2339f3d
+#define WII_DISC_MAGIC 0x5d1c9ea3
+
 #define FST_FILE 0
 #define FST_DIRECTORY 1
+/* in the type table for entries with a bad type or name, never on disc */
+#define FST_INVALID 0xff
 
+/* on-disc structures, every multi-byte field is big-endian and converts to
+ * native on access so they can be used straight from the image */
 #pragma pack(1)
 struct gc_dvdfs_dol_header {
-  uint32_t text_file_pos[7];
-  uint32_t data_file_pos[11];
-  uint32_t text_mem_pos[7];
-  uint32_t data_mem_pos[11];
-  uint32_t text_section_size[7];
-  uint32_t data_section_size[11];
-  uint32_t bss_mem_address;
-  uint32_t bss_size;
-  uint32_t entry_point;
+  be32_t text_file_pos[7];
+  be32_t data_file_pos[11];
+  be32_t text_mem_pos[7];
+  be32_t data_mem_pos[11];
+  be32_t text_section_size[7];
+  be32_t data_section_size[11];
+  be32_t bss_mem_address;
+  be32_t bss_size;
+  be32_t entry_point;
 };
 
 struct gc_dvdfs_disc_header {
-  uint32_t game_code;
-  uint16_t maker_code;
+  be32_t game_code;
+  be16_t maker_code;
   uint8_t disc_id;
   uint8_t version;
   uint8_t streaming;
   uint8_t streamBufSize;
-  uint8_t padding1[22];
+  uint8_t padding1[14];
+  be32_t wii_magic;
+  be32_t gc_magic;
   uint8_t game_name[992];
-  uint32_t offset_dh_bin;
-  uint32_t addr_debug_monitor;
+  be32_t offset_dh_bin;
+  be32_t addr_debug_monitor;
   uint8_t padding2[24];
-  uint32_t offset_bootfile;
-  uint32_t offset_fst;
-  uint32_t fst_size;
-  uint32_t max_fst_size;
-  uint32_t user_position;
-  uint32_t user_length;
+  be32_t offset_bootfile;
+  be32_t offset_fst;
+  be32_t fst_size;
+  be32_t max_fst_size;
+  be32_t user_position;
+  be32_t user_length;
   uint8_t padding[7];
 };
 
 struct gc_dvdfs_file_entry {
   uint8_t type;
-  uint8_t offset_filename[3];
+  be24_t offset_filename;
   union {
     struct {
-      uint32_t offset;
-      uint32_t length; /* if root, number of entries */
+      be32_t offset;
+      be32_t length; /* if root, number of entries */
     } file;
     struct {
-      uint32_t offset_parent;
-      uint32_t offset_next;
+      be32_t offset_parent;
+      be32_t offset_next;
     } dir;
   };
 };
@@ -64,8 +77,8 @@ struct gc_dvdfs_file_entry {
 struct gc_dvdfs_apploader {
   uint8_t version[10];
   uint8_t padding[6];
-  uint32_t entry_point;
-  uint32_t size;
+  be32_t entry_point;
+  be32_t size;
 };
 
 #pragma pack()
@@ -78,9 +91,50 @@ struct gc_dvdfs_directory_info {
   uint32_t total_file_size;
 };
 
+/* FST index files keep what open computes so later mounts map it instead of
+ * parsing and validating the FST again. A gc_fst_index_header followed by
+ * the FST as it is on the disc and the tables open builds, 8 byte aligned
+ * and laid out the same as in memory. Everything besides the FST is in host
+ * byte order. */
+#define FST_INDEX_MAGIC "GCFSTIDX"
+#define FST_INDEX_VERSION 3
+#define FST_INDEX_BYTE_ORDER 0x01020304
+
+#pragma pack(1)
+/* the image an index was built from, any change to it makes a new one */
+struct gc_fst_index_key {
+  uint64_t image_size;
+  int64_t image_mtime; /* in nanoseconds */
+  uint32_t header_crc32; /* of the first sector, the disc header */
+  uint32_t padding;
+};
+
+struct gc_fst_index_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  struct gc_fst_index_key key;
+  uint64_t file_size;
+  uint32_t fst_size;
+  uint32_t entries;
+  uint32_t dol_length;
+  uint32_t dol_offset;
+  uint32_t total_files;
+  uint32_t total_directories;
+  uint32_t total_file_size;
+  uint32_t padding;
+  uint64_t fst_offset;
+  uint64_t tables_offset;
+  struct gc_dvdfs_apploader apploader;
+  struct gc_dvdfs_dol_header dol_header;
+};
+#pragma pack()
+
 class GamecubeFilesystemTable {
 private:
-  struct gc_dvdfs_file_entry *root;
+  const struct gc_dvdfs_file_entry *root;
+  /* set when root points at our own copy rather than the reader's mapping */
+  unsigned char *fst_copy;
   const char *str_table;
   uint32_t size;
   uint32_t str_table_size;
@@ -92,19 +146,104 @@ private:
   struct gc_dvdfs_apploader apploader;
   struct gc_dvdfs_dol_header dol_header;
 
+  /* Every field of the FST entries in an array of its own, indexed like the
+   * FST and in host byte order, so walking a directory or a getattr only
+   * brings the fields it needs into the cache rather than whole entries
+   * and the names they point at. */
+  const uint8_t *types;         /* FST_FILE, FST_DIRECTORY or FST_INVALID */
+  const uint32_t *parents;      /* the root is its own parent */
+  const uint32_t *nexts;        /* after a directory's subtree, i + 1 else */
+  const uint32_t *offsets;      /* of files on the disc, 0 for directories */
+  const uint32_t *lengths;      /* of files, 0 for directories */
+  const uint32_t *name_offsets; /* into str_table */
+  const uint32_t *name_lengths;
+  const uint32_t *name_hashes;
+  /* immediate children totals, only valid for dirs */
+  const gc_dvdfs_directory_info *directory_info;
+  /* The valid children of every directory sorted by name, those of
+   * directory d at first_children[d] onwards. child_keys has the first
+   * bytes of each one's name as a big-endian integer, which sort the same
+   * as the names, so a binary search mostly stays within them. */
+  const uint32_t *first_children;
+  const uint32_t *children;
+  const uint64_t *child_keys;
+  /* the same runs sorted by their names with ASCII case folded, and keys
+   * of the folded names, for lookupIgnoringCase */
+  const uint32_t *folded_children;
+  const uint64_t *folded_keys;
+
+  /* byte offsets of the tables within the block holding them all */
+  struct table_layout {
+    uint64_t types;
+    uint64_t parents;
+    uint64_t nexts;
+    uint64_t offsets;
+    uint64_t lengths;
+    uint64_t name_offsets;
+    uint64_t name_lengths;
+    uint64_t name_hashes;
+    uint64_t directory_info;
+    uint64_t first_children;
+    uint64_t children;
+    uint64_t child_keys;
+    uint64_t folded_children;
+    uint64_t folded_keys;
+    uint64_t size;
+  };
+
+  /* the block when open built the tables */
+  std::vector<uint64_t> tables_storage;
+  /* or the mapping of the index file openIndex found them in */
+  void *index_file;
+  size_t index_file_size;
+
 public:
   GamecubeFilesystemTable();
   ~GamecubeFilesystemTable();
 
   bool open(BinaryReader *in);
 
-  int enumerate(struct gc_dvdfs_file_entry *root,
-                int (*callback)(struct gc_dvdfs_file_entry *pfe, void *param),
-                void *param) const;
+  /* Instead of open, maps an index file saveIndex wrote for the image key
+   * describes. Only the header is checked, nothing is parsed or
+   * validated. */
+  bool openIndex(const char *path, const struct gc_fst_index_key &key);
+  /* writes what open computed to path for openIndex */
+  bool saveIndex(const char *path, const struct gc_fst_index_key &key) const;
+
+  /* Calls callback for the entries of directory root until it returns
+   * something negative. Resumes at entry index from when it isn't 0, which
+   * is what getNext gave for the last entry seen, so a directory can be
+   * walked a bit at a time without starting over. */
+  int enumerate(const struct gc_dvdfs_file_entry *root,
+                int (*callback)(const struct gc_dvdfs_file_entry *pfe,
+                                void *param),
+                void *param, uint32_t from = 0) const;
+
+  /* binary search for name within directory dir, name need not be
+   * terminated */
+  const struct gc_dvdfs_file_entry *
+  lookup(const struct gc_dvdfs_file_entry *dir, const char *name,
+         size_t length) const;
 
-  int getDirectoryInfo(struct gc_dvdfs_file_entry *root,
+  /* Like lookup but also matches names that only differ in the case of
+   * ASCII letters, an exact match is preferred over those. */
+  const struct gc_dvdfs_file_entry *
+  lookupIgnoringCase(const struct gc_dvdfs_file_entry *dir, const char *name,
+                     size_t length) const;
+
+  /* resolves a '/' separated path relative to the root of the FST */
+  const struct gc_dvdfs_file_entry *lookupPath(const char *path,
+                                               bool ignoreCase = false) const;
+
+  int getDirectoryInfo(const struct gc_dvdfs_file_entry *root,
                        gc_dvdfs_directory_info *directoryInfo) const;
 
+  /* number of FST entries, including the root */
+  uint32_t getEntryCount() const { return root ? directoryEntries(root) : 0; }
+
+  /* bytes allocated for the FST and its tables, a mapped FST is free */
+  size_t getMemoryUsage() const;
+
   uint32_t getTotalFileSize() const { return total_file_size; }
   uint32_t getTotalFiles() const { return total_files; }
 
@@ -112,28 +251,63 @@ public:
   const uint32_t getDolLength() const { return dol_length; }
   const uint32_t getDolOffset() const { return dol_offset; }
 
-  struct gc_dvdfs_file_entry *getRoot() const {
+  const struct gc_dvdfs_file_entry *getRoot() const {
     return root;
   }
 
-  const char *getFileName(struct gc_dvdfs_file_entry *pfe) const {
-    int fileNameOffset =
-        ((pfe->offset_filename[0] << 16) | (pfe->offset_filename[1] << 8) |
-         pfe->offset_filename[2]);
+  /* the fields of an entry, from the tables rather than the entry itself */
+  bool isDirectory(const struct gc_dvdfs_file_entry *pfe) const {
+    return types[entryIndex(pfe)] == FST_DIRECTORY;
+  }
+  bool isFile(const struct gc_dvdfs_file_entry *pfe) const {
+    return types[entryIndex(pfe)] == FST_FILE;
+  }
+  uint32_t getFileOffset(const struct gc_dvdfs_file_entry *pfe) const {
+    return offsets[entryIndex(pfe)];
+  }
+  uint32_t getFileLength(const struct gc_dvdfs_file_entry *pfe) const {
+    return lengths[entryIndex(pfe)];
+  }
+  /* index of the entry after pfe and, for a directory, everything in it */
+  uint32_t getNext(const struct gc_dvdfs_file_entry *pfe) const {
+    return nexts[entryIndex(pfe)];
+  }
 
-    return (str_table + fileNameOffset);
+  const char *getFileName(const struct gc_dvdfs_file_entry *pfe) const {
+    return (str_table + name_offsets[entryIndex(pfe)]);
+  }
+  size_t getFileNameLength(const struct gc_dvdfs_file_entry *pfe) const {
+    return name_lengths[entryIndex(pfe)];
   }
 
 private:
-  bool isValidFileEntry(struct gc_dvdfs_file_entry *pfe) const;
+  bool isValidFileEntry(const struct gc_dvdfs_file_entry *pfe) const;
   bool validate();
+  void buildChildren();
+  void sortChildren(uint32_t *child_table, uint64_t *key_table, bool fold);
+  void close();
+
+  static table_layout layoutTables(uint32_t entries);
+  void pointTables(const unsigned char *block, uint32_t entries);
+
+  static uint32_t hashName(const char *name, size_t length);
+  static uint64_t nameKey(const char *name, size_t length, bool fold);
+  /* the first of dir's run of keys, from child_keys or folded_keys, not
+   * below key */
+  const uint64_t *lowerBound(const uint64_t *keys, uint32_t dir,
+                             uint64_t key) const;
+
+  inline uint32_t entryIndex(const struct gc_dvdfs_file_entry *pfe) const {
+    return static_cast<uint32_t>(pfe - root);
+  }
 
-  inline static uint32_t filenameOffset(struct gc_dvdfs_file_entry *pfe) {
-    return (((pfe)->offset_filename[0] << 16) |
-            ((pfe)->offset_filename[1] << 8) | (pfe)->offset_filename[2]);
+  inline static uint32_t
+  filenameOffset(const struct gc_dvdfs_file_entry *pfe) {
+    return pfe->offset_filename;
   }
 
-  inline static uint32_t directoryEntries(struct gc_dvdfs_file_entry *root) {
+  inline static uint32_t
+  directoryEntries(const struct gc_dvdfs_file_entry *root) {
     return root->dir.offset_next;
   }
 };
@@ -1,13 +1,17 @@
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include <algorithm>
+#include <vector>
+#include "Crc32.h"
 #include "GamecubeIsoFilesystem.h"
-#include "Tokenizer.h"
 
 const struct timespec GamecubeIsoFilesystem::defaultTime = {1006095600, 0};
+const double GamecubeIsoFilesystem::CACHE_TIMEOUT = 365 * 24 * 60 * 60;
 
 struct root_dir_entry {
   const char *name;
@@ -17,17 +21,23 @@ struct root_dir_entry {
 static const struct root_dir_entry root_dir_entries[] = {
     {"apploader", GamecubeIsoFilesystem::APPLOADER_INO},
     {"boot.dol", GamecubeIsoFilesystem::BOOTDOL_INO},
-    {"data", GamecubeIsoFilesystem::DATA_INO}};
+    {"data", GamecubeIsoFilesystem::DATA_INO},
+    {".stats", GamecubeIsoFilesystem::STATS_INO},
+    {".verify", GamecubeIsoFilesystem::VERIFY_INO}};
 
 static const unsigned int num_root_dir_entries =
     sizeof(root_dir_entries) / sizeof(root_dir_entries[0]);
 
 GamecubeIsoFilesystem::GamecubeIsoFilesystem(uid_t uid, gid_t gid,
                                              const char *logFile)
-    : mLogFile(nullptr), mFile(nullptr), mUid(uid), mGid(gid),
-      mLogFilePath(logFile) {
+    : mLog(nullptr), mFile(nullptr), mUid(uid), mGid(gid),
+      mLogFilePath(logFile), mReaderType(READER_FILE), mCacheSize(0),
+      mCache(nullptr), mReadaheadSize(0), mPool(nullptr), mTrace(nullptr),
+      mProfile(nullptr), mVerifier(nullptr), mIgnoreCase(false) {
   memset(&mOperations, 0, sizeof(mOperations));
+  memset(&mIndexKey, 0, sizeof(mIndexKey));
 
+  mOperations.init = static_init;
   mOperations.destroy = static_destroy;
   mOperations.statfs = static_statfs;
   mOperations.fgetattr = static_fgetattr;
@@ -38,66 +48,409 @@ GamecubeIsoFilesystem::GamecubeIsoFilesystem(uid_t uid, gid_t gid,
   mOperations.open = static_open;
   mOperations.release = static_release;
   mOperations.read = static_read;
+  mOperations.read_buf = static_read_buf;
+
+  memset(&mLowLevelOperations, 0, sizeof(mLowLevelOperations));
+
+  mLowLevelOperations.init = static_ll_init;
+  mLowLevelOperations.destroy = static_ll_destroy;
+  mLowLevelOperations.lookup = static_ll_lookup;
+  mLowLevelOperations.getattr = static_ll_getattr;
+  mLowLevelOperations.opendir = static_ll_opendir;
+  mLowLevelOperations.releasedir = static_ll_releasedir;
+  mLowLevelOperations.readdir = static_ll_readdir;
+  mLowLevelOperations.open = static_ll_open;
+  mLowLevelOperations.release = static_ll_release;
+  mLowLevelOperations.read = static_ll_read;
+  mLowLevelOperations.statfs = static_ll_statfs;
 }
 
 GamecubeIsoFilesystem::~GamecubeIsoFilesystem() {
-  if (mLogFile) {
-    fclose(mLogFile);
+  if (mCache) {
+    log("block cache hits %llu misses %llu\n",
+        static_cast<unsigned long long>(mCache->getHits()),
+        static_cast<unsigned long long>(mCache->getMisses()));
+  }
+
+  // readahead still in flight needs the reader, prefetching the profile or
+  // verifying the image only waste time on the way out
+  if (mProfile) {
+    mProfile->cancel();
+  }
+  if (mVerifier) {
+    mVerifier->cancel();
+  }
+  if (mPrefetcher.joinable()) {
+    mPrefetcher.join();
+  }
+  if (mVerifyThread.joinable()) {
+    mVerifyThread.join();
+  }
+  if (mPool) {
+    delete mPool;
+  }
+
+  if (mVerifier) {
+    delete mVerifier;
+  }
+
+  if (mProfile) {
+    if (mProfile->getRecordedExtents() > 0) {
+      if (mProfile->save(mProfileFilePath.c_str())) {
+        log("Saved access profile of %lu extents to %s\n",
+            mProfile->getRecordedExtents(), mProfileFilePath.c_str());
+      } else {
+        log("Unable to save access profile to %s\n",
+            mProfileFilePath.c_str());
+      }
+    }
+    delete mProfile;
   }
 
   if (mFile) {
     delete mFile;
   }
+
+  if (mTrace) {
+    delete mTrace;
+  }
+
+  if (mLog) {
+    delete mLog;
+  }
 }
 
-bool GamecubeIsoFilesystem::open(const char *filePath) {
-  if (!mLogFilePath.empty()) {
-    mLogFile = fopen(mLogFilePath.c_str(), "w");
-    if (mLogFile == nullptr) {
+bool GamecubeIsoFilesystem::openLog() {
+  if (mLog == nullptr && !mLogFilePath.empty()) {
+    mLog = new AsyncLog();
+    if (!mLog->open(mLogFilePath.c_str())) {
       fprintf(stderr, "Unable to open log file %s\n", mLogFilePath.c_str());
+      delete mLog;
+      mLog = nullptr;
       return false;
     }
   }
+  return true;
+}
+
+bool GamecubeIsoFilesystem::openTrace() {
+  if (mTrace == nullptr && !mTraceFilePath.empty()) {
+    mTrace = new TraceRecorder();
+    if (!mTrace->open(mTraceFilePath.c_str())) {
+      fprintf(stderr, "Unable to open trace file %s\n",
+              mTraceFilePath.c_str());
+      delete mTrace;
+      mTrace = nullptr;
+      return false;
+    }
+  }
+  return true;
+}
+
+void GamecubeIsoFilesystem::openProfile() {
+  unsigned char disc[ACCESS_PROFILE_DISC_SIZE];
+
+  if (mProfileFilePath.empty() ||
+      mFile->read(disc, sizeof(disc), 0) != sizeof(disc)) {
+    return;
+  }
+  mProfile = new AccessProfile(disc);
+  if (mProfile->load(mProfileFilePath.c_str())) {
+    log("Loaded access profile of %lu extents from %s\n",
+        mProfile->getLoadedExtents(), mProfileFilePath.c_str());
+  }
+}
+
+bool GamecubeIsoFilesystem::open(const char *filePath) {
+  if (!openLog()) {
+    return false;
+  }
 
   log("Attempting to open %s\n", filePath);
 
-  BinaryFILEReader *reader = new BinaryFILEReader();
+  // the index is only current while the image is the same size and
+  // hasn't been written to since
+  struct stat statbuf;
+  if (!mIndexDirectory.empty() && !stat(filePath, &statbuf)) {
+    const char *const slash = strrchr(filePath, '/');
+    mIndexFilePath = mIndexDirectory + "/" + (slash ? slash + 1 : filePath) +
+                     (mDisc.empty() ? "" : "." + mDisc) + ".gcindex";
+    mIndexKey.image_size = statbuf.st_size;
+    mIndexKey.image_mtime =
+        statbuf.st_mtim.tv_sec * 1000000000LL + statbuf.st_mtim.tv_nsec;
+  }
+
+  BinaryReader *const reader = openReader(filePath);
   if (reader == nullptr) {
-    log("Unable to allocate BinaryFILEReader\n");
+    log("Unable to open %s\n", filePath);
     return false;
   }
 
-  if (!reader->open(filePath)) {
-    log("Unable to open %s\n", filePath);
+  if (!open(reader)) {
+    log("Unable to read FST from %s\n", filePath);
+    return false;
+  }
+  log("Successfully opened %s\n", filePath);
+  return true;
+}
+
+bool GamecubeIsoFilesystem::open(BinaryReader *reader) {
+  if (!openLog() || !openTrace()) {
     delete reader;
     return false;
   }
 
-  if (!mFst.open(reader)) {
-    log("Unable to read FST from %s\n", filePath);
+  if (mCacheSize > 0) {
+    log("Caching %lu bytes\n", mCacheSize);
+    reader = mCache = new CachedBinaryReader(reader, mCacheSize);
+  }
+
+  if (!openFst(reader)) {
     delete reader;
+    mCache = nullptr;
     return false;
   }
 
   mFile = reader;
-  log("Successfully opened %s\n", filePath);
+  openProfile();
+  if (mReadaheadSize > 0) {
+    getPool();
+  }
+  // fuse daemonizes after this and threads don't survive the fork, the
+  // workers start again with the first task
+  if (mPool) {
+    mPool->stop();
+  }
+  return true;
+}
+
+bool GamecubeIsoFilesystem::readGameIds(const char *filePath,
+                                        std::vector<std::string> *ids) {
+  BinaryReader *const file = openFileReader(filePath);
+  if (file == nullptr) {
+    return false;
+  }
+
+  if (WbfsBinaryReader::detect(file)) {
+    WbfsBinaryReader reader(file);
+    if (!reader.open()) {
+      return false;
+    }
+    for (const WbfsBinaryReader::Disc &disc : reader.getDiscs()) {
+      ids->push_back(disc.gameId);
+    }
+    return true;
+  }
+  delete file;
+
+  // compressed images need their reader to decode the header
+  BinaryReader *const reader = openReader(filePath);
+  if (reader == nullptr) {
+    return false;
+  }
+  gc_dvdfs_disc_header header;
+  const bool read = reader->read(&header, sizeof(header), 0) == sizeof(header);
+  delete reader;
+  // anything is taken for a plain image, only real ones have the magic
+  if (!read || (header.gc_magic != GC_DISC_MAGIC &&
+                header.wii_magic != WII_DISC_MAGIC)) {
+    return false;
+  }
+  const char *const id = reinterpret_cast<const char *>(&header);
+  ids->push_back(std::string(id, strnlen(id, 6)));
+  return true;
+}
+
+// Maps the FST index when there's a current one, otherwise parses the FST
+// and saves the index for the next mount
+bool GamecubeIsoFilesystem::openFst(BinaryReader *reader) {
+  unsigned char header[GC_DVD_SECTOR_SIZE];
+
+  if (mIndexFilePath.empty() ||
+      reader->read(header, sizeof(header), 0) != sizeof(header)) {
+    return mFst.open(reader);
+  }
+  mIndexKey.header_crc32 = crc32_update(0, header, sizeof(header));
+  if (mFst.openIndex(mIndexFilePath.c_str(), mIndexKey)) {
+    log("Mapped the FST index %s\n", mIndexFilePath.c_str());
+    return true;
+  }
+
+  if (!mFst.open(reader)) {
+    return false;
+  }
+  if (mFst.saveIndex(mIndexFilePath.c_str(), mIndexKey)) {
+    log("Saved the FST index to %s\n", mIndexFilePath.c_str());
+  } else {
+    log("Unable to save the FST index to %s\n", mIndexFilePath.c_str());
+  }
+  return true;
+}
+
+bool GamecubeIsoFilesystem::parseReaderType(const char *name,
+                                            ReaderType *type) {
+  if (!strcmp(name, "file")) {
+    *type = READER_FILE;
+  } else if (!strcmp(name, "mmap")) {
+    *type = READER_MMAP;
+  } else if (!strcmp(name, "uring")) {
+    *type = READER_URING;
+  } else {
+    return false;
+  }
   return true;
 }
 
+ThreadPool *GamecubeIsoFilesystem::getPool() {
+  if (mPool == nullptr) {
+    mPool = new ThreadPool(WORKER_THREADS);
+  }
+  return mPool;
+}
+
+BinaryReader *GamecubeIsoFilesystem::openReader(const char *filePath) {
+  BinaryReader *const file = openFileReader(filePath);
+  if (file == nullptr) {
+    return nullptr;
+  }
+
+  // compressed images are recognized by their magic, anything else is
+  // taken to be a plain ISO
+  if (GczBinaryReader::detect(file)) {
+    log("%s is a GCZ image\n", filePath);
+    GczBinaryReader *const reader = new GczBinaryReader(file, getPool());
+    if (!reader->open()) {
+      delete reader;
+      return nullptr;
+    }
+    return reader;
+  }
+  if (WiaBinaryReader::detect(file)) {
+    log("%s is a WIA/RVZ image\n", filePath);
+    WiaBinaryReader *const reader = new WiaBinaryReader(file, getPool());
+    if (!reader->open()) {
+      delete reader;
+      return nullptr;
+    }
+    return reader;
+  }
+  if (CisoBinaryReader::detect(file)) {
+    log("%s is a CISO image\n", filePath);
+    CisoBinaryReader *const reader = new CisoBinaryReader(file);
+    if (!reader->open()) {
+      delete reader;
+      return nullptr;
+    }
+    return reader;
+  }
+  if (WbfsBinaryReader::detect(file)) {
+    log("%s is a WBFS container\n", filePath);
+    WbfsBinaryReader *const reader = new WbfsBinaryReader(file);
+    if (!reader->open() || !selectDisc(reader)) {
+      delete reader;
+      return nullptr;
+    }
+    return reader;
+  }
+  return file;
+}
+
+bool GamecubeIsoFilesystem::selectDisc(WbfsBinaryReader *reader) {
+  const std::vector<WbfsBinaryReader::Disc> &discs = reader->getDiscs();
+  size_t selected = discs.size();
+
+  // the disc is picked by its index in the container or by its game id,
+  // the first one is mounted if nothing is asked for
+  if (mDisc.empty()) {
+    selected = 0;
+  } else if (mDisc.find_first_not_of("0123456789") == std::string::npos) {
+    selected = strtoul(mDisc.c_str(), nullptr, 10);
+  } else {
+    for (size_t i = 0; i < discs.size(); ++i) {
+      if (discs[i].gameId == mDisc) {
+        selected = i;
+        break;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < discs.size(); ++i) {
+    log("%c disc %lu: %s %s\n", i == selected ? '*' : ' ', i,
+        discs[i].gameId.c_str(), discs[i].name.c_str());
+  }
+  if (selected >= discs.size()) {
+    log("No disc %s in the container\n", mDisc.c_str());
+    return false;
+  }
+  return reader->select(selected);
+}
+
+BinaryReader *GamecubeIsoFilesystem::openFileReader(const char *filePath) {
+  switch (mReaderType) {
+  case READER_MMAP: {
+    BinaryMmapReader *reader = new BinaryMmapReader();
+    if (!reader->open(filePath)) {
+      delete reader;
+      return nullptr;
+    }
+    return reader;
+  }
+  case READER_URING: {
+    UringBinaryReader *reader = new UringBinaryReader();
+    if (!reader->open(filePath)) {
+      delete reader;
+      return nullptr;
+    }
+    if (!reader->isAvailable()) {
+      log("io_uring is unavailable, reading %s with pread\n", filePath);
+    }
+    return reader;
+  }
+  case READER_FILE:
+  default: {
+    BinaryFILEReader *reader = new BinaryFILEReader();
+    if (!reader->open(filePath)) {
+      delete reader;
+      return nullptr;
+    }
+    return reader;
+  }
+  }
+}
+
 void GamecubeIsoFilesystem::log(const char *format, ...) {
-  if (mLogFile) {
+  if (mLog) {
     va_list ap;
     va_start(ap, format);
 
-    vfprintf(mLogFile, format, ap);
-    fflush(mLogFile);
+    mLog->message(format, ap);
+    va_end(ap);
   }
 }
 
+void *GamecubeIsoFilesystem::init(struct fuse_conn_info *conn) {
+  // file data can be spliced from the image to the kernel without a copy
+  conn->want |= conn->capable & (FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+  // by now the process has daemonized
+  if (mLog) {
+    mLog->start();
+  }
+  // warm the caches with what the last boot read while this one starts
+  if (mProfile && mProfile->getLoadedExtents() > 0) {
+    mPrefetcher = std::thread([this] {
+      const uint64_t bytes = mProfile->prefetch(mFile);
+      log("Prefetched %llu bytes of the access profile\n",
+          static_cast<unsigned long long>(bytes));
+    });
+  }
+  return this;
+}
+
 void GamecubeIsoFilesystem::destroy(void *userdata) { delete this; }
 
 int GamecubeIsoFilesystem::statfs(const char *path, struct statvfs *sfs) {
-  log("statfs %s\n", path);
+  log(AsyncLog::OP_STATFS, path);
+  trace(TRACE_STATFS, path, 0, 0);
 
   sfs->f_bsize = GC_DVD_SECTOR_SIZE;
   sfs->f_frsize = 512;
@@ -112,75 +465,52 @@ int GamecubeIsoFilesystem::statfs(const char *path, struct statvfs *sfs) {
   return 0;
 }
 
-struct search_callback_data {
-  GamecubeFilesystemTable *fileSystem;
-  const char *name;
-  gc_dvdfs_file_entry *found;
-};
-
-static int search_callback(gc_dvdfs_file_entry *pfe, void *param) {
-  search_callback_data *const data =
-      reinterpret_cast<search_callback_data *>(param);
-
-  if (strcmp(data->name, data->fileSystem->getFileName(pfe)) == 0) {
-    data->found = pfe;
-    return -1;
-  }
-  return 0;
+int GamecubeIsoFilesystem::compareNames(const char *a, const char *b) const {
+  return mIgnoreCase ? strcasecmp(a, b) : strcmp(a, b);
 }
 
-gc_dvdfs_file_entry *GamecubeIsoFilesystem::search(gc_dvdfs_file_entry *pfe,
-                                                   const char *name) {
-  search_callback_data data;
-
-  if (pfe->type != FST_DIRECTORY) {
-    return nullptr;
-  }
-
-  data.fileSystem = &mFst;
-  data.name = name;
-  data.found = nullptr;
-
-  mFst.enumerate(pfe, search_callback, &data);
-  return data.found;
+int GamecubeIsoFilesystem::compareNames(const char *a, const char *b,
+                                        size_t length) const {
+  return mIgnoreCase ? strncasecmp(a, b, length) : strncmp(a, b, length);
 }
 
 // Returns 0 on error
 ino_t GamecubeIsoFilesystem::convertPathToInode(const char *path) {
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_LOOKUP);
+
   if (!strcmp(path, "/")) {
     return ROOT_INO;
-  } else if (!strcmp(path, "/apploader")) {
+  } else if (!compareNames(path, "/apploader")) {
     return APPLOADER_INO;
-  } else if (!strcmp(path, "/boot.dol")) {
+  } else if (!compareNames(path, "/boot.dol")) {
     return BOOTDOL_INO;
-  } else if (!strcmp(path, "/data")) {
+  } else if (!compareNames(path, "/data")) {
     return DATA_INO;
+  } else if (!compareNames(path, "/.stats")) {
+    return STATS_INO;
+  } else if (!compareNames(path, "/.verify")) {
+    return VERIFY_INO;
   } else {
-    Tokenizer tokenizer(path);
-    auto const tokens = tokenizer.getTokens();
-
-    if (tokens.size() <= 0) {
-      log("convertPathToInode failed for %s\n", path);
-      return 0;
-    }
-    // grab first, ensure it's data
-    if (strcmp("data", tokens.front())) {
-      log("convertPathToInode failed for %s\n", path);
+    // everything else must live under /data
+    if (compareNames(path, "/data/", 6)) {
+      log(AsyncLog::OP_NOT_FOUND, path);
       return 0;
     }
 
-    // walk the directory searching for the path
-    gc_dvdfs_file_entry *root = mFst.getRoot();
-    for (auto iter = tokens.begin() + 1; iter != tokens.end(); ++iter) {
-      if ((root = search(root, *iter)) == nullptr) {
-        log("convertPathToInode failed for %s\n", path);
-        return 0;
-      }
+    const gc_dvdfs_file_entry *const pfe =
+        mFst.lookupPath(path + 6, mIgnoreCase);
+    if (pfe == nullptr) {
+      log(AsyncLog::OP_NOT_FOUND, path);
+      return 0;
     }
-    return fileEntryToInode(root);
+    return fileEntryToInode(pfe);
   }
 }
 
+bool GamecubeIsoFilesystem::isValidInode(ino_t inode) const {
+  return inode >= ROOT_INO && inode < DATA_INO + mFst.getEntryCount();
+}
+
 void GamecubeIsoFilesystem::init_statbuf(struct stat *statbuf, ino_t inode) {
   memset(statbuf, 0, sizeof(struct stat));
   statbuf->st_ino = inode;
@@ -194,9 +524,9 @@ void GamecubeIsoFilesystem::init_statbuf(struct stat *statbuf, ino_t inode) {
 }
 
 int GamecubeIsoFilesystem::fgetattr_by_pfe(struct stat *statbuf,
-                                           gc_dvdfs_file_entry *pfe) {
+                                           const gc_dvdfs_file_entry *pfe) {
   init_statbuf(statbuf, fileEntryToInode(pfe));
-  if (pfe->type == FST_DIRECTORY) {
+  if (mFst.isDirectory(pfe)) {
     struct gc_dvdfs_directory_info di;
     // get information about the directory
     mFst.getDirectoryInfo(pfe, &di);
@@ -205,8 +535,8 @@ int GamecubeIsoFilesystem::fgetattr_by_pfe(struct stat *statbuf,
     statbuf->st_nlink = /*2 +*/ di.total_directories;
   } else {
     statbuf->st_mode |= S_IFREG;
-    statbuf->st_size = pfe->file.length;
-    statbuf->st_blocks = pfe->file.length / 512;
+    statbuf->st_size = mFst.getFileLength(pfe);
+    statbuf->st_blocks = statbuf->st_size / 512;
   }
   return 0;
 }
@@ -214,11 +544,7 @@ int GamecubeIsoFilesystem::fgetattr_by_pfe(struct stat *statbuf,
 int GamecubeIsoFilesystem::fgetattr_by_inode(const char *path,
                                              struct stat *statbuf,
                                              ino_t inode) {
-  if (path) {
-    log("fgetattr %s:%d\n", path, inode);
-  } else {
-    log("fgetattr %d\n", inode);
-  }
+  log(AsyncLog::OP_FGETATTR, path, inode);
 
   switch (inode) {
   case ROOT_INO:
@@ -238,6 +564,12 @@ int GamecubeIsoFilesystem::fgetattr_by_inode(const char *path,
     statbuf->st_size = mFst.getDolLength();
     statbuf->st_blocks = statbuf->st_size / 512;
     break;
+  case STATS_INO:
+  case VERIFY_INO:
+    // the size isn't known until it's opened, it's read with direct I/O
+    init_statbuf(statbuf, inode);
+    statbuf->st_mode |= S_IFREG;
+    break;
   default:
     return fgetattr_by_pfe(statbuf, inodeToFileEntry(inode));
   }
@@ -246,13 +578,17 @@ int GamecubeIsoFilesystem::fgetattr_by_inode(const char *path,
 
 int GamecubeIsoFilesystem::fgetattr(const char *path, struct stat *statbuf,
                                     struct fuse_file_info *fi) {
-  log("fgetattr %s\n", path);
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_GETATTR);
+  log(AsyncLog::OP_FGETATTR, path);
+  trace(TRACE_FGETATTR, path, getOpenFile(fi)->inode, fi->fh);
 
-  return fgetattr_by_inode(path, statbuf, fi->fh);
+  return fgetattr_by_inode(path, statbuf, getOpenFile(fi)->inode);
 }
 
 int GamecubeIsoFilesystem::getattr(const char *path, struct stat *statbuf) {
-  log("getattr %s\n", path);
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_GETATTR);
+  log(AsyncLog::OP_GETATTR, path);
+  trace(TRACE_GETATTR, path, 0, 0);
 
   const ino_t inode = convertPathToInode(path);
   if (inode <= 0) {
@@ -263,7 +599,8 @@ int GamecubeIsoFilesystem::getattr(const char *path, struct stat *statbuf) {
 
 int GamecubeIsoFilesystem::opendir(const char *path,
                                    struct fuse_file_info *fi) {
-  log("opendir %s\n", path);
+  log(AsyncLog::OP_OPENDIR, path);
+  trace(TRACE_OPENDIR, path, 0, 0);
 
   const ino_t inode = convertPathToInode(path);
   if (inode > 0) {
@@ -279,7 +616,8 @@ int GamecubeIsoFilesystem::opendir(const char *path,
 
 int GamecubeIsoFilesystem::releasedir(const char *path,
                                       struct fuse_file_info *fi) {
-  log("releasedir %s\n", path);
+  log(AsyncLog::OP_RELEASEDIR, path);
+  trace(TRACE_RELEASEDIR, path, fi->fh, fi->fh);
   return 0;
 }
 
@@ -289,32 +627,47 @@ struct readdir_callback_data {
   fuse_fill_dir_t filler;
 };
 
-int GamecubeIsoFilesystem::readdir_callback(gc_dvdfs_file_entry *pfe,
+// Directories are listed a buffer at a time. The offset of an FST entry is
+// the index of the one after it, what enumerate resumes from, so every call
+// costs what it returns however big the directory is. The root's fixed
+// entries have their position plus one.
+int GamecubeIsoFilesystem::readdir_callback(const gc_dvdfs_file_entry *pfe,
                                             void *param) {
   struct stat statbuf;
   readdir_callback_data *const data =
       reinterpret_cast<readdir_callback_data *>(param);
+  GamecubeIsoFilesystem *const context = data->context;
 
-  data->context->fgetattr_by_pfe(&statbuf, pfe);
-  return data->filler(data->buf, data->context->mFst.getFileName(pfe), &statbuf,
-                      0);
+  context->fgetattr_by_pfe(&statbuf, pfe);
+  if (data->filler(data->buf, context->mFst.getFileName(pfe), &statbuf,
+                   context->mFst.getNext(pfe))) {
+    context->log(AsyncLog::OP_FILLER_FULL, nullptr);
+    return -ENOSPC;
+  }
+  return 0;
 }
 
 int GamecubeIsoFilesystem::readdir(const char *path, void *buf,
                                    fuse_fill_dir_t filler, off_t offset,
                                    struct fuse_file_info *fi) {
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_READDIR);
   const auto inode = fi->fh;
 
-  log("readdir %s:%d\n", path, inode);
+  log(AsyncLog::OP_READDIR, path, inode);
+  trace(TRACE_READDIR, path, inode, fi->fh, offset);
+  // past the end, or not an offset we gave out
+  if (offset < 0 || offset > UINT32_MAX) {
+    return 0;
+  }
   if (inode == ROOT_INO) {
-    for (unsigned int i = 0; i < num_root_dir_entries; ++i) {
+    for (unsigned int i = offset; i < num_root_dir_entries; ++i) {
       struct stat statbuf;
       if (fgetattr_by_inode(nullptr, &statbuf, root_dir_entries[i].inode)) {
         break;
       }
 
-      if (filler(buf, root_dir_entries[i].name, &statbuf, 0)) {
-        log("filler buffer full\n");
+      if (filler(buf, root_dir_entries[i].name, &statbuf, i + 1)) {
+        log(AsyncLog::OP_FILLER_FULL, nullptr);
         break;
       }
     }
@@ -326,57 +679,243 @@ int GamecubeIsoFilesystem::readdir(const char *path, void *buf,
     data.buf = buf;
     data.filler = filler;
 
-    mFst.enumerate(inodeToFileEntry(inode), readdir_callback, &data);
+    mFst.enumerate(inodeToFileEntry(inode), readdir_callback, &data, offset);
     return 0;
   }
 }
 
 int GamecubeIsoFilesystem::open(const char *path, struct fuse_file_info *fi) {
-  log("opendir %s\n", path);
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_OPEN);
+  log(AsyncLog::OP_OPEN, path);
 
   const ino_t inode = convertPathToInode(path);
+  if (inode == STATS_INO || inode == VERIFY_INO) {
+    fi->direct_io = 1;
+    fi->fh = reinterpret_cast<uint64_t>(createGeneratedFile(inode));
+    trace(TRACE_OPEN, path, inode, fi->fh);
+    return 0;
+  }
   if (inode > 0) {
-    fi->fh = inode;
     struct stat statbuf;
     if (const int i = fgetattr_by_inode(path, &statbuf, inode)) {
       return i;
     }
-    return (statbuf.st_mode & S_IFDIR) ? -ENOENT : 0;
+    if (statbuf.st_mode & S_IFDIR) {
+      return -ENOENT;
+    }
+
+    off_t block_base;
+    size_t file_length;
+    if (!getExtent(inode, &block_base, &file_length)) {
+      return -ENOENT;
+    }
+    fi->fh = reinterpret_cast<uint64_t>(
+        createOpenFile(inode, block_base, file_length));
+    // recorded once there's a handle for the reads to refer to
+    trace(TRACE_OPEN, path, inode, fi->fh);
+    return 0;
   }
   return -EEXIST;
 }
 
 int GamecubeIsoFilesystem::release(const char *path,
                                    struct fuse_file_info *fi) {
-  log("release %s\n", path);
+  log(AsyncLog::OP_RELEASE, path);
+  trace(TRACE_RELEASE, path, getOpenFile(fi)->inode, fi->fh);
+  destroyOpenFile(fi);
   return 0;
 }
 
+GamecubeIsoFilesystem::OpenFile *
+GamecubeIsoFilesystem::createOpenFile(ino_t inode, off_t block_base,
+                                      size_t file_length) {
+  OpenFile *const file = new OpenFile();
+
+  file->inode = inode;
+  file->readahead = nullptr;
+  file->contents = nullptr;
+  // large files are streamed, let the reader prefetch them
+  if (file_length >= SEQUENTIAL_FILE_SIZE) {
+    {
+      std::lock_guard<std::mutex> guard(mAdviceLock);
+      if (mSequentialOpens[inode]++ == 0) {
+        mFile->advise(block_base, file_length,
+                      BinaryReader::ADVICE_SEQUENTIAL);
+      }
+    }
+    file->base = block_base;
+    file->length = file_length;
+    if (mReadaheadSize > 0) {
+      file->readahead = new ReadaheadStream(mFile, mPool, block_base,
+                                            file_length, mReadaheadSize);
+    }
+  }
+  return file;
+}
+
+void GamecubeIsoFilesystem::destroyOpenFile(struct fuse_file_info *fi) {
+  OpenFile *const file = getOpenFile(fi);
+
+  // the advice outlives the open, later reads of the range may be random,
+  // but other handles may still be streaming the file
+  if (file->length > 0) {
+    std::lock_guard<std::mutex> guard(mAdviceLock);
+    if (--mSequentialOpens[file->inode] == 0) {
+      mSequentialOpens.erase(file->inode);
+      mFile->advise(file->base, file->length, BinaryReader::ADVICE_NORMAL);
+    }
+  }
+  if (file->readahead) {
+    delete file->readahead;
+  }
+  if (file->contents) {
+    delete file->contents;
+  }
+  delete file;
+}
+
+// Generated files are rendered once per open, so every read of one open
+// sees the same contents
+GamecubeIsoFilesystem::OpenFile *
+GamecubeIsoFilesystem::createGeneratedFile(ino_t inode) {
+  OpenFile *const file =
+      inode == STATS_INO ? createStatsFile() : createVerifyFile();
+
+  file->inode = inode;
+  file->readahead = nullptr;
+  return file;
+}
+
+// one Prometheus counter with its HELP and TYPE lines
+static void appendCounter(std::string *out, const char *name,
+                          const char *help, uint64_t value) {
+  out->append("# HELP ").append(name).append(" ").append(help).append("\n");
+  out->append("# TYPE ").append(name).append(" counter\n");
+  out->append(name).append(" ").append(std::to_string(value)).append("\n");
+}
+
+GamecubeIsoFilesystem::OpenFile *GamecubeIsoFilesystem::createStatsFile() {
+  OpenFile *const file = new OpenFile();
+
+  file->contents = new std::string();
+  mStats.writePrometheus(file->contents);
+  if (mCache) {
+    appendCounter(file->contents, "gcdvdfs_block_cache_hits_total",
+                  "Block cache hits.", mCache->getHits());
+    appendCounter(file->contents, "gcdvdfs_block_cache_misses_total",
+                  "Block cache misses.", mCache->getMisses());
+  }
+  if (mLog) {
+    appendCounter(file->contents, "gcdvdfs_log_dropped_total",
+                  "Log records dropped.", mLog->getDropped());
+  }
+  return file;
+}
+
+// The first open starts hashing the image in the background, until it's
+// done the file only tells how far it got. A pass that failed is reported
+// once, the open after that starts over.
+GamecubeIsoFilesystem::OpenFile *GamecubeIsoFilesystem::createVerifyFile() {
+  OpenFile *const file = new OpenFile();
+  char line[128];
+
+  file->contents = new std::string();
+  std::lock_guard<std::mutex> guard(mVerifyLock);
+  if (mVerifier == nullptr) {
+    // straight from the image, hashing it all would only churn the cache
+    mVerifier =
+        new DiscVerifier(mCache ? mCache->getReader() : mFile, mFst);
+    DiscVerifier *const verifier = mVerifier;
+    // not on the pool, the pass would hold a worker for as long as it takes
+    // to read the whole image
+    mVerifyThread = std::thread([this, verifier] {
+      if (verifier->run()) {
+        log("Verified the image at %.2f GB/s\n",
+            verifier->getDigests().size / verifier->getSeconds() / 1e9);
+      }
+    });
+  }
+  if (mVerifier->isDone()) {
+    mVerifier->writeReport(file->contents, true);
+    if (mVerifier->hasFailed()) {
+      mVerifyThread.join();
+      delete mVerifier;
+      mVerifier = nullptr;
+    }
+  } else {
+    snprintf(line, sizeof(line), "verifying, %llu bytes hashed so far\n",
+             static_cast<unsigned long long>(mVerifier->getHashed()));
+    file->contents->append(line);
+  }
+  return file;
+}
+
+size_t GamecubeIsoFilesystem::readContents(OpenFile *file, void *buf,
+                                            size_t size, off_t offset) {
+  if (static_cast<size_t>(offset) >= file->contents->size()) {
+    return 0;
+  }
+  size = std::min(size, file->contents->size() - offset);
+  memcpy(buf, file->contents->data() + offset, size);
+  return size;
+}
+
+// Reads size bytes at offset of an open file, already clamped to its length
+int GamecubeIsoFilesystem::readOpenFile(OpenFile *file, void *buf, size_t size,
+                                        off_t offset, off_t block_base) {
+  if (file->readahead) {
+    return file->readahead->read(buf, size, offset);
+  }
+  return mFile->read(buf, size, block_base + offset);
+}
+
+bool GamecubeIsoFilesystem::getExtent(ino_t inode, off_t *block_base,
+                                      size_t *file_length) const {
+  switch (inode) {
+  case ROOT_INO:
+  case STATS_INO:
+  case VERIFY_INO:
+    return false;
+  case APPLOADER_INO:
+    *file_length = mFst.getApploader().size;
+    *block_base = APPLOADER_OFFSET;
+    return true;
+  case BOOTDOL_INO:
+    *file_length = mFst.getDolLength();
+    *block_base = mFst.getDolOffset();
+    return true;
+  default: {
+    const gc_dvdfs_file_entry *pfe = inodeToFileEntry(inode);
+    if (!mFst.isFile(pfe)) {
+      return false;
+    }
+    *file_length = mFst.getFileLength(pfe);
+    *block_base = mFst.getFileOffset(pfe);
+    return true;
+  }
+  }
+}
+
 int GamecubeIsoFilesystem::read(const char *path, char *buf, size_t size,
                                 off_t offset, struct fuse_file_info *fi) {
-  const ino_t inode = fi->fh;
-  const gc_dvdfs_file_entry *pfe = inodeToFileEntry(inode);
+  OpenFile *const file = getOpenFile(fi);
+  const ino_t inode = file->inode;
   off_t block_base;
   size_t file_length;
   off_t read;
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_READ);
 
-  log("read %d:%d:%d\n", inode, size, offset);
+  log(AsyncLog::OP_READ, nullptr, inode, offset, size);
+  trace(TRACE_READ, nullptr, inode, fi->fh, offset, size);
 
-  switch (inode) {
-  case ROOT_INO:
+  if (file->contents) {
+    read = readContents(file, buf, size, offset);
+    timer.setBytes(read);
+    return read;
+  }
+
+  if (!getExtent(inode, &block_base, &file_length)) {
     return 0;
-  case APPLOADER_INO:
-    file_length = mFst.getApploader().size;
-    block_base = APPLOADER_OFFSET;
-    break;
-  case BOOTDOL_INO:
-    file_length = mFst.getDolLength();
-    block_base = mFst.getDolOffset();
-    break;
-  default:
-    file_length = pfe->file.length;
-    block_base = pfe->file.offset;
-    break;
   }
 
   if (static_cast<size_t>(offset) >= file_length) {
@@ -384,5 +923,360 @@ int GamecubeIsoFilesystem::read(const char *path, char *buf, size_t size,
   }
 
   read = std::min(size, static_cast<size_t>(file_length - offset));
-  return mFile->read(buf, read, block_base + offset);
+  read = readOpenFile(file, buf, read, offset, block_base);
+  if (read > 0) {
+    timer.setBytes(read);
+    recordAccess(block_base + offset, read);
+  }
+  return read;
+}
+
+int GamecubeIsoFilesystem::read_buf(const char *path, struct fuse_bufvec **bufp,
+                                    size_t size, off_t offset,
+                                    struct fuse_file_info *fi) {
+  OpenFile *const file = getOpenFile(fi);
+  const ino_t inode = file->inode;
+  off_t block_base;
+  size_t file_length;
+  size_t length = 0;
+  // spliced data is only moved once this returns, that isn't timed
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_READ);
+
+  log(AsyncLog::OP_READ_BUF, nullptr, inode, offset, size);
+  trace(TRACE_READ_BUF, nullptr, inode, fi->fh, offset, size);
+
+  if (file->contents) {
+    block_base = 0;
+    file_length = file->contents->size();
+  } else if (!getExtent(inode, &block_base, &file_length)) {
+    file_length = 0;
+  }
+  if (static_cast<size_t>(offset) < file_length) {
+    length = std::min(size, static_cast<size_t>(file_length - offset));
+  }
+  if (!file->contents) {
+    recordAccess(block_base + offset, length);
+  }
+
+  // libfuse frees the vector and any memory buffer once it has replied
+  struct fuse_bufvec *const bufv =
+      reinterpret_cast<struct fuse_bufvec *>(malloc(sizeof(*bufv)));
+  if (bufv == nullptr) {
+    return -ENOMEM;
+  }
+  *bufv = FUSE_BUFVEC_INIT(length);
+
+  // streamed files are served from their readahead buffers instead
+  const int fd =
+      file->readahead || file->contents ? -1 : mFile->getFileDescriptor();
+  if (length > 0 && fd >= 0) {
+    // every file is one extent of the image, point libfuse at it
+    bufv->buf[0].flags =
+        static_cast<fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+    bufv->buf[0].fd = fd;
+    bufv->buf[0].pos = block_base + offset;
+  } else if (length > 0) {
+    void *const mem = malloc(length);
+    int read = -ENOMEM;
+    if (mem && file->contents) {
+      read = readContents(file, mem, length, offset);
+    } else if (mem) {
+      read = readOpenFile(file, mem, length, offset, block_base);
+    }
+    if (read < 0) {
+      free(mem);
+      free(bufv);
+      return read == -ENOMEM ? read : -EIO;
+    }
+    bufv->buf[0].mem = mem;
+    bufv->buf[0].size = length = read;
+  }
+
+  timer.setBytes(length);
+  *bufp = bufv;
+  return 0;
+}
+
+// Low-level, inode based front end. Inode numbers are the same ones the path
+// based handlers use, so FUSE_ROOT_ID is ROOT_INO and FST entries map
+// straight to and from inodes without any path resolution.
+
+void GamecubeIsoFilesystem::ll_lookup(fuse_req_t req, fuse_ino_t parent,
+                                      const char *name) {
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_LOOKUP);
+  struct fuse_entry_param entry;
+  ino_t inode = 0;
+
+  log(AsyncLog::OP_LL_LOOKUP, name, parent);
+  trace(TRACE_LL_LOOKUP, name, parent, 0);
+
+  if (parent == ROOT_INO) {
+    for (unsigned int i = 0; i < num_root_dir_entries; ++i) {
+      if (!compareNames(name, root_dir_entries[i].name)) {
+        inode = root_dir_entries[i].inode;
+        break;
+      }
+    }
+  } else if (parent >= DATA_INO && isValidInode(parent)) {
+    const gc_dvdfs_file_entry *const dir = inodeToFileEntry(parent);
+    // a file has no entries, not even negative ones worth caching
+    if (!mFst.isDirectory(dir)) {
+      fuse_reply_err(req, ENOTDIR);
+      return;
+    }
+    const gc_dvdfs_file_entry *const pfe =
+        mIgnoreCase ? mFst.lookupIgnoringCase(dir, name, strlen(name))
+                    : mFst.lookup(dir, name, strlen(name));
+    if (pfe != nullptr) {
+      inode = fileEntryToInode(pfe);
+    }
+  } else {
+    fuse_reply_err(req, ENOTDIR);
+    return;
+  }
+
+  memset(&entry, 0, sizeof(entry));
+  // a zero inode is a negative entry, the kernel caches misses too
+  entry.entry_timeout = CACHE_TIMEOUT;
+  if (inode > 0) {
+    entry.ino = inode;
+    entry.attr_timeout = CACHE_TIMEOUT;
+    if (fgetattr_by_inode(nullptr, &entry.attr, inode)) {
+      fuse_reply_err(req, ENOENT);
+      return;
+    }
+  }
+  fuse_reply_entry(req, &entry);
+}
+
+void GamecubeIsoFilesystem::ll_getattr(fuse_req_t req, fuse_ino_t ino,
+                                       struct fuse_file_info *fi) {
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_GETATTR);
+  struct stat statbuf;
+
+  trace(TRACE_LL_GETATTR, nullptr, ino, fi ? fi->fh : 0);
+
+  if (!isValidInode(ino)) {
+    fuse_reply_err(req, ENOENT);
+    return;
+  }
+  if (const int i = fgetattr_by_inode(nullptr, &statbuf, ino)) {
+    fuse_reply_err(req, -i);
+    return;
+  }
+  fuse_reply_attr(req, &statbuf, CACHE_TIMEOUT);
+}
+
+void GamecubeIsoFilesystem::ll_opendir(fuse_req_t req, fuse_ino_t ino,
+                                       struct fuse_file_info *fi) {
+  struct stat statbuf;
+
+  log(AsyncLog::OP_LL_OPENDIR, nullptr, ino);
+  trace(TRACE_LL_OPENDIR, nullptr, ino, 0);
+
+  if (!isValidInode(ino)) {
+    fuse_reply_err(req, ENOENT);
+    return;
+  }
+  if (const int i = fgetattr_by_inode(nullptr, &statbuf, ino)) {
+    fuse_reply_err(req, -i);
+    return;
+  }
+  if (!(statbuf.st_mode & S_IFDIR)) {
+    fuse_reply_err(req, ENOTDIR);
+    return;
+  }
+
+  fi->fh = ino;
+  fi->keep_cache = 1;
+  fuse_reply_open(req, fi);
+}
+
+void GamecubeIsoFilesystem::ll_releasedir(fuse_req_t req, fuse_ino_t ino,
+                                          struct fuse_file_info *fi) {
+  log(AsyncLog::OP_LL_RELEASEDIR, nullptr, ino);
+  trace(TRACE_LL_RELEASEDIR, nullptr, ino, fi->fh);
+  fuse_reply_err(req, 0);
+}
+
+struct ll_readdir_data {
+  GamecubeIsoFilesystem *context;
+  fuse_req_t req;
+  char *buf;
+  size_t size;
+  size_t used;
+};
+
+// Appends one entry to the reply, with the same offsets readdir gives.
+// Returns non zero once the reply is full.
+int GamecubeIsoFilesystem::ll_add_direntry(ll_readdir_data *data,
+                                           const char *name,
+                                           const struct stat *statbuf,
+                                           off_t next) {
+  const size_t length =
+      fuse_add_direntry(data->req, data->buf + data->used,
+                        data->size - data->used, name, statbuf, next);
+  if (length > data->size - data->used) {
+    return 1;
+  }
+  data->used += length;
+  return 0;
+}
+
+int GamecubeIsoFilesystem::ll_readdir_callback(const gc_dvdfs_file_entry *pfe,
+                                               void *param) {
+  struct stat statbuf;
+  ll_readdir_data *const data = reinterpret_cast<ll_readdir_data *>(param);
+
+  data->context->fgetattr_by_pfe(&statbuf, pfe);
+  return ll_add_direntry(data, data->context->mFst.getFileName(pfe), &statbuf,
+                         data->context->mFst.getNext(pfe))
+             ? -ENOSPC
+             : 0;
+}
+
+void GamecubeIsoFilesystem::ll_readdir(fuse_req_t req, fuse_ino_t ino,
+                                       size_t size, off_t offset,
+                                       struct fuse_file_info *fi) {
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_READDIR);
+  std::vector<char> buf(size);
+  ll_readdir_data data;
+
+  log(AsyncLog::OP_LL_READDIR, nullptr, ino, offset, size);
+  trace(TRACE_LL_READDIR, nullptr, ino, fi->fh, offset, size);
+
+  if (offset < 0 || offset > UINT32_MAX) {
+    // past the end, or not an offset we gave out
+    fuse_reply_buf(req, nullptr, 0);
+    return;
+  }
+
+  data.context = this;
+  data.req = req;
+  data.buf = buf.data();
+  data.size = size;
+  data.used = 0;
+
+  if (ino == ROOT_INO) {
+    for (unsigned int i = offset; i < num_root_dir_entries; ++i) {
+      struct stat statbuf;
+      if (fgetattr_by_inode(nullptr, &statbuf, root_dir_entries[i].inode) ||
+          ll_add_direntry(&data, root_dir_entries[i].name, &statbuf, i + 1)) {
+        break;
+      }
+    }
+  } else {
+    mFst.enumerate(inodeToFileEntry(ino), ll_readdir_callback, &data, offset);
+  }
+  fuse_reply_buf(req, data.buf, data.used);
+}
+
+void GamecubeIsoFilesystem::ll_open(fuse_req_t req, fuse_ino_t ino,
+                                    struct fuse_file_info *fi) {
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_OPEN);
+  off_t block_base;
+  size_t file_length;
+
+  log(AsyncLog::OP_LL_OPEN, nullptr, ino);
+
+  if (!isValidInode(ino)) {
+    fuse_reply_err(req, ENOENT);
+    return;
+  }
+  if (ino == STATS_INO || ino == VERIFY_INO) {
+    fi->fh = reinterpret_cast<uint64_t>(createGeneratedFile(ino));
+    fi->direct_io = 1;
+  } else if (!getExtent(ino, &block_base, &file_length)) {
+    fuse_reply_err(req, EISDIR);
+    return;
+  } else {
+    fi->fh = reinterpret_cast<uint64_t>(
+        createOpenFile(ino, block_base, file_length));
+    fi->keep_cache = 1;
+  }
+  // recorded before the reply, the reads can't come earlier
+  trace(TRACE_LL_OPEN, nullptr, ino, fi->fh);
+  if (fuse_reply_open(req, fi) == -ENOENT) {
+    // the open was interrupted, release will never come
+    destroyOpenFile(fi);
+  }
+}
+
+void GamecubeIsoFilesystem::ll_release(fuse_req_t req, fuse_ino_t ino,
+                                       struct fuse_file_info *fi) {
+  log(AsyncLog::OP_LL_RELEASE, nullptr, ino);
+  trace(TRACE_LL_RELEASE, nullptr, ino, fi->fh);
+  destroyOpenFile(fi);
+  fuse_reply_err(req, 0);
+}
+
+void GamecubeIsoFilesystem::ll_read(fuse_req_t req, fuse_ino_t ino,
+                                    size_t size, off_t offset,
+                                    struct fuse_file_info *fi) {
+  OpenFile *const file = getOpenFile(fi);
+  off_t block_base;
+  size_t file_length;
+  OperationStats::Timer timer(&mStats, OperationStats::STAT_READ);
+
+  log(AsyncLog::OP_LL_READ, nullptr, ino, offset, size);
+  trace(TRACE_LL_READ, nullptr, ino, fi->fh, offset, size);
+
+  if (file->contents) {
+    std::vector<char> buf(size);
+    const size_t read = readContents(file, buf.data(), size, offset);
+    timer.setBytes(read);
+    fuse_reply_buf(req, buf.data(), read);
+    return;
+  }
+  if (!getExtent(ino, &block_base, &file_length)) {
+    fuse_reply_err(req, EISDIR);
+    return;
+  }
+  if (static_cast<size_t>(offset) >= file_length) {
+    fuse_reply_buf(req, nullptr, 0);
+    return;
+  }
+
+  const size_t length =
+      std::min(size, static_cast<size_t>(file_length - offset));
+  timer.setBytes(length);
+  recordAccess(block_base + offset, length);
+  // splice straight from the image when it's backed by a plain file, unless
+  // the file is streamed from its readahead buffers
+  const int fd = file->readahead ? -1 : mFile->getFileDescriptor();
+  if (fd >= 0) {
+    struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(length);
+    bufv.buf[0].flags =
+        static_cast<fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+    bufv.buf[0].fd = fd;
+    bufv.buf[0].pos = block_base + offset;
+    fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_MOVE);
+    return;
+  }
+  // otherwise reply straight out of the mapping when the reader has one
+  const void *data;
+  if (!file->readahead &&
+      (data = mFile->map(block_base + offset, length)) != nullptr) {
+    fuse_reply_buf(req, reinterpret_cast<const char *>(data), length);
+    return;
+  }
+
+  std::vector<char> buf(length);
+  const int read = readOpenFile(file, buf.data(), length, offset, block_base);
+  if (read < 0) {
+    timer.setBytes(0);
+    fuse_reply_err(req, EIO);
+    return;
+  }
+  timer.setBytes(read);
+  fuse_reply_buf(req, buf.data(), read);
+}
+
+void GamecubeIsoFilesystem::ll_statfs(fuse_req_t req, fuse_ino_t ino) {
+  struct statvfs sfs;
+
+  // statfs only fills in some of it, libfuse zeroes it for the path API
+  memset(&sfs, 0, sizeof(sfs));
+  statfs("/", &sfs);
+  fuse_reply_statfs(req, &sfs);
 }
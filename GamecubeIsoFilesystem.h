@@ -2,20 +2,61 @@
 #define __CONTEXT__H_
 
 #include <fuse.h>
+#include <fuse_lowlevel.h>
+#include "AccessProfile.h"
+#include "AsyncLog.h"
 #include "BinaryReader.h"
+#include "CachedBinaryReader.h"
+#include "CisoBinaryReader.h"
+#include "DiscVerifier.h"
+#include "GczBinaryReader.h"
 #include "GamecubeFilesystemTable.h"
+#include "OperationStats.h"
+#include "ReadaheadStream.h"
+#include "ThreadPool.h"
+#include "TraceRecorder.h"
+#include "UringBinaryReader.h"
+#include "WbfsBinaryReader.h"
+#include "WiaBinaryReader.h"
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 class GamecubeIsoFilesystem {
 public:
   static const ino_t ROOT_INO = 1;
   static const ino_t APPLOADER_INO = 2;
   static const ino_t BOOTDOL_INO = 3;
-  static const ino_t DATA_INO = 4;
+  // hidden file with operation counters and latencies for scrapers
+  static const ino_t STATS_INO = 4;
+  // hidden file with the image's checksums, hashed on its first open
+  static const ino_t VERIFY_INO = 5;
+  static const ino_t DATA_INO = 6;
+
+  enum ReaderType { READER_FILE, READER_MMAP, READER_URING };
 
 private:
   // Nov 18th, 2001. Date the Gamecube was released in NA!
   static const struct timespec defaultTime;
+  // files at least this big are hinted as sequentially read on open
+  static const size_t SEQUENTIAL_FILE_SIZE = 1024 * 1024;
+  // the image never changes, so the kernel may cache entries and attributes
+  // for as long as it likes
+  static const double CACHE_TIMEOUT;
+  // workers issuing readahead for all open files and decompressing chunks
+  static const unsigned int WORKER_THREADS = 4;
+
+  // per open file state, what fi->fh points at for files
+  struct OpenFile {
+    ino_t inode;
+    ReadaheadStream *readahead; // null unless the file is streamed
+    // a generated file's contents as of the open, null for image files
+    std::string *contents;
+    // the extent advised sequential until the release, length 0 for none
+    off_t base;
+    size_t length;
+  };
 
   static inline GamecubeIsoFilesystem *getContext() {
     return reinterpret_cast<GamecubeIsoFilesystem *>(
@@ -23,24 +64,108 @@ private:
   }
 
   fuse_operations mOperations;
+  fuse_lowlevel_ops mLowLevelOperations;
   GamecubeFilesystemTable mFst;
-  FILE *mLogFile;
+  AsyncLog *mLog;
   BinaryReader *mFile;
   uid_t mUid;
   gid_t mGid;
   std::string mLogFilePath;
+  ReaderType mReaderType;
+  size_t mCacheSize;
+  CachedBinaryReader *mCache; // mFile when caching is on
+  size_t mReadaheadSize;
+  ThreadPool *mPool;
+  std::string mDisc;
+  OperationStats mStats;
+  TraceRecorder *mTrace;
+  std::string mTraceFilePath;
+  AccessProfile *mProfile;
+  std::string mProfileFilePath;
+  // reads the profile ahead on a thread of its own, so one long task never
+  // holds a worker that readahead and decompression are queued behind
+  std::thread mPrefetcher;
+  // open handles per streamed inode, the sequential advice is given by the
+  // first and taken back by the last
+  std::mutex mAdviceLock;
+  std::unordered_map<ino_t, unsigned int> mSequentialOpens;
+  std::mutex mVerifyLock;
+  DiscVerifier *mVerifier; // created by the first open of the verify file
+  // runs mVerifier, which reads the whole image, apart from the pool
+  std::thread mVerifyThread;
+  std::string mIndexDirectory;
+  std::string mIndexFilePath;
+  gc_fst_index_key mIndexKey;
+  bool mIgnoreCase;
 
 public:
   GamecubeIsoFilesystem(uid_t uid, gid_t gid, const char *logFile);
   ~GamecubeIsoFilesystem();
 
+  void setReaderType(ReaderType type) { mReaderType = type; }
+  // the type --reader names, file, mmap or uring, false for anything else
+  static bool parseReaderType(const char *name, ReaderType *type);
+  // memory budget of the block cache in bytes, 0 disables it
+  void setCacheSize(size_t bytes) { mCacheSize = bytes; }
+  // largest readahead window per open file in bytes, 0 disables readahead
+  void setReadaheadSize(size_t bytes) { mReadaheadSize = bytes; }
+  // which disc of a multi disc container to mount, an index or a game id
+  void setDisc(const std::string &disc) { mDisc = disc; }
+  // records every operation to path for trace_replay, empty disables it
+  void setTraceFile(const std::string &path) { mTraceFilePath = path; }
+  // where the image's access profile is kept, empty disables recording and
+  // prefetching it
+  void setProfileFile(const std::string &path) { mProfileFilePath = path; }
+  // where the image's FST index is kept, mounts map it rather than parse
+  // the FST when it's current, empty disables it
+  void setIndexDirectory(const std::string &directory) {
+    mIndexDirectory = directory;
+  }
+  // matches names that only differ in the case of ASCII letters too, when
+  // there isn't an exact match
+  void setIgnoreCase(bool ignoreCase) { mIgnoreCase = ignoreCase; }
+
   bool open(const char *filePath);
+  // Serves an image that's already open, takes ownership of reader
+  bool open(BinaryReader *reader);
 
+  // rare events, formatted on the spot
   void log(const char *format, ...);
+  // per operation records, cheap enough for every read
+  void log(AsyncLog::Op op, const char *text, uint64_t inode = 0,
+           int64_t offset = 0, uint64_t size = 0) {
+    if (mLog) {
+      mLog->record(op, text, inode, offset, size);
+    }
+  }
+  // notes a read of the image for the access profile
+  void recordAccess(uint64_t position, size_t length) {
+    if (mProfile) {
+      mProfile->record(position, length);
+    }
+  }
+  void trace(trace_op op, const char *name, uint64_t inode, uint64_t handle,
+             int64_t offset = 0, uint64_t size = 0) {
+    if (mTrace) {
+      mTrace->record(op, name, inode, handle, offset, size);
+    }
+  }
+
+  // Game ids of the discs in the image at filePath, without opening the FST.
+  // One for plain and compressed images, one per disc of a container.
+  bool readGameIds(const char *filePath, std::vector<std::string> *ids);
+
+  const GamecubeFilesystemTable &getFst() const { return mFst; }
+  // the opened image, for tools that read it directly
+  BinaryReader *getReader() const { return mFile; }
 
   fuse_operations *getFuseOperations() { return &mOperations; }
+  fuse_lowlevel_ops *getFuseLowLevelOperations() {
+    return &mLowLevelOperations;
+  }
 
-private:
+  // The path based handlers. Besides fuse, benchmarks call them directly to
+  // drive the filesystem without a mount.
 #define FUSE_FUNCTION1(type_ret, name, type_one, one)                          \
   static type_ret static_##name(type_one one) {                                \
     return getContext()->name(one);                                            \
@@ -70,6 +195,7 @@ private:
   type_ret name(type_one one, type_two two, type_three three, type_four four,  \
                 type_five five)
 
+  FUSE_FUNCTION1(void *, init, struct fuse_conn_info *, conn);
   FUSE_FUNCTION1(void, destroy, void *, userdata);
   FUSE_FUNCTION2(int, statfs, const char *, path, struct statvfs *, sfs);
   FUSE_FUNCTION3(int, fgetattr, const char *, path, struct stat *, statbuf,
@@ -84,25 +210,104 @@ private:
   FUSE_FUNCTION2(int, release, const char *, path, struct fuse_file_info *, fi);
   FUSE_FUNCTION5(int, read, const char *, path, char *, buf, size_t, size,
                  off_t, offset, struct fuse_file_info *, fi);
+  FUSE_FUNCTION5(int, read_buf, const char *, path, struct fuse_bufvec **,
+                 bufp, size_t, size, off_t, offset, struct fuse_file_info *,
+                 fi);
+
+private:
+
+#define FUSE_LL_FUNCTION1(name, type_one, one)                                 \
+  static void static_##name(fuse_req_t req, type_one one) {                    \
+    getContext(req)->name(req, one);                                           \
+  }                                                                            \
+  void name(fuse_req_t req, type_one one)
+
+#define FUSE_LL_FUNCTION2(name, type_one, one, type_two, two)                  \
+  static void static_##name(fuse_req_t req, type_one one, type_two two) {      \
+    getContext(req)->name(req, one, two);                                      \
+  }                                                                            \
+  void name(fuse_req_t req, type_one one, type_two two)
+
+#define FUSE_LL_FUNCTION4(name, type_one, one, type_two, two, type_three,      \
+                          three, type_four, four)                              \
+  static void static_##name(fuse_req_t req, type_one one, type_two two,        \
+                            type_three three, type_four four) {                \
+    getContext(req)->name(req, one, two, three, four);                         \
+  }                                                                            \
+  void name(fuse_req_t req, type_one one, type_two two, type_three three,      \
+            type_four four)
+
+  static inline GamecubeIsoFilesystem *getContext(fuse_req_t req) {
+    return reinterpret_cast<GamecubeIsoFilesystem *>(fuse_req_userdata(req));
+  }
+
+  static void static_ll_init(void *userdata, struct fuse_conn_info *conn) {
+    reinterpret_cast<GamecubeIsoFilesystem *>(userdata)->init(conn);
+  }
+
+  static void static_ll_destroy(void *userdata) {
+    reinterpret_cast<GamecubeIsoFilesystem *>(userdata)->destroy(userdata);
+  }
+
+  FUSE_LL_FUNCTION2(ll_lookup, fuse_ino_t, parent, const char *, name);
+  FUSE_LL_FUNCTION2(ll_getattr, fuse_ino_t, ino, struct fuse_file_info *, fi);
+  FUSE_LL_FUNCTION2(ll_opendir, fuse_ino_t, ino, struct fuse_file_info *, fi);
+  FUSE_LL_FUNCTION2(ll_releasedir, fuse_ino_t, ino, struct fuse_file_info *,
+                    fi);
+  FUSE_LL_FUNCTION4(ll_readdir, fuse_ino_t, ino, size_t, size, off_t, offset,
+                    struct fuse_file_info *, fi);
+  FUSE_LL_FUNCTION2(ll_open, fuse_ino_t, ino, struct fuse_file_info *, fi);
+  FUSE_LL_FUNCTION2(ll_release, fuse_ino_t, ino, struct fuse_file_info *, fi);
+  FUSE_LL_FUNCTION4(ll_read, fuse_ino_t, ino, size_t, size, off_t, offset,
+                    struct fuse_file_info *, fi);
+  FUSE_LL_FUNCTION1(ll_statfs, fuse_ino_t, ino);
 
   void init_statbuf(struct stat *statbuf, ino_t inode);
+  bool isValidInode(ino_t inode) const;
   ino_t convertPathToInode(const char *path);
+  // strcmp and strncmp, or their case insensitive versions when ignoring case
+  int compareNames(const char *a, const char *b) const;
+  int compareNames(const char *a, const char *b, size_t length) const;
+  bool getExtent(ino_t inode, off_t *block_base, size_t *file_length) const;
+
+  OpenFile *createOpenFile(ino_t inode, off_t block_base, size_t file_length);
+  void destroyOpenFile(struct fuse_file_info *fi);
+  static inline OpenFile *getOpenFile(struct fuse_file_info *fi) {
+    return reinterpret_cast<OpenFile *>(fi->fh);
+  }
+  int readOpenFile(OpenFile *file, void *buf, size_t size, off_t offset,
+                   off_t block_base);
+  OpenFile *createGeneratedFile(ino_t inode);
+  OpenFile *createStatsFile();
+  OpenFile *createVerifyFile();
+  size_t readContents(OpenFile *file, void *buf, size_t size, off_t offset);
 
-  int fgetattr_by_pfe(struct stat *statbuf, gc_dvdfs_file_entry *pfe);
+  int fgetattr_by_pfe(struct stat *statbuf, const gc_dvdfs_file_entry *pfe);
   int fgetattr_by_inode(const char *path, struct stat *statbuf, ino_t inode);
 
-  gc_dvdfs_file_entry *search(gc_dvdfs_file_entry *pfe, const char *name);
+  bool openLog();
+  bool openTrace();
+  void openProfile();
+  bool openFst(BinaryReader *reader);
+  BinaryReader *openReader(const char *filePath);
+  BinaryReader *openFileReader(const char *filePath);
+  ThreadPool *getPool();
+  bool selectDisc(WbfsBinaryReader *reader);
 
-  static int readdir_callback(gc_dvdfs_file_entry *pfe, void *param);
+  static int readdir_callback(const gc_dvdfs_file_entry *pfe, void *param);
+  static int ll_add_direntry(struct ll_readdir_data *data, const char *name,
+                             const struct stat *statbuf, off_t next);
+  static int ll_readdir_callback(const gc_dvdfs_file_entry *pfe, void *param);
 
-  inline ino_t fileEntryToInode(struct gc_dvdfs_file_entry *pfe) const {
+  inline ino_t fileEntryToInode(const struct gc_dvdfs_file_entry *pfe) const {
     return ((reinterpret_cast<uintptr_t>(pfe) -
              reinterpret_cast<uintptr_t>(mFst.getRoot())) /
                 sizeof(struct gc_dvdfs_file_entry) +
             DATA_INO);
   }
 
-  inline struct gc_dvdfs_file_entry *inodeToFileEntry(ino_t inode) const {
+  inline const struct gc_dvdfs_file_entry *
+  inodeToFileEntry(ino_t inode) const {
     return (mFst.getRoot() + inode - DATA_INO);
   }
 };
@@ -0,0 +1,103 @@
+#include <endian.h>
+#include <zlib.h>
+#include <algorithm>
+#include "GczBinaryReader.h"
+
+GczBinaryReader::GczBinaryReader(BinaryReader *reader, ThreadPool *pool,
+                                 size_t cacheSize)
+    : ChunkedBinaryReader(reader, pool, cacheSize), mDataOffset(0),
+      mCompressedSize(0) {}
+
+bool GczBinaryReader::detect(BinaryReader *reader) {
+  uint32_t magic;
+
+  return reader->read(&magic, sizeof(magic), 0) ==
+             static_cast<int>(sizeof(magic)) &&
+         le32toh(magic) == MAGIC;
+}
+
+bool GczBinaryReader::open() {
+  struct gcz_header header;
+
+  if (mReader->read(&header, sizeof(header), 0) !=
+      static_cast<int>(sizeof(header))) {
+    return false;
+  }
+
+  const uint32_t blockSize = le32toh(header.block_size);
+  const uint32_t blocks = le32toh(header.num_blocks);
+  const uint64_t dataSize = le64toh(header.data_size);
+  if (le32toh(header.magic) != MAGIC || blockSize == 0 ||
+      static_cast<uint64_t>(blocks) * blockSize < dataSize) {
+    return false;
+  }
+
+  mPointers.resize(blocks);
+  mHashes.resize(blocks);
+  const size_t pointersSize = blocks * sizeof(uint64_t);
+  const size_t hashesSize = blocks * sizeof(uint32_t);
+  if (mReader->read(mPointers.data(), pointersSize, sizeof(header)) !=
+          static_cast<int>(pointersSize) ||
+      mReader->read(mHashes.data(), hashesSize,
+                    sizeof(header) + pointersSize) !=
+          static_cast<int>(hashesSize)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < blocks; ++i) {
+    mPointers[i] = le64toh(mPointers[i]);
+    mHashes[i] = le32toh(mHashes[i]);
+  }
+
+  mDataOffset = sizeof(header) + pointersSize + hashesSize;
+  mCompressedSize = le64toh(header.compressed_data_size);
+  setGeometry(dataSize, blockSize);
+  return true;
+}
+
+bool GczBinaryReader::decodeChunk(uint64_t index, ChunkCache::Chunk *chunk) {
+  if (index >= mPointers.size()) {
+    return false;
+  }
+
+  // blocks are stored back to back, the next pointer ends this one
+  const uint64_t start = mPointers[index] & ~UNCOMPRESSED_FLAG;
+  const uint64_t end = index + 1 < mPointers.size()
+                           ? mPointers[index + 1] & ~UNCOMPRESSED_FLAG
+                           : mCompressedSize;
+  // deflate never grows a block by more than a few bytes per 16 KiB
+  if (end < start || end - start > 2 * getChunkSize() + 64) {
+    return false;
+  }
+
+  std::vector<unsigned char> stored(end - start);
+  if (mReader->read(stored.data(), stored.size(), mDataOffset + start) !=
+      static_cast<int>(stored.size())) {
+    return false;
+  }
+  if (adler32(1, stored.data(), stored.size()) != mHashes[index]) {
+    return false;
+  }
+
+  const uint64_t offset = index * getChunkSize();
+  const size_t length =
+      std::min<uint64_t>(getChunkSize(), getDataSize() - offset);
+  if (mPointers[index] & UNCOMPRESSED_FLAG) {
+    if (stored.size() < length) {
+      return false;
+    }
+    stored.resize(length);
+    chunk->swap(stored);
+    return true;
+  }
+
+  // the last block may have been compressed with padding past the image end
+  uLongf inflated = getChunkSize();
+  chunk->resize(inflated);
+  if (uncompress(chunk->data(), &inflated, stored.data(), stored.size()) !=
+          Z_OK ||
+      inflated < length) {
+    return false;
+  }
+  chunk->resize(length);
+  return true;
+}
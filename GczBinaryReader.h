@@ -0,0 +1,49 @@
+#ifndef __GCZ_BINARY_READER__H_
+#define __GCZ_BINARY_READER__H_
+
+#include <stdint.h>
+#include <vector>
+#include "ChunkedBinaryReader.h"
+
+// Dolphin's GCZ compressed images. Unlike the disc the header and tables are
+// little endian.
+#pragma pack(1)
+struct gcz_header {
+  uint32_t magic;
+  uint32_t sub_type;
+  uint64_t compressed_data_size;
+  uint64_t data_size;
+  uint32_t block_size;
+  uint32_t num_blocks;
+};
+#pragma pack()
+
+// Reads a GCZ image as the ISO it was compressed from. The block pointer and
+// hash tables are loaded once on open, blocks are inflated on demand.
+class GczBinaryReader : public ChunkedBinaryReader {
+public:
+  static const uint32_t MAGIC = 0xB10BC001;
+
+private:
+  // set in a block pointer when the block is stored uncompressed
+  static const uint64_t UNCOMPRESSED_FLAG = 1ULL << 63;
+
+  std::vector<uint64_t> mPointers;
+  std::vector<uint32_t> mHashes;
+  uint64_t mDataOffset;
+  uint64_t mCompressedSize;
+
+public:
+  GczBinaryReader(BinaryReader *reader, ThreadPool *pool,
+                  size_t cacheSize = DEFAULT_CACHE_SIZE);
+
+  bool open();
+
+  // true if the reader's contents start with the GCZ magic
+  static bool detect(BinaryReader *reader);
+
+protected:
+  virtual bool decodeChunk(uint64_t index, ChunkCache::Chunk *chunk);
+};
+
+#endif
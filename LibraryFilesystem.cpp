@@ -0,0 +1,462 @@
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "LibraryFilesystem.h"
+
+// same date as the images' own files
+static const struct timespec defaultTime = {1006095600, 0};
+
+// The part of path below the image it's in, "/" for the image itself
+static const char *innerPath(const char *path) {
+  const char *const slash = strchr(path + 1, '/');
+  return slash ? slash : "/";
+}
+
+// Game ids become directory names, anything but letters and digits means
+// the header isn't an image's
+static bool isValidGameId(const std::string &id) {
+  if (id.empty()) {
+    return false;
+  }
+  for (const char c : id) {
+    if (!isalnum(static_cast<unsigned char>(c))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static std::string foldName(std::string name) {
+  for (char &c : name) {
+    c = tolower(static_cast<unsigned char>(c));
+  }
+  return name;
+}
+
+LibraryFilesystem::LibraryFilesystem(uid_t uid, gid_t gid, const char *logFile)
+    : mLog(nullptr), mUid(uid), mGid(gid), mLogFilePath(logFile),
+      mReaderType(GamecubeIsoFilesystem::READER_FILE), mReadaheadSize(0),
+      mMaxImages(DEFAULT_MAX_IMAGES), mFstBudget(DEFAULT_FST_BUDGET),
+      mIgnoreCase(false), mScanned(false), mFstBytes(0), mPinnedImages(0) {
+  memset(&mOperations, 0, sizeof(mOperations));
+
+  mOperations.init = static_init;
+  mOperations.destroy = static_destroy;
+  mOperations.statfs = static_statfs;
+  mOperations.fgetattr = static_fgetattr;
+  mOperations.getattr = static_getattr;
+  mOperations.opendir = static_opendir;
+  mOperations.releasedir = static_releasedir;
+  mOperations.readdir = static_readdir;
+  mOperations.open = static_open;
+  mOperations.release = static_release;
+  mOperations.read = static_read;
+  mOperations.read_buf = static_read_buf;
+}
+
+LibraryFilesystem::~LibraryFilesystem() {
+  if (mLog) {
+    delete mLog;
+  }
+}
+
+bool LibraryFilesystem::open(const char *directory) {
+  struct stat statbuf;
+
+  if (mLog == nullptr && !mLogFilePath.empty()) {
+    mLog = new AsyncLog();
+    if (!mLog->open(mLogFilePath.c_str())) {
+      fprintf(stderr, "Unable to open log file %s\n", mLogFilePath.c_str());
+      delete mLog;
+      mLog = nullptr;
+      return false;
+    }
+  }
+
+  if (stat(directory, &statbuf) || !S_ISDIR(statbuf.st_mode)) {
+    log("%s isn't a directory\n", directory);
+    return false;
+  }
+  mDirectory = directory;
+  log("Serving the images in %s\n", directory);
+  return true;
+}
+
+void LibraryFilesystem::log(const char *format, ...) {
+  if (mLog) {
+    va_list ap;
+    va_start(ap, format);
+
+    mLog->message(format, ap);
+    va_end(ap);
+  }
+}
+
+size_t LibraryFilesystem::getOpenImages() {
+  std::lock_guard<std::mutex> guard(mLock);
+  return mLru.size();
+}
+
+size_t LibraryFilesystem::getFstBytes() {
+  std::lock_guard<std::mutex> guard(mLock);
+  return mFstBytes;
+}
+
+// Lists the directory and reads every image's game id, once
+void LibraryFilesystem::scan() {
+  if (mScanned) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mScanLock);
+  if (mScanned) {
+    return;
+  }
+
+  std::vector<std::string> files;
+  if (DIR *const dir = ::opendir(mDirectory.c_str())) {
+    while (const struct dirent *const entry = ::readdir(dir)) {
+      if (entry->d_name[0] != '.') {
+        files.push_back(entry->d_name);
+      }
+    }
+    closedir(dir);
+  }
+  // the same library always gets the same names
+  std::sort(files.begin(), files.end());
+  for (const std::string &file : files) {
+    addImages(mDirectory + "/" + file);
+  }
+
+  log("Found %lu discs in %lu files\n", mImages.size(), files.size());
+  mScanned = true;
+}
+
+void LibraryFilesystem::addImages(const std::string &path) {
+  GamecubeIsoFilesystem probe(mUid, mGid, "");
+  std::vector<std::string> ids;
+  struct stat statbuf;
+
+  if (stat(path.c_str(), &statbuf) || !S_ISREG(statbuf.st_mode)) {
+    return;
+  }
+  probe.setReaderType(mReaderType);
+  if (!probe.readGameIds(path.c_str(), &ids)) {
+    log("%s isn't an image\n", path.c_str());
+    return;
+  }
+
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (!isValidGameId(ids[i])) {
+      log("%s has an invalid game id\n", path.c_str());
+      continue;
+    }
+    // copies and the discs of multi disc games share their game id
+    std::string name = ids[i];
+    for (unsigned int copy = 2; mNames.count(name); ++copy) {
+      name = ids[i] + "-" + std::to_string(copy);
+    }
+
+    Image *const image = new Image();
+    image->name = name;
+    image->path = path;
+    image->disc = ids.size() > 1 ? std::to_string(i) : "";
+    image->memory = 0;
+    image->openFiles = 0;
+    mImages.emplace_back(image);
+    mNames[name] = image;
+    mFoldedNames.emplace(foldName(name), image);
+    log("%s is %s\n", name.c_str(), path.c_str());
+  }
+}
+
+LibraryFilesystem::Image *LibraryFilesystem::findImage(const char *path,
+                                                       const char **inner) {
+  scan();
+
+  const char *const slash = strchr(path + 1, '/');
+  const std::string name =
+      slash ? std::string(path + 1, slash - path - 1) : path + 1;
+  *inner = innerPath(path);
+  auto found = mNames.find(name);
+  if (found != mNames.end()) {
+    return found->second;
+  }
+  if (mIgnoreCase && (found = mFoldedNames.find(foldName(name))) !=
+                         mFoldedNames.end()) {
+    return found->second;
+  }
+  return nullptr;
+}
+
+// Hands out the image's filesystem, opening it first if it isn't
+std::shared_ptr<GamecubeIsoFilesystem>
+LibraryFilesystem::acquire(Image *image) {
+  std::vector<std::shared_ptr<GamecubeIsoFilesystem>> evicted;
+  const auto use = [this, image] {
+    std::lock_guard<std::mutex> guard(mLock);
+    if (image->filesystem) {
+      mLru.splice(mLru.begin(), mLru, image->position);
+    }
+    return image->filesystem;
+  };
+
+  // most of the time it's open already
+  std::shared_ptr<GamecubeIsoFilesystem> filesystem = use();
+  if (filesystem) {
+    return filesystem;
+  }
+  // the first thread to get here opens it, the others wait for it
+  std::lock_guard<std::mutex> loading(image->loadLock);
+  if ((filesystem = use())) {
+    return filesystem;
+  }
+  if (!(filesystem = load(image))) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> guard(mLock);
+  image->filesystem = filesystem;
+  image->memory = filesystem->getFst().getMemoryUsage();
+  mLru.push_front(image);
+  image->position = mLru.begin();
+  mFstBytes += image->memory;
+  evict(&evicted);
+  return filesystem;
+}
+
+bool LibraryFilesystem::pin(Image *image) {
+  std::lock_guard<std::mutex> guard(mLock);
+  if (image->openFiles == 0) {
+    if (mPinnedImages >= mMaxImages) {
+      return false;
+    }
+    ++mPinnedImages;
+  }
+  ++image->openFiles;
+  return true;
+}
+
+void LibraryFilesystem::unpin(Image *image) {
+  std::vector<std::shared_ptr<GamecubeIsoFilesystem>> evicted;
+
+  std::lock_guard<std::mutex> guard(mLock);
+  if (--image->openFiles == 0) {
+    --mPinnedImages;
+  }
+  // it may have been kept past the limits for the file
+  evict(&evicted);
+}
+
+void LibraryFilesystem::evict(
+    std::vector<std::shared_ptr<GamecubeIsoFilesystem>> *evicted) {
+  auto it = mLru.end();
+  while ((mLru.size() > mMaxImages || mFstBytes > mFstBudget) &&
+         it != mLru.begin()) {
+    Image *const image = *--it;
+    // The most recent one was just asked for, only the image limit closes
+    // it, the caller's pointer keeps it open until its operation is done
+    if (image->openFiles > 0 ||
+        (it == mLru.begin() && mLru.size() <= mMaxImages)) {
+      continue;
+    }
+    log("Closing %s\n", image->name.c_str());
+    evicted->push_back(std::move(image->filesystem));
+    image->filesystem.reset();
+    mFstBytes -= image->memory;
+    it = mLru.erase(it);
+  }
+}
+
+std::shared_ptr<GamecubeIsoFilesystem> LibraryFilesystem::load(Image *image) {
+  std::shared_ptr<GamecubeIsoFilesystem> filesystem =
+      std::make_shared<GamecubeIsoFilesystem>(mUid, mGid, "");
+
+  filesystem->setReaderType(mReaderType);
+  filesystem->setReadaheadSize(mReadaheadSize);
+  filesystem->setIndexDirectory(mIndexDirectory);
+  filesystem->setIgnoreCase(mIgnoreCase);
+  filesystem->setDisc(image->disc);
+  if (!filesystem->open(image->path.c_str())) {
+    log("Unable to open %s\n", image->path.c_str());
+    return nullptr;
+  }
+  log("Opened %s, its FST takes %lu bytes\n", image->name.c_str(),
+      filesystem->getFst().getMemoryUsage());
+  return filesystem;
+}
+
+void LibraryFilesystem::init_statbuf(struct stat *statbuf) {
+  memset(statbuf, 0, sizeof(struct stat));
+  statbuf->st_atim = defaultTime;
+  statbuf->st_mtim = defaultTime;
+  statbuf->st_ctim = defaultTime;
+  statbuf->st_mode = S_IFDIR | 0555;
+  statbuf->st_nlink = 2;
+  statbuf->st_uid = mUid;
+  statbuf->st_gid = mGid;
+}
+
+void *LibraryFilesystem::init(struct fuse_conn_info *conn) {
+  // file data can be spliced from the images to the kernel without a copy
+  conn->want |= conn->capable & (FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+  // by now the process has daemonized
+  if (mLog) {
+    mLog->start();
+  }
+  return this;
+}
+
+void LibraryFilesystem::destroy(void *userdata) { delete this; }
+
+// Answers for the library as a whole, without listing it
+int LibraryFilesystem::statfs(const char *path, struct statvfs *sfs) {
+  memset(sfs, 0, sizeof(*sfs));
+  sfs->f_bsize = GC_DVD_SECTOR_SIZE;
+  sfs->f_frsize = 512;
+  sfs->f_files = mScanned ? mImages.size() : 0;
+  sfs->f_namemax = 256;
+  return 0;
+}
+
+int LibraryFilesystem::getattr(const char *path, struct stat *statbuf) {
+  const char *inner;
+
+  if (!strcmp(path, "/")) {
+    init_statbuf(statbuf);
+    return 0;
+  }
+  Image *const image = findImage(path, &inner);
+  if (image == nullptr) {
+    return -ENOENT;
+  }
+  // listing the library mustn't open every image
+  if (!strcmp(inner, "/")) {
+    init_statbuf(statbuf);
+    return 0;
+  }
+  const std::shared_ptr<GamecubeIsoFilesystem> filesystem = acquire(image);
+  return filesystem ? filesystem->getattr(inner, statbuf) : -EIO;
+}
+
+int LibraryFilesystem::fgetattr(const char *path, struct stat *statbuf,
+                                struct fuse_file_info *fi) {
+  OpenFile *const file = getOpenFile(fi);
+  struct fuse_file_info inner = *fi;
+
+  inner.fh = file->fh;
+  return file->filesystem->fgetattr(innerPath(path), statbuf, &inner);
+}
+
+// The library's root is handle 0, directories of images keep the handle
+// their image gave them, it stays valid across the image being reopened
+int LibraryFilesystem::opendir(const char *path, struct fuse_file_info *fi) {
+  const char *inner;
+
+  if (!strcmp(path, "/")) {
+    fi->fh = 0;
+    return 0;
+  }
+  Image *const image = findImage(path, &inner);
+  if (image == nullptr) {
+    return -ENOENT;
+  }
+  const std::shared_ptr<GamecubeIsoFilesystem> filesystem = acquire(image);
+  return filesystem ? filesystem->opendir(inner, fi) : -EIO;
+}
+
+int LibraryFilesystem::releasedir(const char *path,
+                                  struct fuse_file_info *fi) {
+  return 0;
+}
+
+int LibraryFilesystem::readdir(const char *path, void *buf,
+                               fuse_fill_dir_t filler, off_t offset,
+                               struct fuse_file_info *fi) {
+  const char *inner;
+
+  if (!strcmp(path, "/")) {
+    struct stat statbuf;
+
+    scan();
+    init_statbuf(&statbuf);
+    // like an image's root, an entry's offset is its position plus one
+    for (size_t i = offset < 0 ? mImages.size() : offset; i < mImages.size();
+         ++i) {
+      if (filler(buf, mImages[i]->name.c_str(), &statbuf, i + 1)) {
+        break;
+      }
+    }
+    return 0;
+  }
+  Image *const image = findImage(path, &inner);
+  if (image == nullptr) {
+    return -ENOENT;
+  }
+  const std::shared_ptr<GamecubeIsoFilesystem> filesystem = acquire(image);
+  return filesystem ? filesystem->readdir(inner, buf, filler, offset, fi)
+                    : -EIO;
+}
+
+int LibraryFilesystem::open(const char *path, struct fuse_file_info *fi) {
+  const char *inner;
+
+  Image *const image = findImage(path, &inner);
+  if (image == nullptr || !strcmp(inner, "/")) {
+    return -ENOENT;
+  }
+  // as many images as may be open at once have files open already
+  if (!pin(image)) {
+    return -EMFILE;
+  }
+  const std::shared_ptr<GamecubeIsoFilesystem> filesystem = acquire(image);
+  if (!filesystem) {
+    unpin(image);
+    return -EIO;
+  }
+
+  struct fuse_file_info opened = *fi;
+  if (const int i = filesystem->open(inner, &opened)) {
+    unpin(image);
+    return i;
+  }
+  // the image decides on direct I/O and caching, only the handle is ours
+  *fi = opened;
+  fi->fh = reinterpret_cast<uint64_t>(
+      new OpenFile{image, filesystem, opened.fh});
+  return 0;
+}
+
+int LibraryFilesystem::release(const char *path, struct fuse_file_info *fi) {
+  OpenFile *const file = getOpenFile(fi);
+  struct fuse_file_info inner = *fi;
+
+  inner.fh = file->fh;
+  file->filesystem->release(innerPath(path), &inner);
+  unpin(file->image);
+  delete file;
+  return 0;
+}
+
+int LibraryFilesystem::read(const char *path, char *buf, size_t size,
+                            off_t offset, struct fuse_file_info *fi) {
+  OpenFile *const file = getOpenFile(fi);
+  struct fuse_file_info inner = *fi;
+
+  inner.fh = file->fh;
+  return file->filesystem->read(innerPath(path), buf, size, offset, &inner);
+}
+
+int LibraryFilesystem::read_buf(const char *path, struct fuse_bufvec **bufp,
+                                size_t size, off_t offset,
+                                struct fuse_file_info *fi) {
+  OpenFile *const file = getOpenFile(fi);
+  struct fuse_file_info inner = *fi;
+
+  inner.fh = file->fh;
+  return file->filesystem->read_buf(innerPath(path), bufp, size, offset,
+                                    &inner);
+}
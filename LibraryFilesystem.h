@@ -0,0 +1,162 @@
+#ifndef __LIBRARY_FILESYSTEM__H_
+#define __LIBRARY_FILESYSTEM__H_
+
+#include <sys/types.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AsyncLog.h"
+#include "GamecubeIsoFilesystem.h"
+
+// Serves a directory of images as one mount, every disc as a directory
+// named after its game id holding what a single image mount has at its
+// root, /GALE01/data/... for example.
+//
+// Mounting costs the same however big the library is. The directory is
+// only listed, and the game id of every image read, by the first access.
+// Images are opened and their FST parsed when something inside them is
+// first touched, each by a GamecubeIsoFilesystem of its own. The least
+// recently used ones are closed again to keep at most a given number of
+// images open, one reader and descriptor each, and their FSTs within a
+// memory budget. Images with open files stay until they're closed, and
+// opening a file fails with EMFILE when as many images as may be open
+// have files open already, so the limit holds for them too. Images are
+// handed out as shared pointers, so one being evicted while an operation
+// is still in it is harmless, it's closed when the operation is done.
+class LibraryFilesystem {
+public:
+  static const unsigned int DEFAULT_MAX_IMAGES = 64;
+  static const size_t DEFAULT_FST_BUDGET = 256 * 1024 * 1024;
+
+private:
+  struct Image {
+    std::string name; // directory it's served as
+    std::string path;
+    std::string disc; // of a container, empty otherwise
+    std::mutex loadLock; // held while the image is being opened
+    // below are guarded by mLock
+    std::shared_ptr<GamecubeIsoFilesystem> filesystem; // null when closed
+    std::list<Image *>::iterator position;             // in mLru when open
+    size_t memory;          // held by its FST
+    unsigned int openFiles; // keep it from being evicted
+  };
+
+  // per open file state, what fi->fh points at for files
+  struct OpenFile {
+    Image *image;
+    std::shared_ptr<GamecubeIsoFilesystem> filesystem;
+    uint64_t fh; // the image's own handle
+  };
+
+  static inline LibraryFilesystem *getContext() {
+    return reinterpret_cast<LibraryFilesystem *>(
+        fuse_get_context()->private_data);
+  }
+
+  fuse_operations mOperations;
+  AsyncLog *mLog;
+  uid_t mUid;
+  gid_t mGid;
+  std::string mLogFilePath;
+  std::string mDirectory;
+  GamecubeIsoFilesystem::ReaderType mReaderType;
+  size_t mReadaheadSize;
+  std::string mIndexDirectory;
+  unsigned int mMaxImages;
+  size_t mFstBudget;
+  bool mIgnoreCase;
+
+  std::mutex mScanLock;
+  std::atomic<bool> mScanned;
+  // only written by the scan, read only afterwards
+  std::vector<std::unique_ptr<Image>> mImages;
+  std::unordered_map<std::string, Image *> mNames;
+  // names in lower case for setIgnoreCase, the first image of each
+  std::unordered_map<std::string, Image *> mFoldedNames;
+
+  std::mutex mLock;
+  std::list<Image *> mLru; // open images, front is most recent
+  size_t mFstBytes;
+  unsigned int mPinnedImages; // those with open files
+
+public:
+  LibraryFilesystem(uid_t uid, gid_t gid, const char *logFile);
+  ~LibraryFilesystem();
+
+  void setReaderType(GamecubeIsoFilesystem::ReaderType type) {
+    mReaderType = type;
+  }
+  // largest readahead window per open file in bytes, 0 disables readahead
+  void setReadaheadSize(size_t bytes) { mReadaheadSize = bytes; }
+  // where the images' FST indexes are kept, empty disables them
+  void setIndexDirectory(const std::string &directory) {
+    mIndexDirectory = directory;
+  }
+  // images kept open at once, those with open files included
+  void setMaxImages(unsigned int images) { mMaxImages = images; }
+  // bytes the FSTs of open images may take, besides those with open files
+  void setFstBudget(size_t bytes) { mFstBudget = bytes; }
+  // game ids and names within the images match in any case too
+  void setIgnoreCase(bool ignoreCase) { mIgnoreCase = ignoreCase; }
+
+  // only checks directory is one, the images are found by the first access
+  bool open(const char *directory);
+
+  void log(const char *format, ...);
+
+  // how many images are open and the memory their FSTs take
+  size_t getOpenImages();
+  size_t getFstBytes();
+
+  fuse_operations *getFuseOperations() { return &mOperations; }
+
+  // The path based handlers, the same ones GamecubeIsoFilesystem has
+  FUSE_FUNCTION1(void *, init, struct fuse_conn_info *, conn);
+  FUSE_FUNCTION1(void, destroy, void *, userdata);
+  FUSE_FUNCTION2(int, statfs, const char *, path, struct statvfs *, sfs);
+  FUSE_FUNCTION3(int, fgetattr, const char *, path, struct stat *, statbuf,
+                 struct fuse_file_info *, fi);
+  FUSE_FUNCTION2(int, getattr, const char *, path, struct stat *, statbuf);
+  FUSE_FUNCTION2(int, opendir, const char *, path, struct fuse_file_info *, fi);
+  FUSE_FUNCTION2(int, releasedir, const char *, path, struct fuse_file_info *,
+                 fi);
+  FUSE_FUNCTION5(int, readdir, const char *, path, void *, buf, fuse_fill_dir_t,
+                 filler, off_t, offset, struct fuse_file_info *, fi);
+  FUSE_FUNCTION2(int, open, const char *, path, struct fuse_file_info *, fi);
+  FUSE_FUNCTION2(int, release, const char *, path, struct fuse_file_info *, fi);
+  FUSE_FUNCTION5(int, read, const char *, path, char *, buf, size_t, size,
+                 off_t, offset, struct fuse_file_info *, fi);
+  FUSE_FUNCTION5(int, read_buf, const char *, path, struct fuse_bufvec **,
+                 bufp, size_t, size, off_t, offset, struct fuse_file_info *,
+                 fi);
+
+private:
+  void scan();
+  void addImages(const std::string &file);
+  // Splits path into the image it's in and the path within it, which is
+  // "/" for the image's own directory. Returns null for the root and
+  // paths that aren't in any image.
+  Image *findImage(const char *path, const char **inner);
+
+  std::shared_ptr<GamecubeIsoFilesystem> acquire(Image *image);
+  // counts an open file against the image, false when that would keep more
+  // images open than the limit
+  bool pin(Image *image);
+  void unpin(Image *image);
+  // closes the least recently used images over the limits, returns them to
+  // be destroyed outside the lock
+  void evict(std::vector<std::shared_ptr<GamecubeIsoFilesystem>> *evicted);
+  std::shared_ptr<GamecubeIsoFilesystem> load(Image *image);
+
+  void init_statbuf(struct stat *statbuf);
+
+  static inline OpenFile *getOpenFile(struct fuse_file_info *fi) {
+    return reinterpret_cast<OpenFile *>(fi->fh);
+  }
+};
+
+#endif
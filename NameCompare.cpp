@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <string.h>
+#include "NameCompare.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NAME_COMPARE_SIMD 1
+#endif
+
+namespace {
+
+bool equal_scalar(const char *a, const char *b, size_t length, bool fold) {
+  if (!fold) {
+    return memcmp(a, b, length) == 0;
+  }
+  for (size_t i = 0; i < length; ++i) {
+    if (fold_name_char(a[i]) != fold_name_char(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#ifdef NAME_COMPARE_SIMD
+// 'A' to 'Z' ORed with 0x20, bytes from 0x80 up are negative and never
+// in range
+__attribute__((target("sse4.2"))) inline __m128i fold128(__m128i v) {
+  const __m128i upper =
+      _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+  return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) inline __m256i fold256(__m256i v) {
+  const __m256i upper =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+  return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+// a 16 byte load that stays within one page can't fault, even where it goes
+// past the end of a name
+inline bool can_load16(const char *p) {
+  return (reinterpret_cast<uintptr_t>(p) & 4095) <= 4096 - 16;
+}
+
+// PCMPESTRI takes the lengths explicitly, so the bytes of a short tail
+// after length are never compared and can be anything. Loading them is
+// deliberate, so the sanitizer is told not to mind.
+__attribute__((target("sse4.2"), no_sanitize("address"))) bool
+equal_sse42(const char *a, const char *b, size_t length, bool fold) {
+  const int mode =
+      _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY;
+
+  while (length > 0) {
+    const int chunk = length < 16 ? length : 16;
+    __m128i va;
+    __m128i vb;
+    if (chunk == 16 || (can_load16(a) && can_load16(b))) {
+      va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+      vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b));
+    } else {
+      // names can end right at the end of a mapping, don't load past it
+      char ta[16];
+      char tb[16];
+      memcpy(ta, a, chunk);
+      memcpy(tb, b, chunk);
+      va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ta));
+      vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tb));
+    }
+    if (fold) {
+      va = fold128(va);
+      vb = fold128(vb);
+    }
+    if (_mm_cmpestri(va, chunk, vb, chunk, mode) != 16) {
+      return false;
+    }
+    a += chunk;
+    b += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+__attribute__((target("avx2,sse4.2"))) bool
+equal_avx2(const char *a, const char *b, size_t length, bool fold) {
+  while (length >= 32) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b));
+    if (fold) {
+      va = fold256(va);
+      vb = fold256(vb);
+    }
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != -1) {
+      return false;
+    }
+    a += 32;
+    b += 32;
+    length -= 32;
+  }
+  return equal_sse42(a, b, length, fold);
+}
+
+enum Kernel { KERNEL_SCALAR, KERNEL_SSE42, KERNEL_AVX2 };
+
+// static initializers may run before the runtime's own CPU detection
+Kernel detect() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2")) {
+    return KERNEL_AVX2;
+  }
+  return __builtin_cpu_supports("sse4.2") ? KERNEL_SSE42 : KERNEL_SCALAR;
+}
+
+const Kernel kernel = detect();
+#endif
+
+inline bool equal(const char *a, const char *b, size_t length, bool fold) {
+#ifdef NAME_COMPARE_SIMD
+  switch (kernel) {
+  case KERNEL_AVX2:
+    return equal_avx2(a, b, length, fold);
+  case KERNEL_SSE42:
+    return equal_sse42(a, b, length, fold);
+  case KERNEL_SCALAR:
+    break;
+  }
+#endif
+  return equal_scalar(a, b, length, fold);
+}
+
+} // namespace
+
+bool names_equal(const char *a, const char *b, size_t length) {
+  return equal(a, b, length, false);
+}
+
+bool names_equal_ignoring_case(const char *a, const char *b, size_t length) {
+  return equal(a, b, length, true);
+}
+
+const char *names_kernel() {
+#ifdef NAME_COMPARE_SIMD
+  switch (kernel) {
+  case KERNEL_AVX2:
+    return "avx2";
+  case KERNEL_SSE42:
+    return "sse4.2";
+  case KERNEL_SCALAR:
+    break;
+  }
+#endif
+  return "scalar";
+}
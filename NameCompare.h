@@ -0,0 +1,26 @@
+#ifndef __NAME_COMPARE__H_
+#define __NAME_COMPARE__H_
+
+#include <stddef.h>
+
+// Compares names of a known length, what a directory search does for every
+// candidate. On x86 processors with AVX2 or SSE4.2 names are compared 32 or
+// 16 bytes at a time, folding case in the same registers, otherwise a byte
+// at a time. Bytes past length are never compared, but the SSE4.2 path
+// loads a short tail 16 bytes at a time when that stays within one page,
+// so it may read up to 15 bytes past the end of either name.
+bool names_equal(const char *a, const char *b, size_t length);
+
+// The same ignoring case. Only bytes of ASCII letters are folded, those in
+// multibyte Shift JIS characters too, every other byte has to match.
+bool names_equal_ignoring_case(const char *a, const char *b, size_t length);
+
+// what names_equal_ignoring_case compares c as
+inline unsigned char fold_name_char(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+// the instruction set the comparisons run on, "avx2", "sse4.2" or "scalar"
+const char *names_kernel();
+
+#endif
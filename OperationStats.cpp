@@ -0,0 +1,153 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "OperationStats.h"
+
+namespace {
+
+const char *const operation_names[OperationStats::STAT_COUNT] = {
+    "lookup", "getattr", "readdir", "open", "read"};
+
+void appendf(std::string *out, const char *format, ...) {
+  char line[256];
+  va_list ap;
+
+  va_start(ap, format);
+  const int length = vsnprintf(line, sizeof(line), format, ap);
+  va_end(ap);
+  if (length > 0) {
+    out->append(line, std::min<size_t>(length, sizeof(line) - 1));
+  }
+}
+
+template <typename T> void add(std::atomic<T> &counter, T value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+} // namespace
+
+uint64_t OperationStats::now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+const char *OperationStats::getName(Operation operation) {
+  return operation_names[operation];
+}
+
+unsigned int OperationStats::getBucket(uint64_t nanoseconds) {
+  if (nanoseconds < (1ULL << MIN_SHIFT)) {
+    return 0;
+  }
+  if (nanoseconds >= (1ULL << MAX_SHIFT)) {
+    return BUCKETS - 1;
+  }
+  // the power of two picks the octave, the bits after it the sub-bucket
+  const unsigned int shift = 63 - __builtin_clzll(nanoseconds);
+  const unsigned int sub =
+      (nanoseconds >> (shift - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return 1 + (shift - MIN_SHIFT) * SUB_BUCKETS + sub;
+}
+
+uint64_t OperationStats::getBucketLimit(unsigned int bucket) {
+  if (bucket == 0) {
+    return 1ULL << MIN_SHIFT;
+  }
+  const unsigned int shift = MIN_SHIFT + (bucket - 1) / SUB_BUCKETS;
+  const unsigned int sub = (bucket - 1) % SUB_BUCKETS;
+  return (1ULL << shift) +
+         (static_cast<uint64_t>(sub + 1) << (shift - SUB_BUCKET_BITS));
+}
+
+OperationStats::Shard *OperationStats::getShard() {
+  return mShards.get([](size_t) {
+    Shard *const shard = new Shard();
+    for (Counters &counters : shard->operations) {
+      counters.count = 0;
+      counters.nanoseconds = 0;
+      counters.bytes = 0;
+      for (std::atomic<uint64_t> &bucket : counters.buckets) {
+        bucket = 0;
+      }
+    }
+    return shard;
+  });
+}
+
+void OperationStats::record(Operation operation, uint64_t nanoseconds,
+                            uint64_t bytes) {
+  Counters &counters = getShard()->operations[operation];
+
+  add<uint64_t>(counters.count, 1);
+  add(counters.nanoseconds, nanoseconds);
+  add(counters.bytes, bytes);
+  add<uint64_t>(counters.buckets[getBucket(nanoseconds)], 1);
+}
+
+void OperationStats::getTotals(Operation operation, Totals *totals) {
+  memset(totals, 0, sizeof(*totals));
+
+  for (const Shard *shard : mShards.getAll()) {
+    const Counters &counters = shard->operations[operation];
+    totals->count += counters.count.load(std::memory_order_relaxed);
+    totals->nanoseconds +=
+        counters.nanoseconds.load(std::memory_order_relaxed);
+    totals->bytes += counters.bytes.load(std::memory_order_relaxed);
+    for (unsigned int i = 0; i < BUCKETS; ++i) {
+      totals->buckets[i] +=
+          counters.buckets[i].load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void OperationStats::writePrometheus(std::string *out) {
+  Totals totals[STAT_COUNT];
+
+  for (unsigned int i = 0; i < STAT_COUNT; ++i) {
+    getTotals(static_cast<Operation>(i), &totals[i]);
+  }
+
+  out->append("# HELP gcdvdfs_operations_total Operations served.\n"
+              "# TYPE gcdvdfs_operations_total counter\n");
+  for (unsigned int i = 0; i < STAT_COUNT; ++i) {
+    appendf(out, "gcdvdfs_operations_total{op=\"%s\"} %llu\n",
+            operation_names[i],
+            static_cast<unsigned long long>(totals[i].count));
+  }
+
+  out->append("# HELP gcdvdfs_read_bytes_total Bytes of file data served.\n"
+              "# TYPE gcdvdfs_read_bytes_total counter\n");
+  appendf(out, "gcdvdfs_read_bytes_total %llu\n",
+          static_cast<unsigned long long>(totals[STAT_READ].bytes));
+
+  out->append("# HELP gcdvdfs_operation_duration_seconds Time spent in the "
+              "filesystem per operation.\n"
+              "# TYPE gcdvdfs_operation_duration_seconds histogram\n");
+  for (unsigned int i = 0; i < STAT_COUNT; ++i) {
+    // Prometheus buckets count everything up to their limit
+    uint64_t cumulative = 0;
+    for (unsigned int bucket = 0; bucket < BUCKETS - 1; ++bucket) {
+      cumulative += totals[i].buckets[bucket];
+      appendf(out,
+              "gcdvdfs_operation_duration_seconds_bucket{op=\"%s\","
+              "le=\"%.9g\"} %llu\n",
+              operation_names[i], getBucketLimit(bucket) / 1e9,
+              static_cast<unsigned long long>(cumulative));
+    }
+    appendf(out,
+            "gcdvdfs_operation_duration_seconds_bucket{op=\"%s\","
+            "le=\"+Inf\"} %llu\n",
+            operation_names[i],
+            static_cast<unsigned long long>(totals[i].count));
+    appendf(out, "gcdvdfs_operation_duration_seconds_sum{op=\"%s\"} %.9f\n",
+            operation_names[i], totals[i].nanoseconds / 1e9);
+    appendf(out, "gcdvdfs_operation_duration_seconds_count{op=\"%s\"} %llu\n",
+            operation_names[i],
+            static_cast<unsigned long long>(totals[i].count));
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef __OPERATION_STATS__H_
+#define __OPERATION_STATS__H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include "PerThread.h"
+
+// Counters and latency histograms per filesystem operation. Every thread
+// updates a shard of its own without locks or shared cache lines, shards
+// are only summed up when somebody asks for them.
+//
+// Latencies go into log-linear buckets like an HDR histogram: every power
+// of two from MIN_SHIFT to MAX_SHIFT nanoseconds is split into SUB_BUCKETS
+// equal parts, so the relative error stays under 25% from a hundred
+// nanoseconds to seconds with a fixed, small number of buckets.
+class OperationStats {
+public:
+  enum Operation {
+    STAT_LOOKUP, // resolving a name or path to an inode
+    STAT_GETATTR,
+    STAT_READDIR,
+    STAT_OPEN,
+    STAT_READ,
+    STAT_COUNT
+  };
+
+  static const unsigned int SUB_BUCKET_BITS = 2;
+  static const unsigned int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const unsigned int MIN_SHIFT = 7;  // 128 ns
+  static const unsigned int MAX_SHIFT = 34; // ~17 s
+  // everything under 2^MIN_SHIFT, the log-linear buckets, then everything
+  // from 2^MAX_SHIFT on
+  static const unsigned int BUCKETS =
+      1 + (MAX_SHIFT - MIN_SHIFT) * SUB_BUCKETS + 1;
+
+  // Times one operation from construction to destruction
+  class Timer {
+  private:
+    OperationStats *mStats;
+    Operation mOperation;
+    uint64_t mStart;
+    uint64_t mBytes;
+
+  public:
+    Timer(OperationStats *stats, Operation operation)
+        : mStats(stats), mOperation(operation), mStart(now()), mBytes(0) {}
+    ~Timer() { mStats->record(mOperation, now() - mStart, mBytes); }
+
+    // bytes served by the operation
+    void setBytes(uint64_t bytes) { mBytes = bytes; }
+  };
+
+  struct Totals {
+    uint64_t count;
+    uint64_t nanoseconds;
+    uint64_t bytes;
+    uint64_t buckets[BUCKETS];
+  };
+
+private:
+  // only the owning thread writes, so plain loads and stores suffice
+  struct Counters {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> nanoseconds;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> buckets[BUCKETS];
+  };
+
+  struct Shard {
+    Counters operations[STAT_COUNT];
+  };
+
+  PerThread<Shard> mShards;
+
+public:
+
+  void record(Operation operation, uint64_t nanoseconds, uint64_t bytes);
+
+  // sums up every thread's shard
+  void getTotals(Operation operation, Totals *totals);
+
+  // appends every operation's counters and histogram in the Prometheus text
+  // exposition format
+  void writePrometheus(std::string *out);
+
+  static const char *getName(Operation operation);
+  static unsigned int getBucket(uint64_t nanoseconds);
+  // smallest latency that no longer falls into the bucket
+  static uint64_t getBucketLimit(unsigned int bucket);
+  static uint64_t now();
+
+private:
+  Shard *getShard();
+};
+
+#endif
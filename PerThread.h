@@ -0,0 +1,75 @@
+#ifndef __PER_THREAD__H_
+#define __PER_THREAD__H_
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// One T per thread that uses it, for state a thread updates without locks
+// and others only look at now and then. A thread finds its own through a
+// thread local cache, so only its first call, or switching between owners,
+// takes the lock. A thread that exits leaves its T behind and a new thread
+// given the same id carries on with it, so every T only ever has one
+// thread writing it. The Ts live until the PerThread is destroyed.
+template <typename T> class PerThread {
+private:
+  struct Cached {
+    uint64_t owner;
+    T *slot;
+  };
+
+  // tells owners apart in the cache without a lookup
+  static std::atomic<uint64_t> sNextId;
+  static thread_local Cached sCached;
+
+  const uint64_t mId;
+  std::mutex mLock;
+  std::unordered_map<std::thread::id, T *> mByThread;
+  std::vector<T *> mSlots;
+
+public:
+  PerThread() : mId(sNextId++) {}
+  ~PerThread() {
+    for (T *slot : mSlots) {
+      delete slot;
+    }
+  }
+
+  PerThread(const PerThread &) = delete;
+  PerThread &operator=(const PerThread &) = delete;
+
+  // The calling thread's T, made by create(index) on the thread's first
+  // call, index counting up from 0 in the order threads showed up
+  template <typename Create> T *get(Create create) {
+    if (sCached.owner == mId) {
+      return sCached.slot;
+    }
+
+    std::lock_guard<std::mutex> guard(mLock);
+    T *&slot = mByThread[std::this_thread::get_id()];
+    if (slot == nullptr) {
+      slot = create(mSlots.size());
+      mSlots.push_back(slot);
+    }
+    sCached.owner = mId;
+    sCached.slot = slot;
+    return slot;
+  }
+
+  // every thread's T so far
+  std::vector<T *> getAll() {
+    std::lock_guard<std::mutex> guard(mLock);
+    return mSlots;
+  }
+};
+
+template <typename T> std::atomic<uint64_t> PerThread<T>::sNextId(1);
+
+template <typename T>
+thread_local typename PerThread<T>::Cached PerThread<T>::sCached = {0,
+                                                                   nullptr};
+
+#endif
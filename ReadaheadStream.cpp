@@ -0,0 +1,141 @@
+#include <string.h>
+#include <algorithm>
+#include "ReadaheadStream.h"
+
+const size_t ReadaheadStream::MIN_WINDOW;
+const size_t ReadaheadStream::CHUNK_SIZE;
+
+ReadaheadStream::ReadaheadStream(BinaryReader *reader, ThreadPool *pool,
+                                 size_t base, size_t length, size_t maxWindow)
+    : mReader(reader), mPool(pool), mBase(base), mLength(length),
+      mMaxWindow(std::max(maxWindow, MIN_WINDOW)), mPending(0),
+      mNextOffset(0), mPrefetchEnd(0), mWindow(MIN_WINDOW) {}
+
+ReadaheadStream::~ReadaheadStream() {
+  std::unique_lock<std::mutex> guard(mLock);
+  mDone.wait(guard, [this] { return mPending == 0; });
+}
+
+int ReadaheadStream::read(void *buf, size_t size, size_t offset) {
+  unsigned char *const out = reinterpret_cast<unsigned char *>(buf);
+
+  if (offset >= mLength) {
+    return 0;
+  }
+  size = std::min(size, mLength - offset);
+
+  std::unique_lock<std::mutex> guard(mLock);
+  // reads that land inside what's already prefetched still count as
+  // sequential, concurrent FUSE threads can deliver them slightly out of order
+  const bool prefetched = !mSegments.empty() &&
+                          offset >= mSegments.front()->offset &&
+                          offset < mPrefetchEnd;
+  const bool sequential = offset == mNextOffset || prefetched;
+
+  if (!sequential) {
+    // a seek, whatever is in flight finishes but is thrown away
+    mSegments.clear();
+    mWindow = MIN_WINDOW;
+    mPrefetchEnd = offset;
+  }
+  while (!mSegments.empty() &&
+         mSegments.front()->offset + mSegments.front()->length <= offset) {
+    mSegments.pop_front();
+  }
+
+  int done = copyFromSegments(guard, out, size, offset);
+  if (done < 0) {
+    return done;
+  }
+  if (static_cast<size_t>(done) == size) {
+    // served entirely from memory, open the window up
+    mWindow = std::min(mWindow * 2, mMaxWindow);
+  } else {
+    guard.unlock();
+    const int read =
+        mReader->read(out + done, size - done, mBase + offset + done);
+    guard.lock();
+    if (read < 0) {
+      return done > 0 ? done : read;
+    }
+    done += read;
+  }
+
+  mNextOffset = offset + done;
+  mPrefetchEnd = std::max(mPrefetchEnd, mNextOffset);
+  if (sequential) {
+    prefetch(mNextOffset + mWindow);
+  }
+  return done;
+}
+
+// Copies whatever prefetched segments cover starting at offset, waiting for
+// any that are still being read. Returns the bytes copied.
+int ReadaheadStream::copyFromSegments(std::unique_lock<std::mutex> &guard,
+                                      unsigned char *out, size_t size,
+                                      size_t offset) {
+  size_t done = 0;
+
+  while (done < size) {
+    const size_t position = offset + done;
+    std::shared_ptr<Segment> segment;
+    for (const std::shared_ptr<Segment> &candidate : mSegments) {
+      if (candidate->offset <= position &&
+          position < candidate->offset + candidate->length) {
+        segment = candidate;
+        break;
+      }
+    }
+    if (!segment) {
+      break;
+    }
+
+    // the segment stays alive through our reference even if a seek on
+    // another thread drops it while we wait
+    mDone.wait(guard, [&segment] { return segment->done; });
+    if (segment->result < 0) {
+      return done > 0 ? static_cast<int>(done) : segment->result;
+    }
+
+    const size_t within = position - segment->offset;
+    if (within >= static_cast<size_t>(segment->result)) {
+      // short read, let the caller read the rest directly
+      break;
+    }
+    const size_t length =
+        std::min(size - done, static_cast<size_t>(segment->result) - within);
+    memcpy(out + done, segment->data.data() + within, length);
+    done += length;
+  }
+  return done;
+}
+
+// Queues chunks until everything up to upTo is prefetched or in flight
+void ReadaheadStream::prefetch(size_t upTo) {
+  upTo = std::min(upTo, mLength);
+
+  while (mPrefetchEnd < upTo) {
+    std::shared_ptr<Segment> segment(new Segment());
+    segment->offset = mPrefetchEnd;
+    segment->length = std::min(CHUNK_SIZE, mLength - mPrefetchEnd);
+    segment->data.resize(segment->length);
+    segment->result = 0;
+    segment->done = false;
+
+    mSegments.push_back(segment);
+    mPrefetchEnd += segment->length;
+    ++mPending;
+    mPool->submit([this, segment] { fill(segment); });
+  }
+}
+
+void ReadaheadStream::fill(const std::shared_ptr<Segment> &segment) {
+  const int read = mReader->read(segment->data.data(), segment->length,
+                                 mBase + segment->offset);
+
+  std::lock_guard<std::mutex> guard(mLock);
+  segment->result = read;
+  segment->done = true;
+  --mPending;
+  mDone.notify_all();
+}
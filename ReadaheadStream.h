@@ -0,0 +1,62 @@
+#ifndef __READAHEAD_STREAM__H_
+#define __READAHEAD_STREAM__H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BinaryReader.h"
+#include "ThreadPool.h"
+
+// Sequential readahead for one open file, a single extent of the image.
+// While reads keep following on from each other the stream keeps a window
+// of data ahead of the reader in flight on the thread pool, doubling the
+// window on every sequential read up to a maximum. A seek drops whatever was
+// prefetched and shrinks the window back to its minimum.
+class ReadaheadStream {
+public:
+  static const size_t MIN_WINDOW = 256 * 1024;
+  static const size_t CHUNK_SIZE = 256 * 1024;
+
+private:
+  struct Segment {
+    size_t offset; // within the file
+    size_t length;
+    std::vector<unsigned char> data;
+    int result; // bytes read, or negative on error
+    bool done;
+  };
+
+  BinaryReader *mReader;
+  ThreadPool *mPool;
+  const size_t mBase;
+  const size_t mLength;
+  const size_t mMaxWindow;
+
+  std::mutex mLock;
+  std::condition_variable mDone;
+  std::deque<std::shared_ptr<Segment>> mSegments;
+  unsigned int mPending;
+  size_t mNextOffset;
+  size_t mPrefetchEnd;
+  size_t mWindow;
+
+public:
+  ReadaheadStream(BinaryReader *reader, ThreadPool *pool, size_t base,
+                  size_t length, size_t maxWindow);
+  // waits for any readahead still in flight
+  ~ReadaheadStream();
+
+  // reads size bytes at offset within the file
+  int read(void *buf, size_t size, size_t offset);
+
+private:
+  int copyFromSegments(std::unique_lock<std::mutex> &guard,
+                       unsigned char *out, size_t size, size_t offset);
+  void prefetch(size_t upTo);
+  void fill(const std::shared_ptr<Segment> &segment);
+};
+
+#endif
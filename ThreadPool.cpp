@@ -0,0 +1,50 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threads)
+    : mSize(threads), mStopping(false) {}
+
+ThreadPool::~ThreadPool() { stop(); }
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> guard(mLock);
+    mTasks.push_back(std::move(task));
+    if (mThreads.empty()) {
+      for (unsigned int i = 0; i < mSize; ++i) {
+        mThreads.emplace_back(&ThreadPool::run, this);
+      }
+    }
+  }
+  mWork.notify_one();
+}
+
+void ThreadPool::stop() {
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> guard(mLock);
+    mStopping = true;
+    threads.swap(mThreads);
+  }
+  mWork.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  std::lock_guard<std::mutex> guard(mLock);
+  mStopping = false;
+}
+
+void ThreadPool::run() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> guard(mLock);
+      mWork.wait(guard, [this] { return mStopping || !mTasks.empty(); });
+      if (mTasks.empty()) {
+        return;
+      }
+      task = std::move(mTasks.front());
+      mTasks.pop_front();
+    }
+    task();
+  }
+}
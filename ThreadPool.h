@@ -0,0 +1,40 @@
+#ifndef __THREAD_POOL__H_
+#define __THREAD_POOL__H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running queued tasks in submission order. The
+// workers are started by the first submit, so a pool can be created before
+// the process daemonizes as long as nothing was submitted yet, or it was
+// stopped since.
+class ThreadPool {
+private:
+  const unsigned int mSize;
+  std::mutex mLock;
+  std::condition_variable mWork;
+  std::deque<std::function<void()>> mTasks;
+  std::vector<std::thread> mThreads;
+  bool mStopping;
+
+public:
+  explicit ThreadPool(unsigned int threads);
+  // runs everything already queued, then joins the workers
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+  // runs everything already queued and joins the workers, the next submit
+  // starts them again
+  void stop();
+
+  unsigned int size() const { return mSize; }
+
+private:
+  void run();
+};
+
+#endif
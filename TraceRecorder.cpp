@@ -0,0 +1,93 @@
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "TraceRecorder.h"
+
+namespace {
+
+const char *const trace_op_names[TRACE_OP_COUNT] = {
+    "unknown",    "statfs",        "getattr",    "fgetattr",   "opendir",
+    "releasedir", "readdir",       "open",       "release",    "read",
+    "read_buf",   "ll_lookup",     "ll_getattr", "ll_opendir", "ll_releasedir",
+    "ll_readdir", "ll_open",       "ll_release", "ll_read"};
+
+} // namespace
+
+TraceRecorder::TraceRecorder() : mFile(nullptr), mStart(now()) {}
+
+TraceRecorder::~TraceRecorder() {
+  for (Buffer *buffer : mBuffers.getAll()) {
+    flush(buffer);
+  }
+  if (mFile) {
+    fclose(mFile);
+  }
+}
+
+bool TraceRecorder::open(const char *path) {
+  struct trace_header header;
+
+  mFile = fopen(path, "wb");
+  if (mFile == nullptr) {
+    return false;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  header.version = TRACE_VERSION;
+  return fwrite(&header, sizeof(header), 1, mFile) == 1;
+}
+
+const char *TraceRecorder::getName(trace_op op) {
+  return op < TRACE_OP_COUNT ? trace_op_names[op] : trace_op_names[0];
+}
+
+uint64_t TraceRecorder::now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+TraceRecorder::Buffer *TraceRecorder::getBuffer() {
+  return mBuffers.get([](size_t index) {
+    Buffer *const buffer = new Buffer();
+    buffer->thread = index;
+    buffer->data.reserve(BUFFER_SIZE);
+    return buffer;
+  });
+}
+
+void TraceRecorder::flush(Buffer *buffer) {
+  std::lock_guard<std::mutex> guard(mLock);
+  if (!buffer->data.empty()) {
+    fwrite(buffer->data.data(), 1, buffer->data.size(), mFile);
+    buffer->data.clear();
+  }
+}
+
+void TraceRecorder::record(trace_op op, const char *name, uint64_t inode,
+                           uint64_t handle, int64_t offset, uint64_t size) {
+  Buffer *const buffer = getBuffer();
+  struct trace_record record;
+
+  record.timestamp = now() - mStart;
+  record.inode = inode;
+  record.handle = handle;
+  record.offset = offset;
+  record.size = size;
+  record.thread = buffer->thread;
+  record.op = op;
+  record.name_length =
+      name ? std::min<size_t>(strlen(name), UINT16_MAX) : 0;
+
+  const size_t length = sizeof(record) + record.name_length;
+  if (buffer->data.size() + length > BUFFER_SIZE) {
+    flush(buffer);
+  }
+  const unsigned char *const bytes =
+      reinterpret_cast<const unsigned char *>(&record);
+  buffer->data.insert(buffer->data.end(), bytes, bytes + sizeof(record));
+  if (name) {
+    buffer->data.insert(buffer->data.end(), name, name + record.name_length);
+  }
+}
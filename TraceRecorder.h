@@ -0,0 +1,95 @@
+#ifndef __TRACE_RECORDER__H_
+#define __TRACE_RECORDER__H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+#include "PerThread.h"
+
+// Trace files are a trace_header followed by trace_records, each followed by
+// name_length bytes of the path or name it refers to. Everything is in host
+// byte order, traces are meant to be replayed on the machine they were
+// recorded on or one like it.
+#define TRACE_MAGIC "GCTRACE"
+#define TRACE_VERSION 1
+
+enum trace_op {
+  TRACE_STATFS = 1,
+  TRACE_GETATTR,
+  TRACE_FGETATTR,
+  TRACE_OPENDIR,
+  TRACE_RELEASEDIR,
+  TRACE_READDIR,
+  TRACE_OPEN,
+  TRACE_RELEASE,
+  TRACE_READ,
+  TRACE_READ_BUF,
+  TRACE_LL_LOOKUP,
+  TRACE_LL_GETATTR,
+  TRACE_LL_OPENDIR,
+  TRACE_LL_RELEASEDIR,
+  TRACE_LL_READDIR,
+  TRACE_LL_OPEN,
+  TRACE_LL_RELEASE,
+  TRACE_LL_READ,
+  TRACE_OP_COUNT
+};
+
+#pragma pack(1)
+struct trace_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct trace_record {
+  uint64_t timestamp; // nanoseconds since recording started
+  uint64_t inode;     // for lookups the parent directory
+  uint64_t handle;    // the open file's fi->fh, 0 if there's none
+  int64_t offset;
+  uint64_t size;
+  uint32_t thread; // small number telling the threads apart
+  uint16_t op;
+  uint16_t name_length;
+};
+#pragma pack()
+
+// Writes a trace of every operation. Threads append to buffers of their own
+// and only take the file's lock to write out a full buffer, so records from
+// different threads are interleaved in blocks; replaying sorts them by
+// timestamp.
+class TraceRecorder {
+public:
+  static const size_t BUFFER_SIZE = 64 * 1024;
+
+private:
+  struct Buffer {
+    uint32_t thread;
+    std::vector<unsigned char> data;
+  };
+
+  FILE *mFile;
+  uint64_t mStart;
+  std::mutex mLock; // held while writing to mFile
+  PerThread<Buffer> mBuffers;
+
+public:
+  TraceRecorder();
+  // writes out what's still buffered
+  ~TraceRecorder();
+
+  bool open(const char *path);
+
+  void record(trace_op op, const char *name, uint64_t inode, uint64_t handle,
+              int64_t offset = 0, uint64_t size = 0);
+
+  static const char *getName(trace_op op);
+
+private:
+  Buffer *getBuffer();
+  void flush(Buffer *buffer);
+  static uint64_t now();
+};
+
+#endif
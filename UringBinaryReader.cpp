@@ -0,0 +1,424 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include "UringBinaryReader.h"
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int toSubmit,
+                          unsigned int minComplete, unsigned int flags) {
+  return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                 nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, const void *arg,
+                             unsigned int args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, args);
+}
+
+template <typename T> static T *ringField(void *ring, uint32_t offset) {
+  return reinterpret_cast<T *>(reinterpret_cast<unsigned char *>(ring) +
+                               offset);
+}
+
+UringBinaryReader::Queue::Queue()
+    : mRingFd(-1), mSqpoll(false), mDepth(0), mSqRing(MAP_FAILED),
+      mSqRingSize(0), mCqRing(MAP_FAILED), mCqRingSize(0), mSqes(nullptr),
+      mSqesSize(0), mBuffers(nullptr), mQueued(0), mInFlight(0),
+      mBroken(false) {}
+
+UringBinaryReader::Queue::~Queue() {
+  if (mBuffers != nullptr) {
+    munmap(mBuffers, mDepth * SPLIT_SIZE);
+  }
+  if (mSqes != nullptr) {
+    munmap(mSqes, mSqesSize);
+  }
+  if (mCqRing != MAP_FAILED) {
+    munmap(mCqRing, mCqRingSize);
+  }
+  if (mSqRing != MAP_FAILED) {
+    munmap(mSqRing, mSqRingSize);
+  }
+  if (mRingFd >= 0) {
+    close(mRingFd);
+  }
+}
+
+UringBinaryReader::Queue *UringBinaryReader::Queue::create(
+    int fd, const Options &options) {
+  struct io_uring_params params;
+  Queue *const queue = new Queue();
+
+  memset(&params, 0, sizeof(params));
+  if (options.sqpoll) {
+    params.flags |= IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = 1000;
+  }
+  if ((queue->mRingFd = io_uring_setup(options.queueDepth, &params)) < 0) {
+    delete queue;
+    return nullptr;
+  }
+  queue->mSqpoll = options.sqpoll;
+  queue->mDepth = params.sq_entries;
+
+  queue->mSqRingSize =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  queue->mCqRingSize =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  queue->mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  queue->mSqRing = mmap(nullptr, queue->mSqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, queue->mRingFd,
+                        IORING_OFF_SQ_RING);
+  queue->mCqRing = mmap(nullptr, queue->mCqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, queue->mRingFd,
+                        IORING_OFF_CQ_RING);
+  void *const sqes =
+      mmap(nullptr, queue->mSqesSize, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, queue->mRingFd, IORING_OFF_SQES);
+  if (queue->mSqRing == MAP_FAILED || queue->mCqRing == MAP_FAILED ||
+      sqes == MAP_FAILED) {
+    delete queue;
+    return nullptr;
+  }
+  queue->mSqes = reinterpret_cast<struct io_uring_sqe *>(sqes);
+
+  queue->mSqHead = ringField<unsigned int>(queue->mSqRing, params.sq_off.head);
+  queue->mSqTail = ringField<unsigned int>(queue->mSqRing, params.sq_off.tail);
+  queue->mSqMask =
+      ringField<unsigned int>(queue->mSqRing, params.sq_off.ring_mask);
+  queue->mSqFlags =
+      ringField<unsigned int>(queue->mSqRing, params.sq_off.flags);
+  queue->mSqArray =
+      ringField<unsigned int>(queue->mSqRing, params.sq_off.array);
+  queue->mCqHead = ringField<unsigned int>(queue->mCqRing, params.cq_off.head);
+  queue->mCqTail = ringField<unsigned int>(queue->mCqRing, params.cq_off.tail);
+  queue->mCqMask =
+      ringField<unsigned int>(queue->mCqRing, params.cq_off.ring_mask);
+  queue->mCqes =
+      ringField<struct io_uring_cqe>(queue->mCqRing, params.cq_off.cqes);
+
+  // the image is looked up once here rather than on every request
+  if (io_uring_register(queue->mRingFd, IORING_REGISTER_FILES, &fd, 1) < 0) {
+    delete queue;
+    return nullptr;
+  }
+
+  if (options.fixedBuffers) {
+    void *const buffers =
+        mmap(nullptr, queue->mDepth * SPLIT_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers != MAP_FAILED) {
+      std::vector<struct iovec> iovecs(queue->mDepth);
+      queue->mBuffers = reinterpret_cast<unsigned char *>(buffers);
+      for (unsigned int i = 0; i < queue->mDepth; ++i) {
+        iovecs[i].iov_base = queue->mBuffers + i * SPLIT_SIZE;
+        iovecs[i].iov_len = SPLIT_SIZE;
+      }
+      // pinning can fail against RLIMIT_MEMLOCK, plain reads still work
+      if (io_uring_register(queue->mRingFd, IORING_REGISTER_BUFFERS,
+                            iovecs.data(), iovecs.size()) == 0) {
+        for (unsigned int i = 0; i < queue->mDepth; ++i) {
+          queue->mFreeBuffers.push_back(i);
+        }
+      }
+    }
+  }
+
+  queue->mSlots.resize(queue->mDepth);
+  for (unsigned int i = 0; i < queue->mDepth; ++i) {
+    queue->mFreeSlots.push_back(i);
+  }
+  return queue;
+}
+
+bool UringBinaryReader::Queue::submit(Request *request) {
+  if (mFreeSlots.empty()) {
+    return false;
+  }
+
+  const unsigned int slot = mFreeSlots.back();
+  mFreeSlots.pop_back();
+  mSlots[slot].request = request;
+  mSlots[slot].buffer = -1;
+
+  // only this thread produces, the kernel only moves the head
+  const unsigned int tail = *mSqTail;
+  const unsigned int index = tail & *mSqMask;
+  struct io_uring_sqe *const sqe = &mSqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = 0; // index into the registered files
+  sqe->flags = IOSQE_FIXED_FILE;
+  sqe->off = request->offset;
+  sqe->len = request->size;
+  sqe->user_data = slot;
+  if (!mFreeBuffers.empty() && request->size <= SPLIT_SIZE) {
+    const int buffer = mFreeBuffers.back();
+    mFreeBuffers.pop_back();
+    mSlots[slot].buffer = buffer;
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->addr = reinterpret_cast<uintptr_t>(mBuffers + buffer * SPLIT_SIZE);
+    sqe->buf_index = buffer;
+  } else {
+    sqe->opcode = IORING_OP_READ;
+    sqe->addr = reinterpret_cast<uintptr_t>(request->buf);
+  }
+  mSqArray[index] = index;
+  __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+  ++mQueued;
+  return true;
+}
+
+size_t UringBinaryReader::Queue::complete(size_t min) {
+  size_t completed = reap();
+
+  min = std::min<size_t>(min, getOutstanding() + completed);
+  while (mQueued > 0 || completed < min) {
+    unsigned int flags = 0;
+    const unsigned int wait = completed < min ? min - completed : 0;
+
+    if (wait > 0) {
+      flags |= IORING_ENTER_GETEVENTS;
+    }
+    if (mSqpoll) {
+      // the poller picks submissions up by itself unless it went to sleep
+      if (pollerAsleep()) {
+        flags |= IORING_ENTER_SQ_WAKEUP;
+      }
+      mInFlight += mQueued;
+      mQueued = 0;
+      if (flags == 0) {
+        break;
+      }
+      if (io_uring_enter(mRingFd, 0, wait, flags) < 0 && errno != EINTR) {
+        mBroken = true;
+        break;
+      }
+    } else {
+      const int submitted = io_uring_enter(mRingFd, mQueued, wait, flags);
+      if (submitted < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+          mBroken = true;
+          break;
+        }
+      } else {
+        mQueued -= submitted;
+        mInFlight += submitted;
+      }
+    }
+    completed += reap();
+  }
+  return completed;
+}
+
+bool UringBinaryReader::Queue::drain() {
+  reap();
+  while (mInFlight > 0) {
+    // with SQPOLL, what's in flight may not even have been picked up yet
+    unsigned int flags = IORING_ENTER_GETEVENTS;
+    if (mSqpoll && pollerAsleep()) {
+      flags |= IORING_ENTER_SQ_WAKEUP;
+    }
+    if (io_uring_enter(mRingFd, 0, mInFlight, flags) < 0 && errno != EINTR &&
+        errno != EAGAIN && errno != EBUSY) {
+      return false;
+    }
+    reap();
+  }
+  return true;
+}
+
+bool UringBinaryReader::Queue::pollerAsleep() const {
+  // The poller sets the flag before it sleeps and checks the tail again
+  // after. Without a full fence the load below may be ordered before the
+  // tail submit stored, then the poller misses the tail, we miss the flag
+  // and wait for completions that never come.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return (__atomic_load_n(mSqFlags, __ATOMIC_ACQUIRE) &
+          IORING_SQ_NEED_WAKEUP) != 0;
+}
+
+size_t UringBinaryReader::Queue::reap() {
+  unsigned int head = *mCqHead;
+  const unsigned int tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+  size_t completed = 0;
+
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe *const cqe = &mCqes[head & *mCqMask];
+    Slot &slot = mSlots[cqe->user_data];
+
+    slot.request->result = cqe->res;
+    if (slot.buffer >= 0) {
+      if (cqe->res > 0) {
+        memcpy(slot.request->buf, mBuffers + slot.buffer * SPLIT_SIZE,
+               cqe->res);
+      }
+      mFreeBuffers.push_back(slot.buffer);
+    }
+    mFreeSlots.push_back(cqe->user_data);
+    --mInFlight;
+    ++completed;
+  }
+  __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+  return completed;
+}
+
+UringBinaryReader::UringBinaryReader(const Options &options)
+    : mFd(-1), mOptions(options), mAvailable(false) {}
+
+UringBinaryReader::~UringBinaryReader() {
+  for (Queue *const queue : mIdle) {
+    delete queue;
+  }
+  if (mFd >= 0) {
+    close(mFd);
+  }
+}
+
+bool UringBinaryReader::open(const char *path) {
+  if ((mFd = ::open(path, O_RDONLY)) < 0) {
+    return false;
+  }
+
+  // find out whether io_uring works here at all, the queue is kept
+  Queue *const queue = Queue::create(mFd, mOptions);
+  mAvailable = queue != nullptr;
+  if (queue != nullptr) {
+    releaseQueue(queue);
+  }
+  return true;
+}
+
+UringBinaryReader::Queue *UringBinaryReader::acquireQueue() {
+  if (!mAvailable) {
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(mLock);
+    if (!mIdle.empty()) {
+      Queue *const queue = mIdle.back();
+      mIdle.pop_back();
+      return queue;
+    }
+  }
+  // one more thread than ever before is reading
+  return Queue::create(mFd, mOptions);
+}
+
+void UringBinaryReader::releaseQueue(Queue *queue) {
+  std::lock_guard<std::mutex> guard(mLock);
+  mIdle.push_back(queue);
+}
+
+int UringBinaryReader::read(void *buf, int size, size_t offset) {
+  if (size <= 0) {
+    return 0;
+  }
+
+  // large reads go out as several requests served in parallel
+  unsigned char *const out = reinterpret_cast<unsigned char *>(buf);
+  const size_t count = (size + SPLIT_SIZE - 1) / SPLIT_SIZE;
+  std::vector<Request> requests(count);
+  for (size_t i = 0; i < count; ++i) {
+    requests[i].buf = out + i * SPLIT_SIZE;
+    requests[i].size = std::min(size - i * SPLIT_SIZE, size_t(SPLIT_SIZE));
+    requests[i].offset = offset + i * SPLIT_SIZE;
+  }
+  readBatch(requests.data(), count);
+
+  int done = 0;
+  for (const Request &request : requests) {
+    if (request.result < 0) {
+      return done > 0 ? done : -1;
+    }
+    done += request.result;
+    if (static_cast<size_t>(request.result) < request.size) {
+      break;
+    }
+  }
+  return done;
+}
+
+void UringBinaryReader::readBatch(Request *requests, size_t count) {
+  Queue *const queue = acquireQueue();
+
+  if (queue == nullptr) {
+    for (size_t i = 0; i < count; ++i) {
+      requests[i].result = pread(mFd, requests[i].buf, requests[i].size,
+                                 requests[i].offset);
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    requests[i].result = -EIO;
+  }
+
+  size_t submitted = 0;
+  while (submitted < count || queue->getOutstanding() > 0) {
+    while (submitted < count && queue->submit(&requests[submitted])) {
+      ++submitted;
+    }
+    // keep the queue full, only wait for as much as makes room
+    queue->complete(submitted < count ? 1 : queue->getOutstanding());
+    if (queue->isBroken()) {
+      break;
+    }
+  }
+  if (queue->isBroken()) {
+    // reads in flight still target the requests' buffers, closing the ring
+    // doesn't stop them landing after we return. A ring that can't even be
+    // waited on is leaked, so at least its registered buffers stay mapped.
+    if (queue->drain()) {
+      delete queue;
+    }
+    // whatever didn't finish is read the slow way
+    for (size_t i = 0; i < count; ++i) {
+      if (requests[i].result == -EIO) {
+        requests[i].result = pread(mFd, requests[i].buf, requests[i].size,
+                                   requests[i].offset);
+        if (requests[i].result < 0) {
+          requests[i].result = -errno;
+        }
+      }
+    }
+  } else {
+    releaseQueue(queue);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    Request &request = requests[i];
+    if (request.result < 0) {
+      // match what pread would have returned
+      errno = -request.result;
+      request.result = -1;
+    } else if (request.result > 0 &&
+               static_cast<size_t>(request.result) < request.size) {
+      // short reads only happen at the end of the file, or when the kernel
+      // gives up early, finish those the slow way
+      const ssize_t rest =
+          pread(mFd, reinterpret_cast<unsigned char *>(request.buf) +
+                         request.result,
+                request.size - request.result,
+                request.offset + request.result);
+      if (rest > 0) {
+        request.result += rest;
+      }
+    }
+  }
+}
+
+void UringBinaryReader::advise(size_t offset, size_t size, Advice advice) {
+  static const int fadvice[] = {POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL,
+                                POSIX_FADV_RANDOM};
+
+  posix_fadvise(mFd, offset, size, fadvice[advice]);
+}
@@ -0,0 +1,117 @@
+#ifndef __URING_BINARY_READER__H_
+#define __URING_BINARY_READER__H_
+
+#include <linux/io_uring.h>
+#include <mutex>
+#include <vector>
+#include "BinaryReader.h"
+
+// Reads through io_uring so a single read, or a batch of them, keeps many
+// requests in flight instead of blocking on one pread at a time. Every
+// thread borrows a ring of its own for the duration of a call, so FUSE
+// worker threads never share submission queues. Falls back to pread when
+// the kernel doesn't offer io_uring.
+class UringBinaryReader : public BinaryReader {
+public:
+  static const unsigned int DEFAULT_QUEUE_DEPTH = 32;
+  // reads are split into requests of at most this size
+  static const size_t SPLIT_SIZE = 128 * 1024;
+
+  struct Options {
+    unsigned int queueDepth;
+    bool sqpoll;       // let a kernel thread poll the submission queue
+    bool fixedBuffers; // read into registered buffers and copy out
+  };
+
+  // A submission and completion ring pair for one thread at a time. The
+  // image is registered with it, requests are queued with submit() and
+  // handed to the kernel in one go by complete().
+  class Queue {
+  private:
+    struct Slot {
+      Request *request;
+      int buffer; // registered buffer read into, -1 if none
+    };
+
+    int mRingFd;
+    bool mSqpoll;
+    unsigned int mDepth;
+    void *mSqRing;
+    size_t mSqRingSize;
+    void *mCqRing;
+    size_t mCqRingSize;
+    struct io_uring_sqe *mSqes;
+    size_t mSqesSize;
+    unsigned int *mSqHead;
+    unsigned int *mSqTail;
+    unsigned int *mSqMask;
+    unsigned int *mSqFlags;
+    unsigned int *mSqArray;
+    unsigned int *mCqHead;
+    unsigned int *mCqTail;
+    unsigned int *mCqMask;
+    struct io_uring_cqe *mCqes;
+    unsigned char *mBuffers;
+    std::vector<Slot> mSlots;
+    std::vector<unsigned int> mFreeSlots;
+    std::vector<int> mFreeBuffers;
+    unsigned int mQueued;
+    unsigned int mInFlight;
+    bool mBroken;
+
+    Queue();
+
+  public:
+    ~Queue();
+
+    // null if the ring can't be set up
+    static Queue *create(int fd, const Options &options);
+
+    // queues a read, false when queueDepth reads are already outstanding
+    bool submit(Request *request);
+    // submits everything queued and waits for at least min outstanding
+    // reads to finish, returns how many finished
+    size_t complete(size_t min);
+    // waits for every read handed to the kernel without submitting more,
+    // false if the kernel won't say when they're done
+    bool drain();
+
+    unsigned int getOutstanding() const { return mQueued + mInFlight; }
+    // the kernel refused the ring, outstanding reads will never finish
+    bool isBroken() const { return mBroken; }
+
+  private:
+    size_t reap();
+    // whether the SQPOLL thread went to sleep and needs waking up
+    bool pollerAsleep() const;
+  };
+
+private:
+  int mFd;
+  Options mOptions;
+  bool mAvailable;
+  std::mutex mLock;
+  std::vector<Queue *> mIdle;
+
+public:
+  explicit UringBinaryReader(const Options &options = Options{
+                                 DEFAULT_QUEUE_DEPTH, false, false});
+  virtual ~UringBinaryReader();
+
+  bool open(const char *path);
+
+  virtual int read(void *buf, int size, size_t offset);
+  virtual void readBatch(Request *requests, size_t count);
+  virtual void advise(size_t offset, size_t size, Advice advice);
+  virtual int getFileDescriptor() const { return mFd; }
+
+  // false if reads fall back to pread
+  bool isAvailable() const { return mAvailable; }
+
+  // Lends the caller a queue for its exclusive use until it's released,
+  // null if io_uring is unavailable
+  Queue *acquireQueue();
+  void releaseQueue(Queue *queue);
+};
+
+#endif
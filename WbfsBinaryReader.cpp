@@ -0,0 +1,153 @@
+#include <string.h>
+#include <algorithm>
+#include "WbfsBinaryReader.h"
+
+static const char WBFS_MAGIC[4] = {'W', 'B', 'F', 'S'};
+
+WbfsBinaryReader::WbfsBinaryReader(BinaryReader *reader)
+    : mReader(reader), mHdSectorShift(0), mWbfsSectorShift(0),
+      mDiscInfoSize(0) {}
+
+WbfsBinaryReader::~WbfsBinaryReader() { delete mReader; }
+
+bool WbfsBinaryReader::detect(BinaryReader *reader) {
+  char magic[sizeof(WBFS_MAGIC)];
+
+  return reader->read(magic, sizeof(magic), 0) ==
+             static_cast<int>(sizeof(magic)) &&
+         memcmp(magic, WBFS_MAGIC, sizeof(magic)) == 0;
+}
+
+bool WbfsBinaryReader::open() {
+  struct wbfs_header header;
+
+  if (mReader->read(&header, sizeof(header), 0) !=
+          static_cast<int>(sizeof(header)) ||
+      memcmp(header.magic, WBFS_MAGIC, sizeof(WBFS_MAGIC)) != 0) {
+    return false;
+  }
+  mHdSectorShift = header.hd_sec_sz_s;
+  mWbfsSectorShift = header.wbfs_sec_sz_s;
+  if (mHdSectorShift < 9 || mHdSectorShift > 16 ||
+      mWbfsSectorShift < WII_SECTOR_SIZE_SHIFT || mWbfsSectorShift > 30) {
+    return false;
+  }
+
+  // every slot's info is the disc header and its sector table, padded to a
+  // container sector
+  const uint64_t hdSectorSize = 1ULL << mHdSectorShift;
+  const uint64_t sectorsPerDisc =
+      WII_SECTORS_PER_DISC >> (mWbfsSectorShift - WII_SECTOR_SIZE_SHIFT);
+  mDiscInfoSize = (DISC_HEADER_SIZE + sectorsPerDisc * sizeof(uint16_t) +
+                   hdSectorSize - 1) &
+                  ~(hdSectorSize - 1);
+  mSectors.clear();
+
+  // the slot table fills the rest of the first container sector
+  std::vector<uint8_t> slots(hdSectorSize - sizeof(header));
+  if (mReader->read(slots.data(), slots.size(), sizeof(header)) !=
+      static_cast<int>(slots.size())) {
+    return false;
+  }
+
+  mDiscs.clear();
+  for (unsigned int slot = 0; slot < slots.size(); ++slot) {
+    char discHeader[DISC_HEADER_SIZE];
+    if (slots[slot] == 0 ||
+        mReader->read(discHeader, sizeof(discHeader),
+                      getDiscInfoOffset(slot)) !=
+            static_cast<int>(sizeof(discHeader))) {
+      continue;
+    }
+    // the game id leads the disc header and the title starts at 0x20
+    Disc disc;
+    disc.slot = slot;
+    disc.gameId.assign(discHeader, strnlen(discHeader, 6));
+    disc.name.assign(discHeader + 0x20,
+                     strnlen(discHeader + 0x20, DISC_HEADER_SIZE - 0x20));
+    mDiscs.push_back(disc);
+  }
+  return !mDiscs.empty();
+}
+
+bool WbfsBinaryReader::select(size_t disc) {
+  if (disc >= mDiscs.size()) {
+    return false;
+  }
+
+  const uint64_t sectorsPerDisc =
+      WII_SECTORS_PER_DISC >> (mWbfsSectorShift - WII_SECTOR_SIZE_SHIFT);
+  std::vector<be16_t> table(sectorsPerDisc);
+  const size_t tableSize = table.size() * sizeof(be16_t);
+  if (mReader->read(table.data(), tableSize,
+                    getDiscInfoOffset(mDiscs[disc].slot) + DISC_HEADER_SIZE) !=
+      static_cast<int>(tableSize)) {
+    return false;
+  }
+
+  // the image ends with the last sector the disc uses
+  size_t used = table.size();
+  while (used > 0 && table[used - 1] == 0) {
+    --used;
+  }
+  mSectors.assign(table.begin(), table.begin() + used);
+  return true;
+}
+
+int WbfsBinaryReader::read(void *buf, int size, size_t offset) {
+  unsigned char *const out = reinterpret_cast<unsigned char *>(buf);
+  const uint64_t dataSize = getDataSize();
+  const uint64_t sectorSize = 1ULL << mWbfsSectorShift;
+  size_t done = 0;
+
+  if (size <= 0 || offset >= dataSize) {
+    return 0;
+  }
+
+  const size_t length = std::min<uint64_t>(size, dataSize - offset);
+  while (done < length) {
+    const size_t position = offset + done;
+    size_t sector = position >> mWbfsSectorShift;
+    const uint16_t first = mSectors[sector];
+
+    // extend over the following sectors as long as they're stored right
+    // after this one, or are just as unused
+    do {
+      ++sector;
+    } while ((sector << mWbfsSectorShift) < offset + length &&
+             mSectors[sector] ==
+                 (first ? first + (sector - (position >> mWbfsSectorShift))
+                        : 0));
+    const size_t count =
+        std::min<uint64_t>(sector * sectorSize, offset + length) - position;
+
+    if (first == 0) {
+      memset(out + done, 0, count);
+    } else {
+      const int read =
+          mReader->read(out + done, count, getPhysicalOffset(position));
+      if (read < 0) {
+        return done > 0 ? done : -1;
+      }
+      if (static_cast<size_t>(read) < count) {
+        return done + read;
+      }
+    }
+    done += count;
+  }
+  return done;
+}
+
+const void *WbfsBinaryReader::map(size_t offset, size_t size) {
+  if (size == 0 || offset + size > getDataSize()) {
+    return nullptr;
+  }
+
+  // only a range within one stored sector is contiguous in the container
+  const size_t sector = offset >> mWbfsSectorShift;
+  if (((offset + size - 1) >> mWbfsSectorShift) != sector ||
+      mSectors[sector] == 0) {
+    return nullptr;
+  }
+  return mReader->map(getPhysicalOffset(offset), size);
+}
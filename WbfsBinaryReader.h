@@ -0,0 +1,80 @@
+#ifndef __WBFS_BINARY_READER__H_
+#define __WBFS_BINARY_READER__H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "BigEndian.h"
+#include "BinaryReader.h"
+
+// WBFS partitions and files. The header is followed by a table of used disc
+// slots, every slot has a copy of the disc header and a table mapping the
+// disc's WBFS sized sectors to sectors of the container.
+#pragma pack(1)
+struct wbfs_header {
+  char magic[4];
+  be32_t n_hd_sec;       // sectors in the container
+  uint8_t hd_sec_sz_s;   // log2 of the container's sector size
+  uint8_t wbfs_sec_sz_s; // log2 of the WBFS sector size
+  uint8_t padding[2];
+};
+#pragma pack()
+
+// Reads one disc of a WBFS container as a plain ISO. Sectors the disc
+// doesn't use read as zeros.
+class WbfsBinaryReader : public BinaryReader {
+public:
+  struct Disc {
+    unsigned int slot;
+    std::string gameId;
+    std::string name;
+  };
+
+private:
+  static const unsigned int DISC_HEADER_SIZE = 0x100;
+  // the container is laid out for the largest Wii disc, 32 KiB sectors
+  static const unsigned int WII_SECTOR_SIZE_SHIFT = 15;
+  static const uint64_t WII_SECTORS_PER_DISC = 143432 * 2;
+
+  BinaryReader *mReader;
+  unsigned int mHdSectorShift;
+  unsigned int mWbfsSectorShift;
+  uint64_t mDiscInfoSize;
+  std::vector<Disc> mDiscs;
+  // container sector of each disc sector, 0 when the disc doesn't use it
+  std::vector<uint16_t> mSectors;
+
+public:
+  // Takes ownership of reader
+  explicit WbfsBinaryReader(BinaryReader *reader);
+  virtual ~WbfsBinaryReader();
+
+  // reads the header and the list of discs
+  bool open();
+  // selects the disc reads are served from, an index into getDiscs()
+  bool select(size_t disc);
+
+  const std::vector<Disc> &getDiscs() const { return mDiscs; }
+
+  // true if the reader's contents start with the WBFS magic
+  static bool detect(BinaryReader *reader);
+
+  virtual int read(void *buf, int size, size_t offset);
+  virtual const void *map(size_t offset, size_t size);
+
+  uint64_t getDataSize() const {
+    return static_cast<uint64_t>(mSectors.size()) << mWbfsSectorShift;
+  }
+
+private:
+  uint64_t getDiscInfoOffset(unsigned int slot) const {
+    return (1 + slot * (mDiscInfoSize >> mHdSectorShift)) << mHdSectorShift;
+  }
+  uint64_t getPhysicalOffset(size_t offset) const {
+    return (static_cast<uint64_t>(mSectors[offset >> mWbfsSectorShift])
+            << mWbfsSectorShift) +
+           (offset & ((1ULL << mWbfsSectorShift) - 1));
+  }
+};
+
+#endif
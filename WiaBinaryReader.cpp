@@ -0,0 +1,419 @@
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bzlib.h>
+#include <zstd.h>
+#include <algorithm>
+#include "WiaBinaryReader.h"
+
+static const char WIA_MAGIC[4] = {'W', 'I', 'A', 1};
+static const char RVZ_MAGIC[4] = {'R', 'V', 'Z', 1};
+
+// the junk padding of discs is generated, and regenerated, per 32 KiB block
+static const size_t JUNK_BLOCK_SIZE = 0x8000;
+
+namespace {
+
+// The generator that produced the padding between files on the disc. RVZ
+// stores its seed instead of the padding itself.
+class LaggedFibonacciGenerator {
+public:
+  static const size_t SEED_SIZE = 17 * sizeof(uint32_t);
+
+private:
+  static const size_t K = 521;
+  static const size_t J = 32;
+
+  uint32_t mBuffer[K];
+  size_t mPosition; // bytes of mBuffer already handed out
+
+public:
+  void setSeed(const unsigned char *seed) {
+    for (size_t i = 0; i < SEED_SIZE / sizeof(uint32_t); ++i) {
+      uint32_t word;
+      memcpy(&word, seed + i * sizeof(word), sizeof(word));
+      mBuffer[i] = be32toh(word);
+    }
+    for (size_t i = SEED_SIZE / sizeof(uint32_t); i < K; ++i) {
+      mBuffer[i] =
+          (mBuffer[i - 17] << 23) ^ (mBuffer[i - 16] >> 9) ^ mBuffer[i - 1];
+    }
+    // the disc takes bits 18-25 rather than 16-23 of the third byte, fold
+    // that in now so output is a plain copy of the buffer in disc order
+    for (size_t i = 0; i < K; ++i) {
+      const uint32_t x = mBuffer[i];
+      mBuffer[i] = htobe32((x & 0xFF00FFFF) | ((x >> 2) & 0x00FF0000));
+    }
+    for (size_t i = 0; i < 4; ++i) {
+      forward();
+    }
+    mPosition = 0;
+  }
+
+  void skip(size_t count) {
+    mPosition += count;
+    while (mPosition >= sizeof(mBuffer)) {
+      forward();
+      mPosition -= sizeof(mBuffer);
+    }
+  }
+
+  void generate(unsigned char *out, size_t count) {
+    while (count > 0) {
+      const size_t length = std::min(count, sizeof(mBuffer) - mPosition);
+      memcpy(out, reinterpret_cast<unsigned char *>(mBuffer) + mPosition,
+             length);
+      out += length;
+      count -= length;
+      skip(length);
+    }
+  }
+
+private:
+  void forward() {
+    for (size_t i = 0; i < J; ++i) {
+      mBuffer[i] ^= mBuffer[i + K - J];
+    }
+    for (size_t i = J; i < K; ++i) {
+      mBuffer[i] ^= mBuffer[i - J];
+    }
+  }
+};
+
+} // namespace
+
+WiaBinaryReader::WiaBinaryReader(BinaryReader *reader, ThreadPool *pool,
+                                 size_t cacheSize)
+    : ChunkedBinaryReader(reader, pool, cacheSize), mRvz(false),
+      mCompression(COMPRESSION_NONE) {
+  memset(mDiscHeader, 0, sizeof(mDiscHeader));
+  mFilters[0].id = LZMA_VLI_UNKNOWN;
+  mFilters[0].options = nullptr;
+  mFilters[1].id = LZMA_VLI_UNKNOWN;
+  mFilters[1].options = nullptr;
+}
+
+WiaBinaryReader::~WiaBinaryReader() {
+  // allocated by lzma_properties_decode
+  free(mFilters[0].options);
+}
+
+bool WiaBinaryReader::detect(BinaryReader *reader) {
+  char magic[sizeof(WIA_MAGIC)];
+
+  return reader->read(magic, sizeof(magic), 0) ==
+             static_cast<int>(sizeof(magic)) &&
+         (memcmp(magic, WIA_MAGIC, sizeof(magic)) == 0 ||
+          memcmp(magic, RVZ_MAGIC, sizeof(magic)) == 0);
+}
+
+bool WiaBinaryReader::open() {
+  struct wia_header_1 header1;
+  struct wia_header_2 header2;
+
+  if (mReader->read(&header1, sizeof(header1), 0) !=
+      static_cast<int>(sizeof(header1))) {
+    return false;
+  }
+  mRvz = memcmp(header1.magic, RVZ_MAGIC, sizeof(RVZ_MAGIC)) == 0;
+  if (!mRvz && memcmp(header1.magic, WIA_MAGIC, sizeof(WIA_MAGIC)) != 0) {
+    return false;
+  }
+  if (header1.header_2_size < sizeof(header2) ||
+      mReader->read(&header2, sizeof(header2), sizeof(header1)) !=
+          static_cast<int>(sizeof(header2))) {
+    return false;
+  }
+
+  // Wii partitions are encrypted and hashed, only GameCube discs are plain
+  const uint64_t dataSize = header1.iso_file_size;
+  const uint32_t chunkSize = header2.chunk_size;
+  if (header2.disc_type != DISC_TYPE_GAMECUBE ||
+      header2.number_of_partition_entries != 0 || chunkSize == 0 ||
+      chunkSize % JUNK_BLOCK_SIZE != 0) {
+    return false;
+  }
+  mCompression = static_cast<Compression>(uint32_t(header2.compression_type));
+  if (mCompression > COMPRESSION_ZSTD ||
+      (mRvz && mCompression == COMPRESSION_PURGE) || !setupFilters(&header2)) {
+    return false;
+  }
+  memcpy(mDiscHeader, header2.disc_header, sizeof(mDiscHeader));
+
+  std::vector<unsigned char> table;
+  const uint32_t rawDataEntries = header2.number_of_raw_data_entries;
+  if (!readTable(header2.raw_data_entries_offset,
+                 header2.raw_data_entries_size,
+                 rawDataEntries * sizeof(struct wia_raw_data_entry), &table)) {
+    return false;
+  }
+  const struct wia_raw_data_entry *const rawData =
+      reinterpret_cast<const struct wia_raw_data_entry *>(table.data());
+  const uint32_t groups = header2.number_of_group_entries;
+  for (uint32_t i = 0; i < rawDataEntries; ++i) {
+    const uint64_t offset = rawData[i].data_offset;
+    const uint64_t size = rawData[i].data_size;
+    if (size == 0) {
+      continue;
+    }
+    // groups start at the entry's offset rounded down to a junk block, so
+    // chunks only line up with them if that's also on a chunk boundary
+    const uint64_t start = offset - offset % JUNK_BLOCK_SIZE;
+    const uint32_t firstGroup = rawData[i].group_index;
+    const uint32_t count = rawData[i].number_of_groups;
+    if (start % chunkSize != 0 || firstGroup > groups ||
+        count > groups - firstGroup || offset + size > dataSize) {
+      return false;
+    }
+    mRawData.push_back(RawData{start, offset + size, firstGroup, count});
+  }
+
+  const size_t entrySize = mRvz ? sizeof(struct rvz_group_entry)
+                                : sizeof(struct wia_group_entry);
+  if (!readTable(header2.group_entries_offset, header2.group_entries_size,
+                 groups * entrySize, &table)) {
+    return false;
+  }
+  mGroups.resize(groups);
+  for (uint32_t i = 0; i < groups; ++i) {
+    const unsigned char *const entry = table.data() + i * entrySize;
+    Group &group = mGroups[i];
+    if (mRvz) {
+      const struct rvz_group_entry *const rvz =
+          reinterpret_cast<const struct rvz_group_entry *>(entry);
+      group.offset = uint64_t(rvz->data_offset) << 2;
+      group.size = rvz->data_size & ~RVZ_COMPRESSED_FLAG;
+      group.compressed = (rvz->data_size & RVZ_COMPRESSED_FLAG) != 0;
+      group.packedSize = rvz->rvz_packed_size;
+    } else {
+      const struct wia_group_entry *const wia =
+          reinterpret_cast<const struct wia_group_entry *>(entry);
+      group.offset = uint64_t(wia->data_offset) << 2;
+      group.size = wia->data_size;
+      group.compressed = mCompression != COMPRESSION_NONE;
+      group.packedSize = 0;
+    }
+  }
+
+  setGeometry(dataSize, chunkSize);
+  return true;
+}
+
+bool WiaBinaryReader::setupFilters(const struct wia_header_2 *header) {
+  lzma_vli id;
+
+  switch (mCompression) {
+  case COMPRESSION_LZMA:
+    id = LZMA_FILTER_LZMA1;
+    break;
+  case COMPRESSION_LZMA2:
+    id = LZMA_FILTER_LZMA2;
+    break;
+  default:
+    return true;
+  }
+
+  // the compressor data holds the raw stream's properties
+  const size_t size = std::min<size_t>(header->compressor_data_size,
+                                       sizeof(header->compressor_data));
+  mFilters[0].id = id;
+  return lzma_properties_decode(&mFilters[0], nullptr, header->compressor_data,
+                                size) == LZMA_OK;
+}
+
+bool WiaBinaryReader::readTable(uint64_t offset, size_t storedSize,
+                                size_t size,
+                                std::vector<unsigned char> *table) {
+  std::vector<unsigned char> stored(storedSize);
+
+  if (mReader->read(stored.data(), storedSize, offset) !=
+      static_cast<int>(storedSize)) {
+    return false;
+  }
+  // the tables are always compressed, even by RVZ
+  table->assign(size, 0);
+  if (mCompression == COMPRESSION_PURGE) {
+    return unpurge(stored.data(), storedSize, table->data(), size);
+  }
+  return decompress(stored.data(), storedSize, table->data(), size);
+}
+
+bool WiaBinaryReader::decodeChunk(uint64_t index, ChunkCache::Chunk *chunk) {
+  const uint64_t start = index * getChunkSize();
+  const size_t length =
+      std::min<uint64_t>(getChunkSize(), getDataSize() - start);
+
+  // anything no raw data entry covers reads as zeros
+  chunk->assign(length, 0);
+  for (const RawData &rawData : mRawData) {
+    if (start < rawData.start || start >= rawData.end) {
+      continue;
+    }
+    const uint64_t group = (start - rawData.start) / getChunkSize();
+    if (group >= rawData.groups) {
+      break;
+    }
+    const size_t groupLength = std::min<uint64_t>(length, rawData.end - start);
+    if (!decodeGroup(mGroups[rawData.firstGroup + group], start,
+                     chunk->data(), groupLength)) {
+      return false;
+    }
+    break;
+  }
+
+  // the disc header lives in the image header rather than in a group
+  if (start < sizeof(mDiscHeader)) {
+    memcpy(chunk->data(), mDiscHeader,
+           std::min<size_t>(length, sizeof(mDiscHeader)));
+  }
+  return true;
+}
+
+bool WiaBinaryReader::decodeGroup(const Group &group, uint64_t discOffset,
+                                  unsigned char *out, size_t length) {
+  if (group.size == 0) {
+    // all zeros
+    return true;
+  }
+
+  std::vector<unsigned char> stored(group.size);
+  if (mReader->read(stored.data(), stored.size(), group.offset) !=
+      static_cast<int>(stored.size())) {
+    return false;
+  }
+
+  if (mCompression == COMPRESSION_PURGE) {
+    return unpurge(stored.data(), stored.size(), out, length);
+  }
+
+  std::vector<unsigned char> packed;
+  const unsigned char *data = stored.data();
+  size_t dataSize = stored.size();
+  if (group.compressed) {
+    const size_t size = group.packedSize ? group.packedSize : length;
+    if (group.packedSize) {
+      packed.resize(size);
+    }
+    if (!decompress(stored.data(), stored.size(),
+                    group.packedSize ? packed.data() : out, size)) {
+      return false;
+    }
+    if (!group.packedSize) {
+      return true;
+    }
+    data = packed.data();
+    dataSize = packed.size();
+  }
+
+  if (group.packedSize) {
+    return unpack(data, std::min<size_t>(dataSize, group.packedSize),
+                  discOffset, out, length);
+  }
+  memcpy(out, data, std::min(dataSize, length));
+  return true;
+}
+
+bool WiaBinaryReader::decompress(const unsigned char *in, size_t inSize,
+                                 unsigned char *out, size_t outSize) {
+  switch (mCompression) {
+  case COMPRESSION_NONE:
+    memcpy(out, in, std::min(inSize, outSize));
+    return true;
+  case COMPRESSION_BZIP2: {
+    unsigned int size = outSize;
+    const int result = BZ2_bzBuffToBuffDecompress(
+        reinterpret_cast<char *>(out), &size,
+        const_cast<char *>(reinterpret_cast<const char *>(in)), inSize, 0, 0);
+    return result == BZ_OK || result == BZ_OUTBUFF_FULL;
+  }
+  case COMPRESSION_LZMA:
+  case COMPRESSION_LZMA2: {
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_raw_decoder(&stream, mFilters) != LZMA_OK) {
+      return false;
+    }
+    stream.next_in = in;
+    stream.avail_in = inSize;
+    stream.next_out = out;
+    stream.avail_out = outSize;
+    // streams may or may not carry an end marker, a full buffer is enough
+    lzma_ret result;
+    do {
+      result = lzma_code(&stream, LZMA_FINISH);
+    } while (result == LZMA_OK && stream.avail_out > 0 && stream.avail_in > 0);
+    lzma_end(&stream);
+    return result == LZMA_STREAM_END ||
+           (result == LZMA_OK && stream.avail_out == 0);
+  }
+  case COMPRESSION_ZSTD: {
+    const size_t result = ZSTD_decompress(out, outSize, in, inSize);
+    return !ZSTD_isError(result);
+  }
+  case COMPRESSION_PURGE:
+  default:
+    return false;
+  }
+}
+
+bool WiaBinaryReader::unpurge(const unsigned char *in, size_t inSize,
+                              unsigned char *out, size_t outSize) {
+  // segments of { be32 offset, be32 size, data } over a zeroed buffer,
+  // followed by a SHA-1 of the whole thing
+  static const size_t HASH_SIZE = 20;
+  size_t position = 0;
+
+  if (inSize < HASH_SIZE) {
+    return false;
+  }
+  inSize -= HASH_SIZE;
+  memset(out, 0, outSize);
+  while (position + 2 * sizeof(be32_t) <= inSize) {
+    const be32_t *const segment =
+        reinterpret_cast<const be32_t *>(in + position);
+    const uint32_t offset = segment[0];
+    const uint32_t size = segment[1];
+    position += 2 * sizeof(be32_t);
+    if (size > inSize - position || offset > outSize ||
+        size > outSize - offset) {
+      return false;
+    }
+    memcpy(out + offset, in + position, size);
+    position += size;
+  }
+  return true;
+}
+
+bool WiaBinaryReader::unpack(const unsigned char *in, size_t inSize,
+                             uint64_t discOffset, unsigned char *out,
+                             size_t outSize) {
+  // runs of { be32 size, data } where the top bit of size marks junk, whose
+  // data is the generator seed instead
+  LaggedFibonacciGenerator junk;
+  size_t position = 0;
+  size_t done = 0;
+
+  while (done < outSize && position + sizeof(be32_t) <= inSize) {
+    const uint32_t header = *reinterpret_cast<const be32_t *>(in + position);
+    const size_t size = header & 0x7FFFFFFF;
+    const size_t count = std::min(size, outSize - done);
+    position += sizeof(be32_t);
+
+    if (header & 0x80000000) {
+      if (position + LaggedFibonacciGenerator::SEED_SIZE > inSize) {
+        return false;
+      }
+      junk.setSeed(in + position);
+      junk.skip((discOffset + done) % JUNK_BLOCK_SIZE);
+      junk.generate(out + done, count);
+      position += LaggedFibonacciGenerator::SEED_SIZE;
+    } else {
+      if (count > inSize - position) {
+        return false;
+      }
+      memcpy(out + done, in + position, count);
+      position += size;
+    }
+    done += count;
+  }
+  return done == outSize;
+}
@@ -0,0 +1,129 @@
+#ifndef __WIA_BINARY_READER__H_
+#define __WIA_BINARY_READER__H_
+
+#include <stdint.h>
+#include <lzma.h>
+#include <vector>
+#include "BigEndian.h"
+#include "ChunkedBinaryReader.h"
+
+// WIA images and their RVZ variant, as written by wit and Dolphin. All
+// fields are big endian.
+#pragma pack(1)
+struct wia_header_1 {
+  char magic[4];
+  be32_t version;
+  be32_t version_compatible;
+  be32_t header_2_size;
+  uint8_t header_2_hash[20];
+  be64_t iso_file_size;
+  be64_t wia_file_size;
+  uint8_t header_1_hash[20];
+};
+
+struct wia_header_2 {
+  be32_t disc_type;
+  be32_t compression_type;
+  be32_t compression_level;
+  be32_t chunk_size;
+  uint8_t disc_header[0x80];
+  be32_t number_of_partition_entries;
+  be32_t partition_entry_size;
+  be64_t partition_entries_offset;
+  uint8_t partition_entries_hash[20];
+  be32_t number_of_raw_data_entries;
+  be64_t raw_data_entries_offset;
+  be32_t raw_data_entries_size;
+  be32_t number_of_group_entries;
+  be64_t group_entries_offset;
+  be32_t group_entries_size;
+  uint8_t compressor_data_size;
+  uint8_t compressor_data[7];
+};
+
+struct wia_raw_data_entry {
+  be64_t data_offset;
+  be64_t data_size;
+  be32_t group_index;
+  be32_t number_of_groups;
+};
+
+struct wia_group_entry {
+  be32_t data_offset; // in units of 4 bytes
+  be32_t data_size;
+};
+
+struct rvz_group_entry {
+  be32_t data_offset; // in units of 4 bytes
+  be32_t data_size;   // top bit set when the data is compressed
+  be32_t rvz_packed_size;
+};
+#pragma pack()
+
+// Reads a GameCube WIA or RVZ image as the ISO it was made from. Every group
+// (chunk) is decompressed on its own with the image's codec, RVZ's padding
+// is regenerated from the stored junk seeds instead of being read.
+class WiaBinaryReader : public ChunkedBinaryReader {
+public:
+  enum Compression {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_PURGE = 1,
+    COMPRESSION_BZIP2 = 2,
+    COMPRESSION_LZMA = 3,
+    COMPRESSION_LZMA2 = 4,
+    COMPRESSION_ZSTD = 5
+  };
+
+private:
+  static const uint32_t DISC_TYPE_GAMECUBE = 1;
+  static const uint32_t RVZ_COMPRESSED_FLAG = 0x80000000;
+
+  struct Group {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t packedSize; // RVZ only, size of the packed data if packed
+    bool compressed;
+  };
+
+  struct RawData {
+    uint64_t start; // rounded down to a chunk
+    uint64_t end;
+    uint32_t firstGroup;
+    uint32_t groups;
+  };
+
+  bool mRvz;
+  Compression mCompression;
+  uint8_t mDiscHeader[0x80];
+  lzma_filter mFilters[2];
+  std::vector<RawData> mRawData;
+  std::vector<Group> mGroups;
+
+public:
+  WiaBinaryReader(BinaryReader *reader, ThreadPool *pool,
+                  size_t cacheSize = DEFAULT_CACHE_SIZE);
+  virtual ~WiaBinaryReader();
+
+  bool open();
+
+  // true if the reader's contents start with the WIA or RVZ magic
+  static bool detect(BinaryReader *reader);
+
+protected:
+  virtual bool decodeChunk(uint64_t index, ChunkCache::Chunk *chunk);
+
+private:
+  bool setupFilters(const struct wia_header_2 *header);
+  bool readTable(uint64_t offset, size_t storedSize, size_t size,
+                 std::vector<unsigned char> *table);
+  bool decodeGroup(const Group &group, uint64_t discOffset,
+                   unsigned char *out, size_t length);
+  bool decompress(const unsigned char *in, size_t inSize, unsigned char *out,
+                  size_t outSize);
+  static bool unpurge(const unsigned char *in, size_t inSize,
+                      unsigned char *out, size_t outSize);
+  static bool unpack(const unsigned char *in, size_t inSize,
+                     uint64_t discOffset, unsigned char *out, size_t outSize);
+};
+
+#endif
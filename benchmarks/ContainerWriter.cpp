@@ -0,0 +1,354 @@
+#include <bzlib.h>
+#include <endian.h>
+#include <lzma.h>
+#include <openssl/evp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <algorithm>
+#include "CisoBinaryReader.h"
+#include "ContainerWriter.h"
+#include "GczBinaryReader.h"
+#include "WbfsBinaryReader.h"
+
+namespace {
+
+void append(std::vector<unsigned char> *file, const void *data, size_t size) {
+  const unsigned char *const bytes =
+      reinterpret_cast<const unsigned char *>(data);
+  file->insert(file->end(), bytes, bytes + size);
+}
+
+bool isZero(const unsigned char *data, size_t size) {
+  return std::all_of(data, data + size,
+                     [](unsigned char byte) { return byte == 0; });
+}
+
+void appendBe32(std::vector<unsigned char> *file, uint32_t value) {
+  be32_t be;
+  be = value;
+  append(file, &be, sizeof(be));
+}
+
+// segments of { be32 offset, be32 size, data } for every run of non-zero
+// 4 KiB blocks, then a SHA-1 of the segments
+std::vector<unsigned char> purge(const unsigned char *data, size_t size) {
+  static const size_t BLOCK_SIZE = 4096;
+  std::vector<unsigned char> purged;
+  size_t position = 0;
+
+  while (position < size) {
+    const size_t length = std::min(BLOCK_SIZE, size - position);
+    if (isZero(data + position, length)) {
+      position += length;
+      continue;
+    }
+    size_t end = position + length;
+    while (end < size &&
+           !isZero(data + end, std::min(BLOCK_SIZE, size - end))) {
+      end += std::min(BLOCK_SIZE, size - end);
+    }
+    appendBe32(&purged, position);
+    appendBe32(&purged, end - position);
+    append(&purged, data + position, end - position);
+    position = end;
+  }
+
+  unsigned char hash[20];
+  EVP_Digest(purged.data(), purged.size(), hash, nullptr, EVP_sha1(),
+             nullptr);
+  append(&purged, hash, sizeof(hash));
+  return purged;
+}
+
+class WiaCompressor {
+private:
+  WiaBinaryReader::Compression mCompression;
+  lzma_options_lzma mLzmaOptions;
+  lzma_filter mFilters[2];
+
+public:
+  explicit WiaCompressor(WiaBinaryReader::Compression compression)
+      : mCompression(compression) {
+    lzma_lzma_preset(&mLzmaOptions, 6);
+    mFilters[0].id = compression == WiaBinaryReader::COMPRESSION_LZMA
+                         ? LZMA_FILTER_LZMA1
+                         : LZMA_FILTER_LZMA2;
+    mFilters[0].options = &mLzmaOptions;
+    mFilters[1].id = LZMA_VLI_UNKNOWN;
+    mFilters[1].options = nullptr;
+  }
+
+  // the LZMA properties the reader takes from header 2's compressor data
+  uint8_t getCompressorData(uint8_t *out, size_t size) {
+    uint32_t length = 0;
+    if (mCompression != WiaBinaryReader::COMPRESSION_LZMA &&
+        mCompression != WiaBinaryReader::COMPRESSION_LZMA2) {
+      return 0;
+    }
+    if (lzma_properties_size(&length, &mFilters[0]) != LZMA_OK ||
+        length > size ||
+        lzma_properties_encode(&mFilters[0], out) != LZMA_OK) {
+      abort();
+    }
+    return length;
+  }
+
+  std::vector<unsigned char> compress(const unsigned char *data,
+                                      size_t size) {
+    std::vector<unsigned char> out;
+
+    switch (mCompression) {
+    case WiaBinaryReader::COMPRESSION_NONE:
+      out.assign(data, data + size);
+      break;
+    case WiaBinaryReader::COMPRESSION_PURGE:
+      out = purge(data, size);
+      break;
+    case WiaBinaryReader::COMPRESSION_BZIP2: {
+      unsigned int length = size + size / 100 + 600;
+      out.resize(length);
+      if (BZ2_bzBuffToBuffCompress(
+              reinterpret_cast<char *>(out.data()), &length,
+              const_cast<char *>(reinterpret_cast<const char *>(data)), size,
+              9, 0, 0) != BZ_OK) {
+        abort();
+      }
+      out.resize(length);
+      break;
+    }
+    case WiaBinaryReader::COMPRESSION_LZMA:
+    case WiaBinaryReader::COMPRESSION_LZMA2: {
+      lzma_stream stream = LZMA_STREAM_INIT;
+      out.resize(size + size / 2 + 4096);
+      if (lzma_raw_encoder(&stream, mFilters) != LZMA_OK) {
+        abort();
+      }
+      stream.next_in = data;
+      stream.avail_in = size;
+      stream.next_out = out.data();
+      stream.avail_out = out.size();
+      const lzma_ret result = lzma_code(&stream, LZMA_FINISH);
+      out.resize(stream.total_out);
+      lzma_end(&stream);
+      if (result != LZMA_STREAM_END) {
+        abort();
+      }
+      break;
+    }
+    case WiaBinaryReader::COMPRESSION_ZSTD:
+      out.resize(ZSTD_compressBound(size));
+      out.resize(ZSTD_compress(out.data(), out.size(), data, size, 3));
+      break;
+    }
+    return out;
+  }
+};
+
+} // namespace
+
+std::vector<unsigned char> writeGcz(BinaryReader *image, uint64_t imageSize,
+                                    uint32_t blockSize) {
+  const uint32_t blocks = (imageSize + blockSize - 1) / blockSize;
+  std::vector<uint64_t> pointers(blocks);
+  std::vector<uint32_t> hashes(blocks);
+  std::vector<unsigned char> data;
+  std::vector<unsigned char> block(blockSize);
+  std::vector<unsigned char> compressed(compressBound(blockSize));
+
+  for (uint32_t i = 0; i < blocks; ++i) {
+    const int length =
+        image->read(block.data(), blockSize, uint64_t(i) * blockSize);
+    uLongf compressedLength = compressed.size();
+    compress2(compressed.data(), &compressedLength, block.data(), length, 6);
+
+    pointers[i] = htole64(data.size());
+    if (compressedLength >= static_cast<uLongf>(length)) {
+      pointers[i] = htole64(data.size() | (1ULL << 63));
+      hashes[i] = htole32(adler32(1, block.data(), length));
+      append(&data, block.data(), length);
+    } else {
+      hashes[i] = htole32(adler32(1, compressed.data(), compressedLength));
+      append(&data, compressed.data(), compressedLength);
+    }
+  }
+
+  struct gcz_header header;
+  header.magic = htole32(GczBinaryReader::MAGIC);
+  header.sub_type = 0;
+  header.compressed_data_size = htole64(data.size());
+  header.data_size = htole64(imageSize);
+  header.block_size = htole32(blockSize);
+  header.num_blocks = htole32(blocks);
+
+  std::vector<unsigned char> file;
+  append(&file, &header, sizeof(header));
+  append(&file, pointers.data(), blocks * sizeof(uint64_t));
+  append(&file, hashes.data(), blocks * sizeof(uint32_t));
+  append(&file, data.data(), data.size());
+  return file;
+}
+
+std::vector<unsigned char> writeCiso(BinaryReader *image, uint64_t imageSize,
+                                     uint32_t blockSize) {
+  std::vector<unsigned char> file(sizeof(struct ciso_header), 0);
+  struct ciso_header header;
+  std::vector<unsigned char> block(blockSize);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "CISO", sizeof(header.magic));
+  header.block_size = htole32(blockSize);
+  for (uint64_t i = 0; i * blockSize < imageSize; ++i) {
+    std::fill(block.begin(), block.end(), 0);
+    image->read(block.data(), blockSize, i * blockSize);
+    if (std::all_of(block.begin(), block.end(),
+                    [](unsigned char byte) { return byte == 0; })) {
+      continue;
+    }
+    header.map[i] = 1;
+    append(&file, block.data(), block.size());
+  }
+  memcpy(file.data(), &header, sizeof(header));
+  return file;
+}
+
+std::vector<unsigned char> writeWia(BinaryReader *image, uint64_t imageSize,
+                                    WiaBinaryReader::Compression compression,
+                                    bool rvz, uint32_t chunkSize,
+                                    bool packOddGroups) {
+  const uint32_t groups = (imageSize + chunkSize - 1) / chunkSize;
+  std::vector<unsigned char> file(
+      sizeof(struct wia_header_1) + sizeof(struct wia_header_2), 0);
+  std::vector<unsigned char> groupTable;
+  std::vector<unsigned char> chunk(chunkSize);
+  WiaCompressor compressor(compression);
+
+  for (uint32_t i = 0; i < groups; ++i) {
+    const int length =
+        image->read(chunk.data(), chunkSize, uint64_t(i) * chunkSize);
+    std::vector<unsigned char> packed;
+    const unsigned char *data = chunk.data();
+    size_t size = length;
+    uint32_t packedSize = 0;
+
+    if (isZero(chunk.data(), length)) {
+      size = 0;
+    } else if (rvz && packOddGroups && i % 2 == 1) {
+      appendBe32(&packed, length);
+      append(&packed, chunk.data(), length);
+      data = packed.data();
+      size = packed.size();
+      packedSize = packed.size();
+    }
+
+    const uint32_t dataOffset = file.size() >> 2;
+    uint32_t dataSize = 0;
+    if (size > 0) {
+      const std::vector<unsigned char> stored =
+          compressor.compress(data, size);
+      append(&file, stored.data(), stored.size());
+      dataSize = stored.size();
+      if (rvz && compression != WiaBinaryReader::COMPRESSION_NONE) {
+        dataSize |= 0x80000000;
+      }
+    }
+    appendBe32(&groupTable, dataOffset);
+    appendBe32(&groupTable, dataSize);
+    if (rvz) {
+      appendBe32(&groupTable, packedSize);
+    }
+    file.resize((file.size() + 3) & ~3);
+  }
+
+  struct wia_raw_data_entry rawData;
+  rawData.data_offset = 0x80;
+  rawData.data_size = imageSize - 0x80;
+  rawData.group_index = 0;
+  rawData.number_of_groups = groups;
+  const std::vector<unsigned char> rawDataTable = compressor.compress(
+      reinterpret_cast<const unsigned char *>(&rawData), sizeof(rawData));
+  const std::vector<unsigned char> groupEntries =
+      compressor.compress(groupTable.data(), groupTable.size());
+
+  struct wia_header_2 header2;
+  memset(&header2, 0, sizeof(header2));
+  header2.disc_type = 1;
+  header2.compression_type = compression;
+  header2.compression_level = 3;
+  header2.chunk_size = chunkSize;
+  image->read(header2.disc_header, sizeof(header2.disc_header), 0);
+  header2.number_of_raw_data_entries = 1;
+  header2.raw_data_entries_offset = file.size();
+  header2.raw_data_entries_size = rawDataTable.size();
+  append(&file, rawDataTable.data(), rawDataTable.size());
+  header2.number_of_group_entries = groups;
+  header2.group_entries_offset = file.size();
+  header2.group_entries_size = groupEntries.size();
+  append(&file, groupEntries.data(), groupEntries.size());
+  header2.compressor_data_size = compressor.getCompressorData(
+      header2.compressor_data, sizeof(header2.compressor_data));
+
+  struct wia_header_1 header1;
+  memset(&header1, 0, sizeof(header1));
+  memcpy(header1.magic, rvz ? "RVZ\x01" : "WIA\x01", sizeof(header1.magic));
+  header1.version = 0x01000000;
+  header1.version_compatible = rvz ? 0x00030000 : 0x01000000;
+  header1.header_2_size = sizeof(header2);
+  header1.iso_file_size = imageSize;
+  header1.wia_file_size = file.size();
+
+  memcpy(file.data(), &header1, sizeof(header1));
+  memcpy(file.data() + sizeof(header1), &header2, sizeof(header2));
+  return file;
+}
+
+std::vector<unsigned char>
+writeWbfs(const std::vector<BinaryReader *> &discs,
+          const std::vector<uint64_t> &imageSizes) {
+  static const unsigned int HD_SECTOR_SHIFT = 9;
+  static const unsigned int WBFS_SECTOR_SHIFT = 15;
+  static const uint64_t SECTORS_PER_DISC = 143432 * 2;
+  static const size_t DISC_HEADER_SIZE = 0x100;
+  const uint64_t hdSectorSize = 1ULL << HD_SECTOR_SHIFT;
+  const uint64_t wbfsSectorSize = 1ULL << WBFS_SECTOR_SHIFT;
+  const uint64_t discInfoSize =
+      (DISC_HEADER_SIZE + SECTORS_PER_DISC * sizeof(be16_t) + hdSectorSize -
+       1) &
+      ~(hdSectorSize - 1);
+
+  // the header sector and every slot's info, then the data sectors
+  std::vector<unsigned char> file(hdSectorSize + discs.size() * discInfoSize,
+                                  0);
+  file.resize((file.size() + wbfsSectorSize - 1) & ~(wbfsSectorSize - 1));
+  std::vector<unsigned char> sector(wbfsSectorSize);
+
+  for (size_t disc = 0; disc < discs.size(); ++disc) {
+    const size_t info = hdSectorSize + disc * discInfoSize;
+    const uint64_t sectors =
+        (imageSizes[disc] + wbfsSectorSize - 1) / wbfsSectorSize;
+
+    file[sizeof(struct wbfs_header) + disc] = 1;
+    discs[disc]->read(&file[info], DISC_HEADER_SIZE, 0);
+    for (uint64_t i = 0; i < sectors; ++i) {
+      std::fill(sector.begin(), sector.end(), 0);
+      discs[disc]->read(sector.data(), sector.size(), i * wbfsSectorSize);
+      if (isZero(sector.data(), sector.size())) {
+        continue;
+      }
+      be16_t *const table =
+          reinterpret_cast<be16_t *>(&file[info + DISC_HEADER_SIZE]);
+      table[i] = file.size() >> WBFS_SECTOR_SHIFT;
+      append(&file, sector.data(), sector.size());
+    }
+  }
+
+  struct wbfs_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "WBFS", sizeof(header.magic));
+  header.n_hd_sec = file.size() >> HD_SECTOR_SHIFT;
+  header.hd_sec_sz_s = HD_SECTOR_SHIFT;
+  header.wbfs_sec_sz_s = WBFS_SECTOR_SHIFT;
+  memcpy(file.data(), &header, sizeof(header));
+  return file;
+}
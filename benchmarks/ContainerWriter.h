@@ -0,0 +1,39 @@
+#ifndef __CONTAINER_WRITER__H_
+#define __CONTAINER_WRITER__H_
+
+#include <stdint.h>
+#include <vector>
+#include "BinaryReader.h"
+#include "WiaBinaryReader.h"
+
+// Packs the first imageSize bytes of image into the container formats the
+// readers take, in memory, for benchmarks and tests to read back
+
+// Dolphin's GCZ: header, block pointers, adler32 of every stored block, then
+// the blocks. Blocks that don't shrink are stored uncompressed.
+std::vector<unsigned char> writeGcz(BinaryReader *image, uint64_t imageSize,
+                                    uint32_t blockSize);
+
+// CISO: the presence map, then only the blocks that aren't all zeros. The
+// last block is padded to the block size with zeros.
+std::vector<unsigned char> writeCiso(BinaryReader *image, uint64_t imageSize,
+                                     uint32_t blockSize);
+
+// A GameCube WIA, or RVZ if rvz is set, laid out the way Dolphin does: both
+// headers, the groups, then the raw data and group tables. All-zero groups
+// are stored empty. With packOddGroups, RVZ stores every odd group as one
+// packed literal run so both kinds of group get read; nothing is ever
+// stored as junk.
+std::vector<unsigned char> writeWia(BinaryReader *image, uint64_t imageSize,
+                                    WiaBinaryReader::Compression compression,
+                                    bool rvz, uint32_t chunkSize,
+                                    bool packOddGroups = false);
+
+// A WBFS file with 512 byte container sectors and 32 KiB WBFS sectors,
+// holding discs[i], imageSizes[i] bytes long, in slot i. Sectors that are
+// all zeros aren't stored.
+std::vector<unsigned char>
+writeWbfs(const std::vector<BinaryReader *> &discs,
+          const std::vector<uint64_t> &imageSizes);
+
+#endif
@@ -0,0 +1,96 @@
+#include <string.h>
+#include <benchmark/benchmark.h>
+#include <memory>
+#include "GamecubeFilesystemTable.h"
+#include "SyntheticImage.h"
+
+namespace {
+
+struct Fixture {
+  SyntheticImage image;
+  GamecubeFilesystemTable fst;
+
+  explicit Fixture(const SyntheticImageOptions &options) : image(options) {
+    if (!fst.open(&image)) {
+      abort();
+    }
+  }
+};
+
+std::unique_ptr<Fixture> makeFixture(const benchmark::State &state) {
+  const SyntheticImageOptions options = {
+      static_cast<unsigned int>(state.range(0)),
+      static_cast<unsigned int>(state.range(1)),
+      static_cast<unsigned int>(state.range(2)), 12, 1024, 0, 0};
+  return std::unique_ptr<Fixture>(new Fixture(options));
+}
+
+int legacy_count_callback(const gc_dvdfs_file_entry *pfe, void *param) {
+  gc_dvdfs_directory_info *const di =
+      reinterpret_cast<gc_dvdfs_directory_info *>(param);
+
+  if (pfe->type == FST_FILE) {
+    di->total_files++;
+    di->total_file_size += pfe->file.length;
+  } else {
+    di->total_directories++;
+  }
+  return 0;
+}
+
+struct stat_data {
+  const GamecubeFilesystemTable *fst;
+  bool legacy;
+  uint32_t links;
+};
+
+// What readdir_callback does for every child: stat it, which for a
+// directory means fetching its directory info
+int stat_callback(const gc_dvdfs_file_entry *pfe, void *param) {
+  stat_data *const data = reinterpret_cast<stat_data *>(param);
+  gc_dvdfs_directory_info di;
+
+  if (pfe->type == FST_DIRECTORY) {
+    if (data->legacy) {
+      memset(&di, 0, sizeof(di));
+      data->fst->enumerate(pfe, legacy_count_callback, &di);
+    } else {
+      data->fst->getDirectoryInfo(pfe, &di);
+    }
+    data->links += di.total_directories;
+  }
+  return 0;
+}
+
+// Equivalent of ls -l data/, whose children are mostly directories
+void listRoot(benchmark::State &state, bool legacy) {
+  std::unique_ptr<Fixture> fixture = makeFixture(state);
+  gc_dvdfs_directory_info di;
+
+  fixture->fst.getDirectoryInfo(fixture->fst.getRoot(), &di);
+  for (auto _ : state) {
+    stat_data data = {&fixture->fst, legacy, 0};
+    fixture->fst.enumerate(fixture->fst.getRoot(), stat_callback, &data);
+    benchmark::DoNotOptimize(data.links);
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          (di.total_files + di.total_directories));
+}
+
+void BM_ReaddirEnumerate(benchmark::State &state) { listRoot(state, true); }
+void BM_ReaddirPrecomputed(benchmark::State &state) {
+  listRoot(state, false);
+}
+
+#define TREE_SHAPES                                                            \
+  ArgNames({"depth", "fanout", "files"})                                       \
+      ->Args({1, 256, 256})                                                    \
+      ->Args({6, 6, 16})                                                       \
+      ->Args({12, 2, 64})
+
+BENCHMARK(BM_ReaddirEnumerate)->TREE_SHAPES;
+BENCHMARK(BM_ReaddirPrecomputed)->TREE_SHAPES;
+
+} // namespace
+
+BENCHMARK_MAIN();
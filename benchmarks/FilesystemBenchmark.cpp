@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+#include "GamecubeIsoFilesystem.h"
+#include "SyntheticImage.h"
+
+// Drives the FST and the path based FUSE handlers in-process, the way fuse
+// would call them but without a mount or the kernel round trips, so the
+// numbers only show the filesystem's own cost.
+
+namespace {
+
+// 19,890 entries, names of 8 to 24 characters, files of 4 to 64 KiB
+const SyntheticImageOptions kTreeOptions = {3, 8, 33, 8, 4096, 24, 65536};
+// 16,384 files in data/ alone, for listing a big directory a page at a time
+const SyntheticImageOptions kFlatOptions = {0, 0, 16384, 8, 4096, 24, 65536};
+// one 64 MiB file to stream
+const SyntheticImageOptions kLargeFileOptions = {0, 0, 1, 8, 64 * 1024 * 1024,
+                                                 0, 0};
+
+struct Fixture {
+  GamecubeIsoFilesystem filesystem;
+  std::vector<std::string> files;       // "/data/..."
+  std::vector<std::string> directories; // "/data/..."
+  std::vector<const gc_dvdfs_file_entry *> directoryEntries;
+
+  explicit Fixture(const SyntheticImageOptions &options)
+      : filesystem(geteuid(), getegid(), "") {
+    SyntheticImage *const image = new SyntheticImage(options);
+    for (const std::string &path : image->getFilePaths()) {
+      files.push_back("/data/" + path);
+    }
+    directories.push_back("/data");
+    for (const std::string &path : image->getDirectoryPaths()) {
+      directories.push_back("/data/" + path);
+    }
+    if (!filesystem.open(image)) {
+      abort();
+    }
+    const GamecubeFilesystemTable &fst = filesystem.getFst();
+    directoryEntries.push_back(fst.getRoot());
+    for (size_t i = 1; i < directories.size(); ++i) {
+      // skip the leading "/data/"
+      const char *const path = directories[i].c_str() + 6;
+      directoryEntries.push_back(fst.lookupPath(path));
+    }
+  }
+};
+
+Fixture &getTreeFixture() {
+  static Fixture fixture(kTreeOptions);
+  return fixture;
+}
+
+Fixture &getFlatFixture() {
+  static Fixture fixture(kFlatOptions);
+  return fixture;
+}
+
+Fixture &getLargeFileFixture() {
+  static Fixture fixture(kLargeFileOptions);
+  return fixture;
+}
+
+int count_filler(void *buf, const char *name, const struct stat *statbuf,
+                 off_t offset) {
+  ++*reinterpret_cast<size_t *>(buf);
+  return 0;
+}
+
+// what the kernel's buffer holds, entries up to a limit and the offset to
+// carry on from
+struct Page {
+  size_t entries;
+  size_t limit;
+  off_t next;
+};
+
+int page_filler(void *buf, const char *name, const struct stat *statbuf,
+                off_t offset) {
+  Page *const page = reinterpret_cast<Page *>(buf);
+
+  if (page->entries == page->limit) {
+    return 1;
+  }
+  ++page->entries;
+  page->next = offset;
+  return 0;
+}
+
+int count_callback(const gc_dvdfs_file_entry *pfe, void *param) {
+  ++*reinterpret_cast<size_t *>(param);
+  return 0;
+}
+
+void BM_FstLookupPath(benchmark::State &state) {
+  Fixture &fixture = getTreeFixture();
+  const GamecubeFilesystemTable &fst = fixture.filesystem.getFst();
+  size_t i = 0;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fst.lookupPath(fixture.files[i].c_str() + 6));
+    i = (i + 1) % fixture.files.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FstLookupPath);
+
+void BM_FstEnumerate(benchmark::State &state) {
+  Fixture &fixture = getTreeFixture();
+  const GamecubeFilesystemTable &fst = fixture.filesystem.getFst();
+  size_t i = 0;
+  size_t entries = 0;
+
+  for (auto _ : state) {
+    fst.enumerate(fixture.directoryEntries[i], count_callback, &entries);
+    i = (i + 1) % fixture.directoryEntries.size();
+  }
+  state.SetItemsProcessed(entries);
+}
+BENCHMARK(BM_FstEnumerate);
+
+void BM_Getattr(benchmark::State &state) {
+  Fixture &fixture = getTreeFixture();
+  struct stat statbuf;
+  size_t i = 0;
+
+  for (auto _ : state) {
+    if (fixture.filesystem.getattr(fixture.files[i].c_str(), &statbuf)) {
+      state.SkipWithError("getattr failed");
+      break;
+    }
+    i = (i + 1) % fixture.files.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Getattr)->ThreadRange(1, 4)->UseRealTime();
+
+void BM_Readdir(benchmark::State &state) {
+  Fixture &fixture = getTreeFixture();
+  size_t i = 0;
+  size_t entries = 0;
+
+  for (auto _ : state) {
+    const char *const path = fixture.directories[i].c_str();
+    struct fuse_file_info fi;
+    memset(&fi, 0, sizeof(fi));
+    if (fixture.filesystem.opendir(path, &fi) ||
+        fixture.filesystem.readdir(path, &entries, count_filler, 0, &fi)) {
+      state.SkipWithError("readdir failed");
+      break;
+    }
+    fixture.filesystem.releasedir(path, &fi);
+    i = (i + 1) % fixture.directories.size();
+  }
+  state.SetItemsProcessed(entries);
+}
+BENCHMARK(BM_Readdir)->ThreadRange(1, 4)->UseRealTime();
+
+// Lists the flat directory in pages of range(0) entries, each readdir
+// resuming at the offset the last one ended on as the kernel does
+void BM_ReaddirPaged(benchmark::State &state) {
+  Fixture &fixture = getFlatFixture();
+  struct fuse_file_info fi;
+  size_t entries = 0;
+
+  memset(&fi, 0, sizeof(fi));
+  if (fixture.filesystem.opendir("/data", &fi)) {
+    state.SkipWithError("opendir failed");
+    return;
+  }
+  for (auto _ : state) {
+    Page page = {0, static_cast<size_t>(state.range(0)), 0};
+    do {
+      page.entries = 0;
+      fixture.filesystem.readdir("/data", &page, page_filler, page.next, &fi);
+      entries += page.entries;
+    } while (page.entries == page.limit);
+  }
+  fixture.filesystem.releasedir("/data", &fi);
+  state.SetItemsProcessed(entries);
+}
+BENCHMARK(BM_ReaddirPaged)->Arg(64)->Arg(1024);
+
+void BM_OpenRelease(benchmark::State &state) {
+  Fixture &fixture = getTreeFixture();
+  size_t i = 0;
+
+  for (auto _ : state) {
+    const char *const path = fixture.files[i].c_str();
+    struct fuse_file_info fi;
+    memset(&fi, 0, sizeof(fi));
+    if (fixture.filesystem.open(path, &fi)) {
+      state.SkipWithError("open failed");
+      break;
+    }
+    fixture.filesystem.release(path, &fi);
+    i = (i + 1) % fixture.files.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_OpenRelease)->ThreadRange(1, 4)->UseRealTime();
+
+// range(0) is the size of every read, the file is read front to back over
+// and over
+void BM_Read(benchmark::State &state) {
+  Fixture &fixture = getLargeFileFixture();
+  const char *const path = fixture.files[0].c_str();
+  const size_t size = state.range(0);
+  std::vector<char> buf(size);
+  struct fuse_file_info fi;
+  struct stat statbuf;
+  off_t offset = 0;
+
+  memset(&fi, 0, sizeof(fi));
+  if (fixture.filesystem.getattr(path, &statbuf) ||
+      fixture.filesystem.open(path, &fi)) {
+    state.SkipWithError("open failed");
+    return;
+  }
+  for (auto _ : state) {
+    const int read =
+        fixture.filesystem.read(path, buf.data(), size, offset, &fi);
+    if (read <= 0) {
+      state.SkipWithError("read failed");
+      break;
+    }
+    offset = (offset + read) % statbuf.st_size;
+  }
+  fixture.filesystem.release(path, &fi);
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Read)
+    ->Arg(4 * 1024)
+    ->Arg(128 * 1024)
+    ->Arg(1024 * 1024)
+    ->ThreadRange(1, 4)
+    ->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
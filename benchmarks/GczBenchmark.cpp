@@ -0,0 +1,88 @@
+#include <string.h>
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "ContainerWriter.h"
+#include "GczBinaryReader.h"
+#include "MemoryReader.h"
+#include "SyntheticImage.h"
+#include "ThreadPool.h"
+
+// Compares reads of a synthetic image against the same image compressed to
+// GCZ: random 4 KiB reads and sequential 128 KiB FUSE sized reads.
+
+namespace {
+
+const uint32_t kGczBlockSize = 32 * 1024;
+
+struct Fixture {
+  SyntheticImage image;
+  ThreadPool pool;
+  GczBinaryReader gcz;
+
+  // one 64 MiB file
+  Fixture()
+      : image(SyntheticImageOptions{0, 0, 1, 8, 64 * 1024 * 1024, 0, 0}),
+        pool(4), gcz(createContainer(&image), &pool) {
+    if (!gcz.open()) {
+      abort();
+    }
+  }
+
+  static BinaryReader *createContainer(SyntheticImage *image) {
+    std::vector<unsigned char> file =
+        writeGcz(image, image->getImageSize(), kGczBlockSize);
+    return new MemoryReader(&file);
+  }
+
+  BinaryReader *getReader(int gcz) {
+    return gcz ? static_cast<BinaryReader *>(&this->gcz) : &image;
+  }
+};
+
+Fixture &getFixture() {
+  static Fixture fixture;
+  return fixture;
+}
+
+// range(0) selects the raw (0) or GCZ (1) image
+void BM_RandomRead4K(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  BinaryReader *const reader = fixture.getReader(state.range(0));
+  const uint64_t size = fixture.image.getImageSize();
+  std::mt19937_64 random(42);
+  char buf[4096];
+
+  for (auto _ : state) {
+    const uint64_t offset = (random() % (size - sizeof(buf))) & ~4095ULL;
+    benchmark::DoNotOptimize(reader->read(buf, sizeof(buf), offset));
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(buf));
+}
+BENCHMARK(BM_RandomRead4K)->ArgName("gcz")->Arg(0)->Arg(1);
+
+void BM_SequentialRead128K(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  BinaryReader *const reader = fixture.getReader(state.range(0));
+  const uint64_t size = fixture.image.getImageSize();
+  std::vector<char> buf(128 * 1024);
+  uint64_t offset = 0;
+
+  for (auto _ : state) {
+    if (offset + buf.size() > size) {
+      offset = 0;
+    }
+    benchmark::DoNotOptimize(reader->read(buf.data(), buf.size(), offset));
+    offset += buf.size();
+  }
+  state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_SequentialRead128K)
+    ->ArgName("gcz")
+    ->Arg(0)
+    ->Arg(1)
+    ->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
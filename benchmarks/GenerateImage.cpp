@@ -0,0 +1,107 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "SyntheticImage.h"
+
+// Writes a synthetic Gamecube image to disk, to mount or to feed the
+// benchmarks that want a real file
+
+static const struct option long_opts[] = {
+    {"depth", required_argument, NULL, 'd'},
+    {"fanout", required_argument, NULL, 'f'},
+    {"files", required_argument, NULL, 'n'},
+    {"name_length", required_argument, NULL, 'l'},
+    {"max_name_length", required_argument, NULL, 'L'},
+    {"file_size", required_argument, NULL, 's'},
+    {"max_file_size", required_argument, NULL, 'S'},
+    {"help", no_argument, NULL, 'h'},
+    {0, 0, 0, 0},
+};
+
+static int printHelp() {
+  printf("Generates a synthetic Gamecube ISO file\n\n"
+         "generate_image [options] output.iso\n\n"
+         "    -d, --depth=levels        directory levels below data/, 2 "
+         "(default)\n"
+         "    -f, --fanout=dirs         subdirectories per directory, 4 "
+         "(default)\n"
+         "    -n, --files=files         files per directory, 16 (default)\n"
+         "    -l, --name_length=chars   shortest name, 8 (default)\n"
+         "    -L, --max_name_length=chars\n"
+         "                              longest name, the shortest by "
+         "default\n"
+         "    -s, --file_size=bytes     smallest file, 65536 (default)\n"
+         "    -S, --max_file_size=bytes largest file, the smallest by "
+         "default\n"
+         "    -h, --help                this help menu\n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  SyntheticImageOptions options = {2, 4, 16, 8, 65536, 0, 0};
+  int ch;
+
+  while ((ch = getopt_long(argc, argv, "d:f:n:l:L:s:S:h", long_opts,
+                           NULL)) != -1) {
+    switch (ch) {
+    case 'd':
+      options.depth = atoi(optarg);
+      break;
+    case 'f':
+      options.fanout = atoi(optarg);
+      break;
+    case 'n':
+      options.filesPerDirectory = atoi(optarg);
+      break;
+    case 'l':
+      options.nameLength = atoi(optarg);
+      break;
+    case 'L':
+      options.maxNameLength = atoi(optarg);
+      break;
+    case 's':
+      options.fileSize = strtoul(optarg, NULL, 10);
+      break;
+    case 'S':
+      options.maxFileSize = strtoul(optarg, NULL, 10);
+      break;
+    case 'h':
+      return printHelp();
+    default:
+      return 1;
+    }
+  }
+  if (optind + 1 != argc) {
+    fprintf(stderr, "You need to specify an output file!\n");
+    return 1;
+  }
+
+  SyntheticImage image(options);
+  FILE *const file = fopen(argv[optind], "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "Unable to create %s\n", argv[optind]);
+    return 2;
+  }
+
+  std::vector<char> buf(1024 * 1024);
+  for (uint64_t offset = 0; offset < image.getImageSize();) {
+    const int read = image.read(buf.data(), buf.size(), offset);
+    if (read <= 0 || fwrite(buf.data(), 1, read, file) !=
+                         static_cast<size_t>(read)) {
+      fprintf(stderr, "Unable to write %s\n", argv[optind]);
+      fclose(file);
+      return 2;
+    }
+    offset += read;
+  }
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Unable to write %s\n", argv[optind]);
+    return 2;
+  }
+  printf("%s: %lu files, %lu directories, %llu bytes\n", argv[optind],
+         image.getFilePaths().size(), image.getDirectoryPaths().size(),
+         static_cast<unsigned long long>(image.getImageSize()));
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <benchmark/benchmark.h>
+#include <mutex>
+#include "AsyncLog.h"
+
+// What logging costs every FUSE thread for each read, formatting and
+// flushing each line to a shared file as it happens versus appending a
+// record to the thread's ring for the drainer. Both write to /dev/null, so
+// only the cost on the calling thread and its contention show up. Each
+// thread logs one ring's worth, the rate a drainer can't keep up with only
+// measures dropping.
+
+namespace {
+
+FILE *getSharedFile() {
+  static FILE *const file = fopen("/dev/null", "w");
+  return file;
+}
+
+void logFormatted(FILE *file, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  vfprintf(file, format, ap);
+  fflush(file);
+  va_end(ap);
+}
+
+void BM_FormattedLog(benchmark::State &state) {
+  FILE *const file = getSharedFile();
+  unsigned long offset = 0;
+
+  for (auto _ : state) {
+    logFormatted(file, "ll_read %lu:%lu:%ld\n", 42UL, 131072UL, offset);
+    offset += 131072;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FormattedLog)
+    ->ThreadRange(1, 8)
+    ->Iterations(AsyncLog::RING_SIZE)
+    ->Repetitions(10)
+    ->ReportAggregatesOnly(true)
+    ->UseRealTime();
+
+AsyncLog *asyncLog;
+
+void BM_AsyncLog(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    asyncLog = new AsyncLog();
+    asyncLog->open("/dev/null");
+    asyncLog->start();
+  }
+  int64_t offset = 0;
+
+  for (auto _ : state) {
+    asyncLog->record(AsyncLog::OP_LL_READ, nullptr, 42, offset, 131072);
+    offset += 131072;
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    state.counters["dropped"] = asyncLog->getDropped();
+    delete asyncLog;
+  }
+}
+BENCHMARK(BM_AsyncLog)
+    ->ThreadRange(1, 8)
+    ->Iterations(AsyncLog::RING_SIZE)
+    ->Repetitions(10)
+    ->ReportAggregatesOnly(true)
+    ->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
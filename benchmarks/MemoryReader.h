@@ -0,0 +1,34 @@
+#ifndef __MEMORY_READER__H_
+#define __MEMORY_READER__H_
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "BinaryReader.h"
+
+// Serves reads from an image container built in memory
+class MemoryReader : public BinaryReader {
+private:
+  std::vector<unsigned char> mData;
+
+public:
+  // takes the contents of data
+  explicit MemoryReader(std::vector<unsigned char> *data) {
+    mData.swap(*data);
+  }
+
+  virtual int read(void *buf, int size, size_t offset) {
+    if (offset >= mData.size()) {
+      return 0;
+    }
+    const size_t length = std::min<size_t>(size, mData.size() - offset);
+    memcpy(buf, mData.data() + offset, length);
+    return length;
+  }
+
+  virtual const void *map(size_t offset, size_t size) {
+    return offset + size <= mData.size() ? mData.data() + offset : nullptr;
+  }
+};
+
+#endif
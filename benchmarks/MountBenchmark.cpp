@@ -0,0 +1,120 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "GamecubeIsoFilesystem.h"
+#include "SyntheticImage.h"
+
+// Mounting an image from scratch, reading the disc header and parsing and
+// validating the FST, against mapping the FST index an earlier mount saved.
+// The images are written sparse to $BENCHMARK_DIR, or /tmp, with only what
+// a mount reads, their indexes beside them. With dropped set both are
+// dropped from the page cache before every mount, which only makes a
+// difference on a real disk.
+
+namespace {
+
+struct Fixture {
+  std::string directory;
+  std::string path;
+  size_t entries;
+
+  explicit Fixture(unsigned int fanout) {
+    // 8 to 24 character names, 32 files per directory
+    const SyntheticImageOptions options = {3, fanout, 32, 8, 2048, 24, 0};
+    const char *const env = getenv("BENCHMARK_DIR");
+    SyntheticImage image(options);
+
+    directory = env ? env : "/tmp";
+    path = directory + "/gcdvdfs_mount_benchmark_" + std::to_string(fanout) +
+           ".iso";
+    entries = image.getFilePaths().size() + image.getDirectoryPaths().size();
+
+    std::vector<char> metadata(image.getMetadataSize());
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 ||
+        image.read(metadata.data(), metadata.size(), 0) !=
+            static_cast<int>(metadata.size()) ||
+        write(fd, metadata.data(), metadata.size()) !=
+            static_cast<ssize_t>(metadata.size()) ||
+        ftruncate(fd, image.getImageSize())) {
+      abort();
+    }
+    close(fd);
+
+    // the first mount with an index saves it
+    GamecubeIsoFilesystem filesystem(geteuid(), getegid(), "");
+    filesystem.setIndexDirectory(directory);
+    if (!filesystem.open(path.c_str())) {
+      abort();
+    }
+  }
+
+  ~Fixture() {
+    unlink(getIndexPath().c_str());
+    unlink(path.c_str());
+  }
+
+  std::string getIndexPath() const { return path + ".gcindex"; }
+
+  void dropCache() const {
+    for (const std::string &file : {path, getIndexPath()}) {
+      const int fd = open(file.c_str(), O_RDONLY);
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+  }
+};
+
+Fixture &getFixture(unsigned int fanout) {
+  static std::map<unsigned int, std::unique_ptr<Fixture>> fixtures;
+  std::unique_ptr<Fixture> &fixture = fixtures[fanout];
+  if (!fixture) {
+    fixture.reset(new Fixture(fanout));
+  }
+  return *fixture;
+}
+
+// range(0) is the fanout of the tree, range(1) whether the page cache is
+// dropped before every mount
+void mount(benchmark::State &state, bool indexed) {
+  const Fixture &fixture = getFixture(state.range(0));
+
+  for (auto _ : state) {
+    if (state.range(1)) {
+      state.PauseTiming();
+      fixture.dropCache();
+      state.ResumeTiming();
+    }
+    GamecubeIsoFilesystem filesystem(geteuid(), getegid(), "");
+    if (indexed) {
+      filesystem.setIndexDirectory(fixture.directory);
+    }
+    if (!filesystem.open(fixture.path.c_str())) {
+      state.SkipWithError("unable to open the image");
+      break;
+    }
+    benchmark::DoNotOptimize(filesystem.getFst().getRoot());
+  }
+  state.counters["entries"] = fixture.entries;
+}
+
+void BM_MountParse(benchmark::State &state) { mount(state, false); }
+BENCHMARK(BM_MountParse)
+    ->ArgNames({"fanout", "dropped"})
+    ->ArgsProduct({{4, 8, 16}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_MountIndexed(benchmark::State &state) { mount(state, true); }
+BENCHMARK(BM_MountIndexed)
+    ->ArgNames({"fanout", "dropped"})
+    ->ArgsProduct({{4, 8, 16}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,124 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "GamecubeFilesystemTable.h"
+#include "NameCompare.h"
+#include "SyntheticImage.h"
+
+namespace {
+
+// depth 3, fanout 8 and 33 files per directory gives a 19,890 entry FST
+const SyntheticImageOptions kOptions = {3, 8, 33, 12, 4096, 0, 0};
+
+struct Fixture {
+  SyntheticImage image;
+  GamecubeFilesystemTable fst;
+  std::vector<std::string> upperCasePaths; // none of them match exactly
+
+  Fixture() : image(kOptions) {
+    if (!fst.open(&image)) {
+      abort();
+    }
+    for (std::string path : image.getFilePaths()) {
+      for (char &c : path) {
+        c = toupper(static_cast<unsigned char>(c));
+      }
+      upperCasePaths.push_back(path);
+    }
+  }
+};
+
+Fixture &getFixture() {
+  static Fixture fixture;
+  return fixture;
+}
+
+struct search_data {
+  const GamecubeFilesystemTable *fst;
+  const char *name;
+  const gc_dvdfs_file_entry *found;
+};
+
+int search_callback(const gc_dvdfs_file_entry *pfe, void *param) {
+  search_data *const data = reinterpret_cast<search_data *>(param);
+
+  if (strcmp(data->name, data->fst->getFileName(pfe)) == 0) {
+    data->found = pfe;
+    return -1;
+  }
+  return 0;
+}
+
+// The tokenize and enumerate walk convertPathToInode used to do
+const gc_dvdfs_file_entry *linearLookup(const GamecubeFilesystemTable &fst,
+                                  const char *path) {
+  char *const copy = strdup(path);
+  std::vector<const char *> tokens;
+  char *saveptr;
+
+  for (char *token = strtok_r(copy, "/", &saveptr); token != nullptr;
+       token = strtok_r(nullptr, "/", &saveptr)) {
+    tokens.push_back(token);
+  }
+
+  const gc_dvdfs_file_entry *pfe = fst.getRoot();
+  for (const char *token : tokens) {
+    search_data data = {&fst, token, nullptr};
+    if (pfe->type != FST_DIRECTORY) {
+      pfe = nullptr;
+      break;
+    }
+    fst.enumerate(pfe, search_callback, &data);
+    if ((pfe = data.found) == nullptr) {
+      break;
+    }
+  }
+  free(copy);
+  return pfe;
+}
+
+void BM_LinearLookup(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  const std::vector<std::string> &paths = fixture.image.getFilePaths();
+  size_t i = 0;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(linearLookup(fixture.fst, paths[i].c_str()));
+    i = (i + 1) % paths.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LinearLookup);
+
+void BM_IndexedLookup(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  const std::vector<std::string> &paths = fixture.image.getFilePaths();
+  size_t i = 0;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixture.fst.lookupPath(paths[i].c_str()));
+    i = (i + 1) % paths.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IndexedLookup);
+
+void BM_IgnoringCaseLookup(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  const std::vector<std::string> &paths = fixture.upperCasePaths;
+  size_t i = 0;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fixture.fst.lookupPath(paths[i].c_str(), true));
+    i = (i + 1) % paths.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel(names_kernel());
+}
+BENCHMARK(BM_IgnoringCaseLookup);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "ReadaheadStream.h"
+#include "SyntheticImage.h"
+#include "ThreadPool.h"
+
+// Streams one large file in 128 KiB FUSE sized reads from a backing store
+// with network storage like latency, with and without readahead, and reports
+// the per read latency percentiles the application sees.
+
+namespace {
+
+const size_t kReadSize = 128 * 1024;
+
+// Adds a fixed latency to every read of the wrapped image
+class SlowReader : public BinaryReader {
+private:
+  BinaryReader *mReader;
+  std::chrono::microseconds mLatency;
+
+public:
+  SlowReader(BinaryReader *reader, std::chrono::microseconds latency)
+      : mReader(reader), mLatency(latency) {}
+
+  virtual int read(void *buf, int size, size_t offset) {
+    std::this_thread::sleep_for(mLatency);
+    return mReader->read(buf, size, offset);
+  }
+};
+
+struct Fixture {
+  SyntheticImage image;
+
+  // one 64 MiB file
+  Fixture()
+      : image(SyntheticImageOptions{0, 0, 1, 8, 64 * 1024 * 1024, 0, 0}) {}
+};
+
+Fixture &getFixture() {
+  static Fixture fixture;
+  return fixture;
+}
+
+void reportPercentiles(benchmark::State &state,
+                       std::vector<double> *latencies) {
+  std::sort(latencies->begin(), latencies->end());
+  const auto percentile = [latencies](double p) {
+    return (*latencies)[std::min(latencies->size() - 1,
+                                 static_cast<size_t>(p * latencies->size()))];
+  };
+  state.counters["p50_us"] = percentile(0.50);
+  state.counters["p90_us"] = percentile(0.90);
+  state.counters["p99_us"] = percentile(0.99);
+}
+
+// range(0) is the backing store latency in microseconds, range(1) the
+// largest readahead window in KiB, 0 meaning no readahead
+void BM_SequentialStream(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  SlowReader reader(&fixture.image, std::chrono::microseconds(state.range(0)));
+  // the file is the only one in the image, it starts where the data does
+  const size_t length = 64 * 1024 * 1024;
+  const size_t base = fixture.image.getImageSize() - length;
+  const size_t window = state.range(1) * 1024;
+  std::vector<char> buf(kReadSize);
+  std::vector<double> latencies;
+
+  ThreadPool pool(4);
+  for (auto _ : state) {
+    ReadaheadStream stream(&reader, &pool, base, length, window);
+    for (size_t offset = 0; offset < length; offset += kReadSize) {
+      const auto start = std::chrono::steady_clock::now();
+      if (window > 0) {
+        stream.read(buf.data(), kReadSize, offset);
+      } else {
+        reader.read(buf.data(), kReadSize, base + offset);
+      }
+      latencies.push_back(std::chrono::duration<double, std::micro>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * length);
+  reportPercentiles(state, &latencies);
+}
+BENCHMARK(BM_SequentialStream)
+    ->ArgNames({"latency_us", "window_kib"})
+    ->Args({2000, 0})
+    ->Args({2000, 2048})
+    ->Args({2000, 8192})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
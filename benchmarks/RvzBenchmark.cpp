@@ -0,0 +1,88 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "ContainerWriter.h"
+#include "MemoryReader.h"
+#include "SyntheticImage.h"
+#include "ThreadPool.h"
+#include "WiaBinaryReader.h"
+
+// Compares reads of a synthetic image against the same image compressed to
+// zstd RVZ: random 4 KiB reads and sequential 1 MiB reads.
+
+namespace {
+
+const uint32_t kChunkSize = 128 * 1024;
+
+struct Fixture {
+  SyntheticImage image;
+  ThreadPool pool;
+  WiaBinaryReader rvz;
+
+  // one 64 MiB file
+  Fixture()
+      : image(SyntheticImageOptions{0, 0, 1, 8, 64 * 1024 * 1024, 0, 0}),
+        pool(4), rvz(createContainer(&image), &pool) {
+    if (!rvz.open()) {
+      abort();
+    }
+  }
+
+  static BinaryReader *createContainer(SyntheticImage *image) {
+    std::vector<unsigned char> file =
+        writeWia(image, image->getImageSize(),
+                 WiaBinaryReader::COMPRESSION_ZSTD, true, kChunkSize);
+    return new MemoryReader(&file);
+  }
+
+  BinaryReader *getReader(int rvz) {
+    return rvz ? static_cast<BinaryReader *>(&this->rvz) : &image;
+  }
+};
+
+Fixture &getFixture() {
+  static Fixture fixture;
+  return fixture;
+}
+
+// range(0) selects the raw (0) or RVZ (1) image
+void BM_RandomRead4K(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  BinaryReader *const reader = fixture.getReader(state.range(0));
+  const uint64_t size = fixture.image.getImageSize();
+  std::mt19937_64 random(42);
+  char buf[4096];
+
+  for (auto _ : state) {
+    const uint64_t offset = (random() % (size - sizeof(buf))) & ~4095ULL;
+    benchmark::DoNotOptimize(reader->read(buf, sizeof(buf), offset));
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(buf));
+}
+BENCHMARK(BM_RandomRead4K)->ArgName("rvz")->Arg(0)->Arg(1);
+
+void BM_SequentialRead1M(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  BinaryReader *const reader = fixture.getReader(state.range(0));
+  const uint64_t size = fixture.image.getImageSize();
+  std::vector<char> buf(1024 * 1024);
+  uint64_t offset = 0;
+
+  for (auto _ : state) {
+    if (offset + buf.size() > size) {
+      offset = 0;
+    }
+    benchmark::DoNotOptimize(reader->read(buf.data(), buf.size(), offset));
+    offset += buf.size();
+  }
+  state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_SequentialRead1M)
+    ->ArgName("rvz")
+    ->Arg(0)
+    ->Arg(1)
+    ->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
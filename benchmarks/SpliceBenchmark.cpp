@@ -0,0 +1,105 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <vector>
+
+// Compares the two ways a FUSE read reply can reach the kernel: copying the
+// data through a user buffer, which is what read does, or splicing it from
+// the image descriptor through a pipe, which is what read_buf lets libfuse do.
+// The pipe is drained into /dev/null the same way for both.
+
+namespace {
+
+const size_t kImageSize = 256 * 1024 * 1024;
+
+struct Fixture {
+  int image;
+  int sink;
+  int pipe[2];
+
+  Fixture() {
+    char path[] = "/tmp/gcdvdfs_splice_XXXXXX";
+    std::vector<char> chunk(1024 * 1024, 0x5a);
+
+    if ((image = mkstemp(path)) < 0) {
+      abort();
+    }
+    unlink(path);
+    for (size_t done = 0; done < kImageSize; done += chunk.size()) {
+      if (write(image, chunk.data(), chunk.size()) !=
+          static_cast<ssize_t>(chunk.size())) {
+        abort();
+      }
+    }
+    if ((sink = open("/dev/null", O_WRONLY)) < 0 || pipe2(pipe, 0) != 0) {
+      abort();
+    }
+    // the FUSE channel pipe is sized for the largest reply
+    fcntl(pipe[1], F_SETPIPE_SZ, 1024 * 1024);
+  }
+};
+
+Fixture &getFixture() {
+  static Fixture fixture;
+  return fixture;
+}
+
+void drain(Fixture &fixture, size_t length) {
+  while (length > 0) {
+    const ssize_t moved = splice(fixture.pipe[0], nullptr, fixture.sink,
+                                 nullptr, length, SPLICE_F_MOVE);
+    if (moved <= 0) {
+      abort();
+    }
+    length -= moved;
+  }
+}
+
+void BM_CopyRead(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  const size_t size = state.range(0);
+  std::vector<char> buf(size);
+  off_t offset = 0;
+
+  for (auto _ : state) {
+    if (pread(fixture.image, buf.data(), size, offset) !=
+            static_cast<ssize_t>(size) ||
+        write(fixture.pipe[1], buf.data(), size) !=
+            static_cast<ssize_t>(size)) {
+      abort();
+    }
+    drain(fixture, size);
+    offset = (offset + size) % kImageSize;
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_CopyRead)->Arg(128 * 1024)->Arg(1024 * 1024);
+
+void BM_SpliceRead(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  const size_t size = state.range(0);
+  off_t offset = 0;
+
+  for (auto _ : state) {
+    loff_t position = offset;
+    size_t left = size;
+    while (left > 0) {
+      const ssize_t moved = splice(fixture.image, &position, fixture.pipe[1],
+                                   nullptr, left, SPLICE_F_MOVE);
+      if (moved <= 0) {
+        abort();
+      }
+      left -= moved;
+    }
+    drain(fixture, size);
+    offset = (offset + size) % kImageSize;
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_SpliceRead)->Arg(128 * 1024)->Arg(1024 * 1024);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "GamecubeFilesystemTable.h"
+#include "SyntheticImage.h"
+
+#define DOL_OFFSET 0x8000
+#define DOL_BODY_SIZE 0x10000
+#define FST_START (DOL_OFFSET + DOL_BODY_SIZE)
+#define FILE_ALIGNMENT 32
+
+namespace {
+
+struct PendingEntry {
+  uint8_t type;
+  uint32_t nameOffset;
+  uint32_t first;
+  uint32_t second;
+};
+
+class FstBuilder {
+public:
+  FstBuilder(const SyntheticImageOptions &options,
+             std::vector<std::string> *filePaths,
+             std::vector<std::string> *directoryPaths)
+      : mOptions(options), mFilePaths(filePaths),
+        mDirectoryPaths(directoryPaths), mDataOffset(0) {}
+
+  void build(uint32_t dataOffset) {
+    mDataOffset = dataOffset;
+    mEntries.push_back(PendingEntry{FST_DIRECTORY, addName(""), 0, 0});
+    addDirectory(0, 0, "");
+    mEntries[0].second = mEntries.size();
+  }
+
+  uint32_t getDataEnd() const { return mDataOffset; }
+
+  void serialize(std::vector<unsigned char> *out) const {
+    out->resize(mEntries.size() * sizeof(gc_dvdfs_file_entry) +
+                mNames.size());
+    gc_dvdfs_file_entry *pfe =
+        reinterpret_cast<gc_dvdfs_file_entry *>(out->data());
+    for (const PendingEntry &entry : mEntries) {
+      pfe->type = entry.type;
+      pfe->offset_filename = entry.nameOffset;
+      pfe->file.offset = entry.first;
+      pfe->file.length = entry.second;
+      ++pfe;
+    }
+    memcpy(pfe, mNames.data(), mNames.size());
+  }
+
+private:
+  uint32_t addName(const std::string &name) {
+    const uint32_t offset = mNames.size();
+    mNames.insert(mNames.end(), name.begin(), name.end());
+    mNames.push_back('\0');
+    return offset;
+  }
+
+  // the same image every time, but sizes and lengths spread out
+  uint32_t vary(uint32_t min, uint32_t max) const {
+    if (max <= min) {
+      return min;
+    }
+    const uint32_t hash = (mEntries.size() + 1) * 2654435761u;
+    return min + (hash >> 8) % (max - min + 1);
+  }
+
+  std::string makeName(char prefix, unsigned int n) const {
+    std::string name = prefix + std::to_string(n);
+    const unsigned int length =
+        vary(mOptions.nameLength, mOptions.maxNameLength);
+    if (name.size() < length) {
+      name.append(length - name.size(), '_');
+    }
+    return name;
+  }
+
+  void addDirectory(uint32_t self, unsigned int level,
+                    const std::string &prefix) {
+    unsigned int i;
+
+    for (i = 0; i < mOptions.filesPerDirectory; ++i) {
+      const std::string name = makeName('f', i);
+      const uint32_t size = vary(mOptions.fileSize, mOptions.maxFileSize);
+      mEntries.push_back(
+          PendingEntry{FST_FILE, addName(name), mDataOffset, size});
+      mFilePaths->push_back(prefix + name);
+      mDataOffset += (size + FILE_ALIGNMENT - 1) & ~(FILE_ALIGNMENT - 1);
+    }
+
+    if (level >= mOptions.depth) {
+      return;
+    }
+
+    for (i = 0; i < mOptions.fanout; ++i) {
+      const std::string name = makeName('d', i);
+      const uint32_t index = mEntries.size();
+      mEntries.push_back(PendingEntry{FST_DIRECTORY, addName(name), self, 0});
+      mDirectoryPaths->push_back(prefix + name);
+      addDirectory(index, level + 1, prefix + name + "/");
+      mEntries[index].second = mEntries.size();
+    }
+  }
+
+  const SyntheticImageOptions &mOptions;
+  std::vector<std::string> *mFilePaths;
+  std::vector<std::string> *mDirectoryPaths;
+  std::vector<PendingEntry> mEntries;
+  std::vector<char> mNames;
+  uint32_t mDataOffset;
+};
+
+struct Pattern {
+  unsigned char bytes[65536];
+
+  Pattern() {
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+      bytes[i] = static_cast<unsigned char>((i * 2654435761u) >> 24);
+    }
+  }
+};
+
+// readers may be called from several threads, let the compiler guard the
+// one time initialization
+const unsigned char *getPattern() {
+  static const Pattern pattern;
+  return pattern.bytes;
+}
+
+} // namespace
+
+SyntheticImage::SyntheticImage(const SyntheticImageOptions &options)
+    : mImageSize(0) {
+  FstBuilder builder(options, &mFilePaths, &mDirectoryPaths);
+  std::vector<unsigned char> fst;
+
+  // the FST size is only known after building, so build twice: once to size
+  // it and once with the real data offset that follows it
+  builder.build(0);
+  builder.serialize(&fst);
+  const uint32_t dataStart =
+      (FST_START + fst.size() + GC_DVD_SECTOR_SIZE - 1) &
+      ~(GC_DVD_SECTOR_SIZE - 1);
+
+  mFilePaths.clear();
+  mDirectoryPaths.clear();
+  FstBuilder finalBuilder(options, &mFilePaths, &mDirectoryPaths);
+  finalBuilder.build(dataStart);
+  finalBuilder.serialize(&fst);
+  mImageSize = finalBuilder.getDataEnd();
+
+  mMetadata.assign(FST_START + fst.size(), 0);
+  memcpy(&mMetadata[FST_START], fst.data(), fst.size());
+
+  gc_dvdfs_disc_header *const dh =
+      reinterpret_cast<gc_dvdfs_disc_header *>(mMetadata.data());
+  memcpy(&dh->game_code, "GSYN", 4);
+  memcpy(&dh->maker_code, "01", 2);
+  dh->gc_magic = GC_DISC_MAGIC;
+  snprintf(reinterpret_cast<char *>(dh->game_name), sizeof(dh->game_name),
+           "Synthetic benchmark image");
+  dh->offset_bootfile = DOL_OFFSET;
+  dh->offset_fst = FST_START;
+  dh->fst_size = fst.size();
+  dh->max_fst_size = fst.size();
+
+  gc_dvdfs_apploader *const apploader =
+      reinterpret_cast<gc_dvdfs_apploader *>(&mMetadata[APPLOADER_OFFSET]);
+  memcpy(apploader->version, "2001/11/18", sizeof(apploader->version));
+  apploader->entry_point = 0x81200000;
+  apploader->size = 0x1000;
+
+  gc_dvdfs_dol_header *const dol =
+      reinterpret_cast<gc_dvdfs_dol_header *>(&mMetadata[DOL_OFFSET]);
+  dol->text_file_pos[0] = 0x100;
+  dol->text_mem_pos[0] = 0x80003100;
+  dol->text_section_size[0] = DOL_BODY_SIZE - 0x100;
+  dol->entry_point = 0x80003100;
+}
+
+int SyntheticImage::read(void *buf, int size, size_t offset) {
+  unsigned char *out = reinterpret_cast<unsigned char *>(buf);
+  const unsigned char *const pattern = getPattern();
+
+  if (size <= 0 || offset >= mImageSize) {
+    return 0;
+  }
+  size = std::min<uint64_t>(size, mImageSize - offset);
+
+  int done = 0;
+  while (done < size) {
+    const size_t position = offset + done;
+    int chunk;
+    if (position < mMetadata.size()) {
+      chunk = std::min<size_t>(size - done, mMetadata.size() - position);
+      memcpy(out + done, &mMetadata[position], chunk);
+    } else {
+      const size_t patternOffset = position % 65536;
+      chunk = std::min<size_t>(size - done, 65536 - patternOffset);
+      memcpy(out + done, pattern + patternOffset, chunk);
+    }
+    done += chunk;
+  }
+  return done;
+}
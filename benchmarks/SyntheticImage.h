@@ -0,0 +1,45 @@
+#ifndef __SYNTHETIC_IMAGE__H_
+#define __SYNTHETIC_IMAGE__H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "BinaryReader.h"
+
+struct SyntheticImageOptions {
+  unsigned int depth;             // directory levels below data/
+  unsigned int fanout;            // subdirectories per directory
+  unsigned int filesPerDirectory; // files per directory
+  unsigned int nameLength;        // minimum file name length
+  uint32_t fileSize;              // size of every file
+  // when above nameLength and fileSize, names and sizes vary up to these
+  unsigned int maxNameLength;
+  uint32_t maxFileSize;
+};
+
+// Builds a valid Gamecube image in memory: disc header, apploader, DOL
+// header and an FST shaped by SyntheticImageOptions. Only the metadata is
+// stored, file contents are generated on the fly from a fixed pattern.
+class SyntheticImage : public BinaryReader {
+private:
+  std::vector<unsigned char> mMetadata;
+  std::vector<std::string> mFilePaths;
+  std::vector<std::string> mDirectoryPaths;
+  uint64_t mImageSize;
+
+public:
+  explicit SyntheticImage(const SyntheticImageOptions &options);
+
+  // paths are relative to data/, e.g. "d0/d3/f12"
+  const std::vector<std::string> &getFilePaths() const { return mFilePaths; }
+  const std::vector<std::string> &getDirectoryPaths() const {
+    return mDirectoryPaths;
+  }
+  uint64_t getImageSize() const { return mImageSize; }
+  // everything before the first file, all a mount reads
+  uint64_t getMetadataSize() const { return mMetadata.size(); }
+
+  virtual int read(void *buf, int size, size_t offset);
+};
+
+#endif
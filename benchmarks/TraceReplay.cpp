@@ -0,0 +1,519 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "GamecubeIsoFilesystem.h"
+
+// Replays a trace recorded with gcdvdfs --trace against an image, calling the
+// path based handlers in-process like filesystem_benchmark does. Replaying
+// the same trace with different reader, cache or readahead settings compares
+// them on a real workload without a mount in the way.
+//
+// The inode based operations need a fuse request to reply to, so they're
+// replayed through their path based counterparts, inodes are turned back into
+// paths through the FST.
+
+namespace {
+
+const struct option long_opts[] = {
+    {"reader", required_argument, NULL, 'r'},
+    {"cache_size", required_argument, NULL, 'c'},
+    {"readahead", required_argument, NULL, 'a'},
+    {"disc", required_argument, NULL, 'd'},
+    {"timing", no_argument, NULL, 'T'},
+    {"serial", no_argument, NULL, 's'},
+    {"help", no_argument, NULL, 'h'},
+    {0, 0, 0, 0},
+};
+
+int printHelp() {
+  printf("Replays a gcdvdfs operation trace against an image\n\n"
+         "trace_replay [options] image trace\n\n"
+         "    -r, --reader=type         how to read the ISO, file (default), "
+         "mmap or uring\n"
+         "    -c, --cache_size=MiB      block cache size, 0 (default) "
+         "disables it\n"
+         "    -a, --readahead=MiB       largest readahead window per open "
+         "file, 0 (default) disables it\n"
+         "    -d, --disc=disc           disc of a WBFS container, its index "
+         "or game id\n"
+         "    -T, --timing              keep the recorded gaps between "
+         "operations instead of\n"
+         "                              replaying back to back\n"
+         "    -s, --serial              replay every operation from one "
+         "thread instead of one\n"
+         "                              thread per recorded thread\n"
+         "    -h, --help                this help menu\n");
+  return 0;
+}
+
+enum slot_state { SLOT_PENDING, SLOT_OPEN, SLOT_FAILED };
+
+// one file open of the trace, recorded handles are pointers that get reused
+// once released, so every open gets a slot of its own
+struct Slot {
+  struct fuse_file_info fi;
+  slot_state state;
+  unsigned int uses; // operations on the file besides open and release
+  unsigned int done;
+};
+
+struct Operation {
+  struct trace_record record;
+  std::string path;
+  int slot; // -1 if the operation doesn't refer to an open file
+};
+
+struct Sample {
+  uint16_t op;
+  uint64_t nanoseconds;
+};
+
+struct Replay {
+  GamecubeIsoFilesystem *filesystem;
+  std::vector<Operation> operations;
+  std::vector<Slot> slots;
+  std::mutex lock;
+  std::condition_variable changed;
+  bool timing;
+  std::chrono::steady_clock::time_point start;
+};
+
+// how many bytes of reply are left, to replay paged inode based readdirs
+// through the path based one
+struct ReaddirBudget {
+  size_t size; // 0 for no limit
+  size_t used;
+};
+
+uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool isOpen(uint16_t op) { return op == TRACE_OPEN || op == TRACE_LL_OPEN; }
+
+bool isRelease(uint16_t op) {
+  return op == TRACE_RELEASE || op == TRACE_LL_RELEASE;
+}
+
+// operations that need the file opened in the trace
+bool usesHandle(uint16_t op) {
+  return op == TRACE_FGETATTR || op == TRACE_READ || op == TRACE_READ_BUF ||
+         op == TRACE_LL_READ || isRelease(op);
+}
+
+std::string childPath(const std::string &parent, const char *name) {
+  return parent == "/" ? parent + name : parent + "/" + name;
+}
+
+// the path of every inode of the image, indexed by inode
+void buildPaths(const GamecubeFilesystemTable &fst,
+                std::vector<std::string> *paths) {
+  const gc_dvdfs_file_entry *const root = fst.getRoot();
+  std::vector<std::pair<uint32_t, std::string>> directories;
+
+  paths->resize(GamecubeIsoFilesystem::DATA_INO + fst.getEntryCount());
+  (*paths)[GamecubeIsoFilesystem::ROOT_INO] = "/";
+  (*paths)[GamecubeIsoFilesystem::APPLOADER_INO] = "/apploader";
+  (*paths)[GamecubeIsoFilesystem::BOOTDOL_INO] = "/boot.dol";
+  (*paths)[GamecubeIsoFilesystem::STATS_INO] = "/.stats";
+  (*paths)[GamecubeIsoFilesystem::VERIFY_INO] = "/.verify";
+  (*paths)[GamecubeIsoFilesystem::DATA_INO] = "/data";
+
+  // a directory's entries follow it up to the index getNext gives
+  directories.push_back(std::make_pair(fst.getEntryCount(), "/data"));
+  for (uint32_t i = 1; i < fst.getEntryCount(); ++i) {
+    const gc_dvdfs_file_entry *const pfe = root + i;
+    while (directories.size() > 1 && i >= directories.back().first) {
+      directories.pop_back();
+    }
+    const std::string path =
+        childPath(directories.back().second, fst.getFileName(pfe));
+    (*paths)[i + GamecubeIsoFilesystem::DATA_INO] = path;
+    if (fst.isDirectory(pfe)) {
+      directories.push_back(std::make_pair(fst.getNext(pfe), path));
+    }
+  }
+}
+
+bool loadTrace(const char *tracePath, const GamecubeFilesystemTable &fst,
+               Replay *replay, size_t *skipped) {
+  FILE *const file = fopen(tracePath, "rb");
+  struct trace_header header;
+  std::vector<std::string> paths;
+  std::unordered_map<uint64_t, int> openHandles;
+
+  if (file == nullptr) {
+    fprintf(stderr, "Unable to open %s\n", tracePath);
+    return false;
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) ||
+      header.version != TRACE_VERSION) {
+    fprintf(stderr, "%s isn't a trace\n", tracePath);
+    fclose(file);
+    return false;
+  }
+
+  Operation operation;
+  std::vector<char> name;
+  while (fread(&operation.record, sizeof(operation.record), 1, file) == 1) {
+    name.resize(operation.record.name_length);
+    if (!name.empty() && fread(name.data(), name.size(), 1, file) != 1) {
+      break;
+    }
+    operation.path.assign(name.begin(), name.end());
+    operation.slot = -1;
+    replay->operations.push_back(operation);
+  }
+  fclose(file);
+
+  // threads wrote their buffers out whenever they filled up
+  std::stable_sort(replay->operations.begin(), replay->operations.end(),
+                   [](const Operation &a, const Operation &b) {
+                     return a.record.timestamp < b.record.timestamp;
+                   });
+
+  buildPaths(fst, &paths);
+  *skipped = 0;
+  std::vector<Operation> operations;
+  for (Operation &operation : replay->operations) {
+    const trace_record &record = operation.record;
+    // from a damaged trace or a newer recorder, there's nothing to replay
+    if (record.op == 0 || record.op >= TRACE_OP_COUNT) {
+      ++*skipped;
+      continue;
+    }
+    if (record.op >= TRACE_LL_LOOKUP) {
+      if (record.inode >= paths.size() || paths[record.inode].empty()) {
+        ++*skipped;
+        continue;
+      }
+      const std::string &path = paths[record.inode];
+      operation.path = record.op == TRACE_LL_LOOKUP
+                           ? childPath(path, operation.path.c_str())
+                           : path;
+    }
+
+    if (isOpen(record.op)) {
+      operation.slot = replay->slots.size();
+      openHandles[record.handle] = operation.slot;
+      replay->slots.push_back(Slot());
+    } else if (usesHandle(record.op)) {
+      const auto handle = openHandles.find(record.handle);
+      if (handle == openHandles.end()) {
+        // opened before the recording started
+        ++*skipped;
+        continue;
+      }
+      operation.slot = handle->second;
+      if (isRelease(record.op)) {
+        openHandles.erase(handle);
+      } else {
+        ++replay->slots[operation.slot].uses;
+      }
+    }
+    operations.push_back(operation);
+  }
+  replay->operations.swap(operations);
+
+  for (Slot &slot : replay->slots) {
+    memset(&slot.fi, 0, sizeof(slot.fi));
+    slot.state = SLOT_PENDING;
+    slot.done = 0;
+  }
+  return true;
+}
+
+int readdir_filler(void *buf, const char *name, const struct stat *statbuf,
+                   off_t offset) {
+  ReaddirBudget *const budget = reinterpret_cast<ReaddirBudget *>(buf);
+
+  // about what fuse_add_direntry takes up
+  const size_t length = (24 + strlen(name) + 7) & ~7;
+  if (budget->size > 0 && budget->used + length > budget->size) {
+    return 1;
+  }
+  budget->used += length;
+  return 0;
+}
+
+// Waits until the file the operation works on is open, and for releases
+// until every other thread is done with it. Returns false if the open
+// failed and the operation can't be replayed.
+bool waitForFile(Replay *replay, const Operation &operation) {
+  if (operation.slot < 0 || isOpen(operation.record.op)) {
+    return true;
+  }
+  Slot *const slot = &replay->slots[operation.slot];
+  const bool release = isRelease(operation.record.op);
+  std::unique_lock<std::mutex> guard(replay->lock);
+  replay->changed.wait(guard, [slot, release] {
+    return slot->state != SLOT_PENDING &&
+           (!release || slot->done == slot->uses);
+  });
+  return slot->state == SLOT_OPEN;
+}
+
+void finishUse(Replay *replay, int slot) {
+  std::lock_guard<std::mutex> guard(replay->lock);
+  ++replay->slots[slot].done;
+  replay->changed.notify_all();
+}
+
+// replays one operation once its file is open, returns the bytes read
+uint64_t replayOperation(Replay *replay, const Operation &operation,
+                         std::vector<char> *scratch) {
+  GamecubeIsoFilesystem *const filesystem = replay->filesystem;
+  const trace_record &record = operation.record;
+  const char *const path = operation.path.c_str();
+  Slot *const slot =
+      operation.slot >= 0 ? &replay->slots[operation.slot] : nullptr;
+  struct fuse_file_info fi;
+  struct stat statbuf;
+  uint64_t bytes = 0;
+
+  memset(&fi, 0, sizeof(fi));
+  switch (record.op) {
+  case TRACE_STATFS: {
+    struct statvfs sfs;
+    filesystem->statfs(path, &sfs);
+    break;
+  }
+  case TRACE_GETATTR:
+  case TRACE_LL_LOOKUP:
+  case TRACE_LL_GETATTR:
+    filesystem->getattr(path, &statbuf);
+    break;
+  case TRACE_OPENDIR:
+  case TRACE_LL_OPENDIR:
+    filesystem->opendir(path, &fi);
+    break;
+  case TRACE_RELEASEDIR:
+  case TRACE_LL_RELEASEDIR:
+    fi.fh = record.inode;
+    filesystem->releasedir(path, &fi);
+    break;
+  case TRACE_READDIR:
+  case TRACE_LL_READDIR: {
+    // both take the offsets handed out by the entries before
+    ReaddirBudget budget = {record.size, 0};
+    fi.fh = record.inode;
+    filesystem->readdir(path, &budget, readdir_filler, record.offset, &fi);
+    break;
+  }
+  case TRACE_OPEN:
+  case TRACE_LL_OPEN: {
+    const int ret = filesystem->open(path, &slot->fi);
+    std::lock_guard<std::mutex> guard(replay->lock);
+    slot->state = ret ? SLOT_FAILED : SLOT_OPEN;
+    replay->changed.notify_all();
+    break;
+  }
+  case TRACE_RELEASE:
+  case TRACE_LL_RELEASE:
+    filesystem->release(path, &slot->fi);
+    break;
+  case TRACE_FGETATTR:
+    filesystem->fgetattr(path, &statbuf, &slot->fi);
+    break;
+  case TRACE_READ:
+  case TRACE_LL_READ: {
+    scratch->resize(std::max<size_t>(scratch->size(), record.size));
+    const int read = filesystem->read(path, scratch->data(), record.size,
+                                      record.offset, &slot->fi);
+    bytes = std::max(read, 0);
+    break;
+  }
+  case TRACE_READ_BUF: {
+    struct fuse_bufvec *bufv;
+    if (filesystem->read_buf(path, &bufv, record.size, record.offset,
+                             &slot->fi)) {
+      break;
+    }
+    // copy what fuse would have spliced to the kernel
+    for (size_t i = 0; i < bufv->count; ++i) {
+      struct fuse_buf &buf = bufv->buf[i];
+      if (buf.flags & FUSE_BUF_IS_FD) {
+        scratch->resize(std::max(scratch->size(), buf.size));
+        const ssize_t read = pread(buf.fd, scratch->data(), buf.size, buf.pos);
+        bytes += std::max<ssize_t>(read, 0);
+      } else {
+        bytes += buf.size;
+        free(buf.mem);
+      }
+    }
+    free(bufv);
+    break;
+  }
+  }
+  return bytes;
+}
+
+void replayThread(Replay *replay, const std::vector<size_t> *indices,
+                  std::vector<Sample> *samples, uint64_t *bytes) {
+  std::vector<char> scratch;
+
+  for (size_t index : *indices) {
+    const Operation &operation = replay->operations[index];
+    if (replay->timing) {
+      std::this_thread::sleep_until(
+          replay->start +
+          std::chrono::nanoseconds(operation.record.timestamp));
+    }
+    // waiting on the other threads isn't timed
+    if (waitForFile(replay, operation)) {
+      const uint64_t start = now();
+      *bytes += replayOperation(replay, operation, &scratch);
+      samples->push_back({operation.record.op, now() - start});
+    }
+    if (operation.slot >= 0 && usesHandle(operation.record.op) &&
+        !isRelease(operation.record.op)) {
+      finishUse(replay, operation.slot);
+    }
+  }
+}
+
+double percentile(const std::vector<uint64_t> &sorted, double fraction) {
+  const size_t index = std::min<size_t>(sorted.size() * fraction,
+                                        sorted.size() - 1);
+  return sorted[index] / 1e3;
+}
+
+void printReport(size_t skipped, double seconds,
+                 const std::vector<std::vector<Sample>> &samples,
+                 uint64_t bytes) {
+  std::vector<std::vector<uint64_t>> latencies(TRACE_OP_COUNT);
+  size_t replayed = 0;
+
+  for (const std::vector<Sample> &thread : samples) {
+    for (const Sample &sample : thread) {
+      latencies[sample.op].push_back(sample.nanoseconds);
+    }
+    replayed += thread.size();
+  }
+
+  printf("replayed %zu operations in %.3f s, %.0f ops/s, %.1f MiB read, "
+         "%.1f MiB/s\n",
+         replayed, seconds, replayed / seconds, bytes / 1048576.0,
+         bytes / 1048576.0 / seconds);
+  if (skipped > 0) {
+    printf("skipped %zu operations on files opened before the recording "
+           "started, unknown inodes or unknown ops\n",
+           skipped);
+  }
+  printf("\n%-14s %10s %10s %10s %10s\n", "op", "count", "p50 us", "p99 us",
+         "max us");
+  for (unsigned int op = 0; op < TRACE_OP_COUNT; ++op) {
+    std::vector<uint64_t> &sorted = latencies[op];
+    if (sorted.empty()) {
+      continue;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    printf("%-14s %10zu %10.1f %10.1f %10.1f\n",
+           TraceRecorder::getName(static_cast<trace_op>(op)), sorted.size(),
+           percentile(sorted, 0.5), percentile(sorted, 0.99),
+           sorted.back() / 1e3);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  GamecubeIsoFilesystem filesystem(geteuid(), getegid(), "");
+  Replay replay;
+  bool serial = false;
+  int ch;
+
+  replay.filesystem = &filesystem;
+  replay.timing = false;
+  while ((ch = getopt_long(argc, argv, "r:c:a:d:Tsh", long_opts, NULL)) !=
+         -1) {
+    switch (ch) {
+    case 'r': {
+      GamecubeIsoFilesystem::ReaderType readerType;
+      if (!GamecubeIsoFilesystem::parseReaderType(optarg, &readerType)) {
+        fprintf(stderr, "Unknown reader %s\n", optarg);
+        return 1;
+      }
+      filesystem.setReaderType(readerType);
+      break;
+    }
+    case 'c':
+      filesystem.setCacheSize(strtoull(optarg, NULL, 10) * 1024 * 1024);
+      break;
+    case 'a':
+      filesystem.setReadaheadSize(strtoull(optarg, NULL, 10) * 1024 * 1024);
+      break;
+    case 'd':
+      filesystem.setDisc(optarg);
+      break;
+    case 'T':
+      replay.timing = true;
+      break;
+    case 's':
+      serial = true;
+      break;
+    case 'h':
+      return printHelp();
+    default:
+      return 1;
+    }
+  }
+  if (optind + 2 != argc) {
+    fprintf(stderr, "You need to specify an image and a trace!\n");
+    return 1;
+  }
+
+  if (!filesystem.open(argv[optind])) {
+    fprintf(stderr, "Unable to open %s\n", argv[optind]);
+    return 1;
+  }
+  size_t skipped;
+  if (!loadTrace(argv[optind + 1], filesystem.getFst(), &replay, &skipped)) {
+    return 1;
+  }
+
+  // one list of operations per replaying thread
+  std::vector<std::vector<size_t>> threads;
+  for (size_t i = 0; i < replay.operations.size(); ++i) {
+    const size_t thread = serial ? 0 : replay.operations[i].record.thread;
+    if (thread >= threads.size()) {
+      threads.resize(thread + 1);
+    }
+    threads[thread].push_back(i);
+  }
+
+  std::vector<std::vector<Sample>> samples(threads.size());
+  std::vector<uint64_t> bytes(threads.size());
+  std::vector<std::thread> workers;
+  replay.start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    workers.emplace_back(replayThread, &replay, &threads[i], &samples[i],
+                         &bytes[i]);
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - replay.start)
+                             .count();
+
+  uint64_t total = 0;
+  for (uint64_t thread : bytes) {
+    total += thread;
+  }
+  printReport(skipped, seconds, samples, total);
+  return 0;
+}
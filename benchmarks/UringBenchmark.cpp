@@ -0,0 +1,104 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "UringBinaryReader.h"
+
+// Random 4 KiB reads issued as batches of increasing size, through pread one
+// at a time and through io_uring all at once. The file is written to
+// $BENCHMARK_FILE, or a temporary file, and dropped from the page cache
+// before every run, so on NVMe this shows how throughput scales with queue
+// depth; on a page cache only filesystem it shows the system call savings.
+
+namespace {
+
+const size_t kFileSize = 1024ULL * 1024 * 1024;
+const size_t kReadSize = 4096;
+
+struct Fixture {
+  std::string path;
+
+  Fixture() {
+    const char *const env = getenv("BENCHMARK_FILE");
+    path = env ? env : "/tmp/gcdvdfs_uring_benchmark";
+
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    std::vector<char> chunk(1024 * 1024);
+    std::mt19937 random(42);
+    for (char &c : chunk) {
+      c = random();
+    }
+    for (size_t written = 0; written < kFileSize; written += chunk.size()) {
+      if (write(fd, chunk.data(), chunk.size()) < 0) {
+        abort();
+      }
+    }
+    fsync(fd);
+    close(fd);
+  }
+
+  ~Fixture() { unlink(path.c_str()); }
+
+  void dropCache() const {
+    const int fd = open(path.c_str(), O_RDONLY);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+};
+
+Fixture &getFixture() {
+  static Fixture fixture;
+  return fixture;
+}
+
+// range(0) selects pread (0), io_uring (1), io_uring with registered
+// buffers (2) or io_uring with a kernel thread polling submissions (3),
+// range(1) is the number of reads in flight
+void BM_RandomReadBatch(benchmark::State &state) {
+  Fixture &fixture = getFixture();
+  const size_t depth = state.range(1);
+  BinaryFILEReader file;
+  UringBinaryReader uring(UringBinaryReader::Options{
+      static_cast<unsigned int>(depth), state.range(0) == 3,
+      state.range(0) == 2});
+  BinaryReader *reader = &file;
+
+  if (state.range(0) == 0) {
+    file.open(fixture.path.c_str());
+  } else {
+    uring.open(fixture.path.c_str());
+    if (!uring.isAvailable()) {
+      // it would quietly measure pread instead
+      state.SkipWithError("io_uring is unavailable");
+      return;
+    }
+    reader = &uring;
+  }
+  reader->advise(0, kFileSize, BinaryReader::ADVICE_RANDOM);
+  fixture.dropCache();
+
+  std::vector<char> buffers(depth * kReadSize);
+  std::vector<BinaryReader::Request> requests(depth);
+  std::mt19937_64 random(depth);
+  for (auto _ : state) {
+    for (size_t i = 0; i < depth; ++i) {
+      requests[i].buf = &buffers[i * kReadSize];
+      requests[i].size = kReadSize;
+      requests[i].offset = (random() % (kFileSize / kReadSize)) * kReadSize;
+    }
+    reader->readBatch(requests.data(), depth);
+  }
+  state.SetBytesProcessed(state.iterations() * depth * kReadSize);
+  state.SetItemsProcessed(state.iterations() * depth);
+}
+BENCHMARK(BM_RandomReadBatch)
+    ->ArgNames({"uring", "depth"})
+    ->ArgsProduct({{0, 1, 2, 3}, {1, 4, 16, 64}})
+    ->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,419 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GamecubeIsoFilesystem.h"
+
+using namespace std;
+
+// Extracts the data/ tree of an image to a directory without going through a
+// mount. Files are sorted by where they are on the disc and split between the
+// threads in contiguous runs, so each thread reads its part of the image
+// front to back, and threads that run out steal from the back of the others.
+// Plain images are copied inside the kernel with copy_file_range or
+// sendfile, everything else is read through the image's reader.
+
+static const struct option long_opts[] = {
+    {"reader", required_argument, NULL, 'r'},
+    {"disc", required_argument, NULL, 'd'},
+    {"threads", required_argument, NULL, 'j'},
+    {"help", no_argument, NULL, 'h'},
+    {0, 0, 0, 0},
+};
+
+static int printHelp() {
+  printf("Extracts the files of a Gamecube ISO file\n\n"
+         "gcextract [options] iso output_directory\n\n"
+         "    -r, --reader=type         how to read the ISO, file (default), "
+         "mmap or uring\n"
+         "    -d, --disc=disc           disc of a WBFS container to extract, "
+         "its index or game id\n"
+         "    -j, --threads=threads     copying threads, one per core "
+         "(default)\n"
+         "    -h, --help                this help menu\n");
+  return 0;
+}
+
+// a piece of a file to copy, big files are split so they can be shared out
+struct extract_task {
+  uint64_t image_offset; // of the file
+  uint32_t file_length;
+  uint32_t offset; // of the piece within the file
+  uint32_t length;
+  size_t file; // index into Extractor::mFiles
+};
+
+// where a file goes, created relative to its directory so that nothing on
+// the disc or in the output can lead it out of the output directory
+struct extract_file {
+  int dir; // one of Extractor::mDirs
+  std::string name;
+  std::string path; // for messages
+};
+
+class Extractor {
+public:
+  // largest piece of a file one task copies
+  static const uint32_t TASK_SIZE = 64 * 1024 * 1024;
+  static const size_t BUFFER_SIZE = 1024 * 1024;
+
+private:
+  enum CopyMethod { COPY_FILE_RANGE, COPY_SENDFILE, COPY_READ };
+
+  struct Queue {
+    std::mutex lock;
+    std::deque<extract_task> tasks;
+  };
+
+  const GamecubeFilesystemTable &mFst;
+  BinaryReader *mReader;
+  const int mImageFd;
+  std::vector<int> mDirs;
+  std::vector<extract_file> mFiles;
+  std::vector<extract_task> mTasks;
+  std::vector<Queue> mQueues;
+  std::atomic<int> mMethod;
+  std::atomic<uint64_t> mBytes;
+  std::atomic<bool> mFailed;
+
+public:
+  Extractor(const GamecubeFilesystemTable &fst, BinaryReader *reader)
+      : mFst(fst), mReader(reader), mImageFd(reader->getFileDescriptor()),
+        mMethod(mImageFd >= 0 ? COPY_FILE_RANGE : COPY_READ), mBytes(0),
+        mFailed(false) {}
+  ~Extractor();
+
+  // creates the directories under output and queues up every file
+  bool prepare(const std::string &output);
+  // copies everything on the given number of threads
+  bool run(unsigned int threads);
+
+  size_t getFiles() const { return mFiles.size(); }
+  uint64_t getBytes() const { return mBytes; }
+
+private:
+  bool walk(const gc_dvdfs_file_entry *dir, int fd, const std::string &path);
+  static int walk_callback(const gc_dvdfs_file_entry *pfe, void *param);
+  static bool isSafeName(const char *name);
+
+  void work(unsigned int thread);
+  bool take(unsigned int thread, extract_task *task);
+  bool copy(extract_task task, std::vector<char> *buf);
+  bool copyInKernel(int out, extract_task *task);
+};
+
+const uint32_t Extractor::TASK_SIZE;
+
+struct walk_data {
+  Extractor *extractor;
+  int fd; // of the directory being walked
+  const std::string *path;
+  bool failed;
+};
+
+Extractor::~Extractor() {
+  for (int fd : mDirs) {
+    close(fd);
+  }
+}
+
+// a name the disc gives must be a single component, anything else could
+// point outside the directory it's in
+bool Extractor::isSafeName(const char *name) {
+  return name[0] != '\0' && strcmp(name, ".") != 0 &&
+         strcmp(name, "..") != 0 && strchr(name, '/') == nullptr;
+}
+
+int Extractor::walk_callback(const gc_dvdfs_file_entry *pfe, void *param) {
+  walk_data *const data = reinterpret_cast<walk_data *>(param);
+  Extractor *const extractor = data->extractor;
+  const char *const name = extractor->mFst.getFileName(pfe);
+  const std::string path = *data->path + "/" + name;
+
+  if (!isSafeName(name)) {
+    fprintf(stderr, "Refusing to extract %s, not a valid name\n",
+            path.c_str());
+    data->failed = true;
+    return -1;
+  }
+
+  if (extractor->mFst.isDirectory(pfe)) {
+    if (mkdirat(data->fd, name, 0755) && errno != EEXIST) {
+      fprintf(stderr, "Unable to create %s: %s\n", path.c_str(),
+              strerror(errno));
+      data->failed = true;
+      return -1;
+    }
+    // a symlink already in the output isn't followed
+    const int fd =
+        openat(data->fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (fd < 0) {
+      fprintf(stderr, "Unable to open %s: %s\n", path.c_str(),
+              strerror(errno));
+      data->failed = true;
+      return -1;
+    }
+    extractor->mDirs.push_back(fd);
+    if (!extractor->walk(pfe, fd, path)) {
+      data->failed = true;
+      return -1;
+    }
+    return 0;
+  }
+
+  const uint32_t length = extractor->mFst.getFileLength(pfe);
+  uint32_t offset = 0;
+  do {
+    extract_task task;
+    task.image_offset = extractor->mFst.getFileOffset(pfe);
+    task.file_length = length;
+    task.offset = offset;
+    task.length = std::min(length - offset, TASK_SIZE);
+    task.file = extractor->mFiles.size();
+    extractor->mTasks.push_back(task);
+    offset += task.length;
+  } while (offset < length);
+  extractor->mFiles.push_back(extract_file{data->fd, name, path});
+  return 0;
+}
+
+bool Extractor::walk(const gc_dvdfs_file_entry *dir, int fd,
+                     const std::string &path) {
+  walk_data data = {this, fd, &path, false};
+
+  mFst.enumerate(dir, walk_callback, &data);
+  return !data.failed;
+}
+
+bool Extractor::prepare(const std::string &output) {
+  if (mkdir(output.c_str(), 0755) && errno != EEXIST) {
+    fprintf(stderr, "Unable to create %s: %s\n", output.c_str(),
+            strerror(errno));
+    return false;
+  }
+  const int fd = ::open(output.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    fprintf(stderr, "Unable to open %s: %s\n", output.c_str(),
+            strerror(errno));
+    return false;
+  }
+  mDirs.push_back(fd);
+  if (!walk(mFst.getRoot(), fd, output)) {
+    return false;
+  }
+  // in disc order, so the threads read the image front to back
+  std::stable_sort(mTasks.begin(), mTasks.end(),
+                   [](const extract_task &a, const extract_task &b) {
+                     return a.image_offset + a.offset <
+                            b.image_offset + b.offset;
+                   });
+  return true;
+}
+
+bool Extractor::run(unsigned int threads) {
+  std::vector<std::thread> workers;
+
+  // every thread starts with a contiguous run of the disc
+  std::vector<Queue> queues(threads);
+  mQueues.swap(queues);
+  for (size_t i = 0; i < mTasks.size(); ++i) {
+    mQueues[i * threads / mTasks.size()].tasks.push_back(mTasks[i]);
+  }
+
+  for (unsigned int i = 0; i < threads; ++i) {
+    workers.emplace_back(&Extractor::work, this, i);
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  return !mFailed;
+}
+
+void Extractor::work(unsigned int thread) {
+  std::vector<char> buf;
+  extract_task task;
+
+  while (!mFailed && take(thread, &task)) {
+    if (!copy(task, &buf)) {
+      mFailed = true;
+    }
+  }
+}
+
+// the front of the thread's own run, or the back of somebody else's, the part
+// its owner would get to last
+bool Extractor::take(unsigned int thread, extract_task *task) {
+  {
+    Queue &own = mQueues[thread];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      *task = own.tasks.front();
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < mQueues.size(); ++i) {
+    Queue &victim = mQueues[(thread + i) % mQueues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      *task = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  // nothing is ever queued again, so empty queues mean done
+  return false;
+}
+
+bool Extractor::copy(extract_task task, std::vector<char> *buf) {
+  const extract_file &file = mFiles[task.file];
+  const std::string &path = file.path;
+  const int out = openat(file.dir, file.name.c_str(),
+                         O_WRONLY | O_CREAT | O_NOFOLLOW, 0644);
+
+  if (out < 0) {
+    fprintf(stderr, "Unable to create %s: %s\n", path.c_str(),
+            strerror(errno));
+    return false;
+  }
+  // every piece sets the same size, whichever gets there first
+  bool copied = ftruncate(out, task.file_length) == 0;
+  if (copied && task.length > 0) {
+    copied = copyInKernel(out, &task);
+  }
+  if (copied && mMethod == COPY_READ) {
+    buf->resize(BUFFER_SIZE);
+    for (uint32_t done = 0; copied && done < task.length;) {
+      const size_t size = std::min<size_t>(task.length - done, buf->size());
+      const int read =
+          mReader->read(buf->data(), size, task.image_offset + task.offset +
+                                               done);
+      copied = read > 0 && pwrite(out, buf->data(), read,
+                                  task.offset + done) == read;
+      done += read;
+    }
+    mBytes += task.length;
+  }
+  if (close(out) || !copied) {
+    fprintf(stderr, "Unable to write %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Copies with copy_file_range or sendfile, falling back to the next method
+// for good once one isn't supported between the two filesystems. Returns
+// false on errors. Whatever is left for the read and write loop stays in
+// task, with mMethod at COPY_READ.
+bool Extractor::copyInKernel(int out, extract_task *task) {
+  loff_t in = task->image_offset + task->offset;
+  loff_t position = task->offset;
+  uint32_t left = task->length;
+
+  while (left > 0 && mMethod == COPY_FILE_RANGE) {
+    const ssize_t copied = copy_file_range(mImageFd, &in, out, &position,
+                                           left, 0);
+    if (copied > 0) {
+      left -= copied;
+    } else if (copied < 0 && (errno == EXDEV || errno == EINVAL ||
+                              errno == ENOSYS || errno == EOPNOTSUPP)) {
+      mMethod = COPY_SENDFILE;
+    } else if (copied < 0 && errno != EINTR) {
+      return false;
+    } else if (copied == 0) {
+      // the image is shorter than the FST says
+      return false;
+    }
+  }
+  if (left > 0 && mMethod == COPY_SENDFILE) {
+    if (lseek(out, position, SEEK_SET) != position) {
+      return false;
+    }
+    while (left > 0 && mMethod == COPY_SENDFILE) {
+      off_t offset = in;
+      const ssize_t copied = sendfile(out, mImageFd, &offset, left);
+      if (copied > 0) {
+        left -= copied;
+        in += copied;
+        position += copied;
+      } else if (copied < 0 && (errno == EINVAL || errno == ENOSYS)) {
+        mMethod = COPY_READ;
+      } else if (copied < 0 && errno != EINTR) {
+        return false;
+      } else if (copied == 0) {
+        return false;
+      }
+    }
+  }
+  mBytes += task->length - left;
+  task->offset = position;
+  task->length = left;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int ch;
+  GamecubeIsoFilesystem::ReaderType readerType =
+      GamecubeIsoFilesystem::READER_FILE;
+  string disc;
+  unsigned int threads = std::max(1U, std::thread::hardware_concurrency());
+
+  while ((ch = getopt_long(argc, argv, "r:d:j:h", long_opts, NULL)) != -1) {
+    switch (ch) {
+    case 'r':
+      if (!GamecubeIsoFilesystem::parseReaderType(optarg, &readerType)) {
+        fprintf(stderr, "Unknown reader %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'd':
+      disc = optarg;
+      break;
+    case 'j':
+      threads = std::max(1, atoi(optarg));
+      break;
+    case 'h':
+      return printHelp();
+    default:
+      return 1;
+    }
+  }
+  if (optind + 2 != argc) {
+    fprintf(stderr, "You need to specify an iso file and an output "
+                    "directory!\n");
+    return 1;
+  }
+
+  GamecubeIsoFilesystem filesystem(geteuid(), getegid(), "");
+  filesystem.setReaderType(readerType);
+  filesystem.setDisc(disc);
+  if (!filesystem.open(argv[optind])) {
+    fprintf(stderr, "Unable to open %s\n", argv[optind]);
+    return 3;
+  }
+
+  const auto start = chrono::steady_clock::now();
+  Extractor extractor(filesystem.getFst(), filesystem.getReader());
+  if (!extractor.prepare(argv[optind + 1]) || !extractor.run(threads)) {
+    return 4;
+  }
+  const double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  printf("Extracted %zu files, %.1f MiB in %.2f s, %.1f MiB/s\n",
+         extractor.getFiles(), extractor.getBytes() / 1048576.0, seconds,
+         extractor.getBytes() / 1048576.0 / seconds);
+  return 0;
+}
@@ -1,9 +1,12 @@
 #include <iostream>
 #include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <string.h>
 #include <unistd.h>
 #include <string>
 #include <getopt.h>
 #include "GamecubeIsoFilesystem.h"
+#include "LibraryFilesystem.h"
 
 using namespace std;
 
@@ -13,6 +16,18 @@ static const struct option long_opts[] = {
     {"logfile", required_argument, NULL, 'l'},
     {"iso", required_argument, NULL, 'i'},
     {"mount_point", required_argument, NULL, 'm'},
+    {"reader", required_argument, NULL, 'r'},
+    {"lowlevel", no_argument, NULL, 'L'},
+    {"cache_size", required_argument, NULL, 'c'},
+    {"readahead", required_argument, NULL, 'a'},
+    {"disc", required_argument, NULL, 'd'},
+    {"trace", required_argument, NULL, 't'},
+    {"profile", no_argument, NULL, 'p'},
+    {"library", required_argument, NULL, 'D'},
+    {"max_images", required_argument, NULL, 'n'},
+    {"fst_budget", required_argument, NULL, 'f'},
+    {"index", optional_argument, NULL, 'x'},
+    {"ignore_case", no_argument, NULL, 'I'},
     {"help", no_argument, NULL, 'h'},
     {0, 0, 0, 0},
 };
@@ -24,11 +39,79 @@ int printHelp() {
          "    -l, --logfile=file        debug logfile location\n"
          "    -i, --iso=file            Gamecube ISO file location\n"
          "    -m, --mount_point=file    mount point\n"
+         "    -r, --reader=type         how to read the ISO, file (default), "
+         "mmap or uring\n"
+         "    -L, --lowlevel            use the inode based FUSE interface\n"
+         "    -c, --cache_size=MiB      block cache size, 0 (default) "
+         "disables it\n"
+         "    -a, --readahead=MiB       largest readahead window per open "
+         "file, 0 (default) disables it\n"
+         "    -d, --disc=disc           disc of a WBFS container to mount, "
+         "its index or game id\n"
+         "    -t, --trace=file          record every operation to file for "
+         "trace_replay\n"
+         "    -p, --profile             record what booting reads beside "
+         "the ISO and prefetch it\n"
+         "                              on later mounts\n"
+         "    -D, --library=directory   serve every image in directory "
+         "instead of --iso,\n"
+         "                              --cache_size, --disc, --trace and "
+         "--profile don't\n"
+         "                              apply to them and --lowlevel is "
+         "refused\n"
+         "    -n, --max_images=count    images of the library kept open, "
+         "64 by default,\n"
+         "                              opening files in more fails with "
+         "EMFILE\n"
+         "    -f, --fst_budget=MiB      memory the open images' FSTs may "
+         "take, 256 by default\n"
+         "    -x, --index[=directory]   keep an index of the FST in "
+         "directory, beside the ISO\n"
+         "                              by default, later mounts map it "
+         "instead of parsing\n"
+         "    -I, --ignore_case         also find names that differ in the "
+         "case of their letters\n"
          "    -h, --help                this help menu\n");
 
   return 0;
 }
 
+// Mounts through the inode based interface, mirrors what fuse_main does for
+// the path based one
+static int mountLowLevel(char *program, const char *mountPoint,
+                         GamecubeIsoFilesystem *context) {
+  char *fake_argv[1] = {program};
+  struct fuse_args args = FUSE_ARGS_INIT(1, fake_argv);
+  struct fuse_chan *channel;
+  struct fuse_session *session;
+  int err = -1;
+
+  if ((channel = fuse_mount(mountPoint, &args)) == nullptr) {
+    delete context;
+    return 4;
+  }
+
+  session = fuse_lowlevel_new(&args, context->getFuseLowLevelOperations(),
+                              sizeof(*context->getFuseLowLevelOperations()),
+                              context);
+  if (session == nullptr) {
+    delete context;
+  } else {
+    if (fuse_set_signal_handlers(session) != -1) {
+      fuse_session_add_chan(session, channel);
+      if (fuse_daemonize(0) != -1) {
+        err = fuse_session_loop_mt(session);
+      }
+      fuse_remove_signal_handlers(session);
+      fuse_session_remove_chan(channel);
+    }
+    // destroys the context through the destroy callback
+    fuse_session_destroy(session);
+  }
+  fuse_unmount(mountPoint, channel);
+  return err ? 1 : 0;
+}
+
 int main(int argc, char **argv) {
   char ch;
   uid_t uid = geteuid();
@@ -36,6 +119,20 @@ int main(int argc, char **argv) {
   string isoFile;
   string logFile;
   string mountPoint;
+  GamecubeIsoFilesystem::ReaderType readerType =
+      GamecubeIsoFilesystem::READER_FILE;
+  bool lowLevel = false;
+  size_t cacheSize = 0;
+  size_t readaheadSize = 0;
+  string disc;
+  string traceFile;
+  bool profile = false;
+  string library;
+  unsigned int maxImages = LibraryFilesystem::DEFAULT_MAX_IMAGES;
+  size_t fstBudget = LibraryFilesystem::DEFAULT_FST_BUDGET;
+  bool index = false;
+  string indexDirectory;
+  bool ignoreCase = false;
   GamecubeIsoFilesystem *context;
 
   if (getuid() == 0 || uid == 0) {
@@ -43,7 +140,8 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  while ((ch = getopt_long(argc, argv, "ugl:i:m:h", long_opts, NULL)) != -1) {
+  while ((ch = getopt_long(argc, argv, "ugl:i:m:r:Lc:a:d:t:pD:n:f:x::Ih",
+                           long_opts, NULL)) != -1) {
     switch (ch) {
     case 'u':
       uid = atol(optarg);
@@ -60,12 +158,54 @@ int main(int argc, char **argv) {
     case 'm':
       mountPoint = optarg;
       break;
+    case 'r':
+      if (!GamecubeIsoFilesystem::parseReaderType(optarg, &readerType)) {
+        fprintf(stderr, "Unknown reader %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'L':
+      lowLevel = true;
+      break;
+    case 'c':
+      cacheSize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+      break;
+    case 'a':
+      readaheadSize = strtoull(optarg, NULL, 10) * 1024 * 1024;
+      break;
+    case 'd':
+      disc = optarg;
+      break;
+    case 't':
+      traceFile = optarg;
+      break;
+    case 'p':
+      profile = true;
+      break;
+    case 'D':
+      library = optarg;
+      break;
+    case 'n':
+      maxImages = strtoul(optarg, NULL, 10);
+      break;
+    case 'f':
+      fstBudget = strtoull(optarg, NULL, 10) * 1024 * 1024;
+      break;
+    case 'x':
+      index = true;
+      if (optarg) {
+        indexDirectory = optarg;
+      }
+      break;
+    case 'I':
+      ignoreCase = true;
+      break;
     case 'h':
       return printHelp();
     }
   }
 
-  if (isoFile.empty()) {
+  if (isoFile.empty() && library.empty()) {
     fprintf(stderr, "You need to specify an iso file!\n");
     return 1;
   }
@@ -73,9 +213,59 @@ int main(int argc, char **argv) {
     fprintf(stderr, "You need to specify a mount point!\n");
     return 2;
   }
+  if (index && indexDirectory.empty()) {
+    // beside the images
+    const size_t slash = isoFile.rfind('/');
+    if (!library.empty()) {
+      indexDirectory = library;
+    } else if (slash != string::npos) {
+      indexDirectory = isoFile.substr(0, slash + 1);
+    } else {
+      indexDirectory = ".";
+    }
+  }
+
+  if (!library.empty()) {
+    // inode numbers would have to be unique across the images
+    if (lowLevel) {
+      fprintf(stderr, "A library can't be served with --lowlevel\n");
+      return 1;
+    }
+    LibraryFilesystem *const libraryContext =
+        new LibraryFilesystem(uid, gid, logFile.c_str());
+    libraryContext->setReaderType(readerType);
+    libraryContext->setReadaheadSize(readaheadSize);
+    libraryContext->setMaxImages(maxImages);
+    libraryContext->setFstBudget(fstBudget);
+    libraryContext->setIndexDirectory(indexDirectory);
+    libraryContext->setIgnoreCase(ignoreCase);
+    if (!libraryContext->open(library.c_str())) {
+      fprintf(stderr, "Unable to open %s\n", library.c_str());
+      delete libraryContext;
+      return 3;
+    }
+    char *fake_argv[2] = {argv[0], const_cast<char *>(mountPoint.c_str())};
+    return fuse_main(sizeof(fake_argv) / sizeof(fake_argv[0]), fake_argv,
+                     libraryContext->getFuseOperations(), libraryContext);
+  }
 
   context = new GamecubeIsoFilesystem(uid, gid, logFile.c_str());
+  context->setReaderType(readerType);
+  context->setCacheSize(cacheSize);
+  context->setReadaheadSize(readaheadSize);
+  context->setDisc(disc);
+  context->setTraceFile(traceFile);
+  context->setIndexDirectory(indexDirectory);
+  context->setIgnoreCase(ignoreCase);
+  if (profile) {
+    // every disc of a container boots differently
+    context->setProfileFile(isoFile + (disc.empty() ? "" : "." + disc) +
+                            ".gcprofile");
+  }
   if (context->open(isoFile.c_str())) {
+    if (lowLevel) {
+      return mountLowLevel(argv[0], mountPoint.c_str(), context);
+    }
     // create fake argc, argv for fuse
     char *fake_argv[2] = {argv[0], const_cast<char *>(mountPoint.c_str())};
     return fuse_main(sizeof(fake_argv) / sizeof(fake_argv[0]), fake_argv,
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "CisoBinaryReader.h"
+#include "ContainerWriter.h"
+#include "MemoryReader.h"
+#include "ReaderTest.h"
+#include "SyntheticImage.h"
+
+namespace {
+
+// about 2 MiB whose size isn't a multiple of the block size
+const SyntheticImageOptions kOptions = {1, 3, 4, 8, 1000, 24, 250000};
+const uint32_t kBlockSize = 32 * 1024;
+
+TEST(CisoBinaryReaderTest, ReadsBackTheImage) {
+  SyntheticImage image(kOptions);
+  const uint64_t size = image.getImageSize();
+  std::vector<unsigned char> file = writeCiso(&image, size, kBlockSize);
+
+  // the DOL body is all zeros and must have been left out
+  const struct ciso_header *const header =
+      reinterpret_cast<const struct ciso_header *>(file.data());
+  const size_t blocks = (size + kBlockSize - 1) / kBlockSize;
+  const size_t present = std::count(header->map, header->map + blocks, 1);
+  EXPECT_LT(present, blocks);
+  EXPECT_EQ(sizeof(*header) + present * kBlockSize, file.size());
+
+  MemoryReader *const container = new MemoryReader(&file);
+  ASSERT_TRUE(CisoBinaryReader::detect(container));
+  CisoBinaryReader ciso(container);
+  ASSERT_TRUE(ciso.open());
+  expectSameContents(&image, &ciso, size);
+
+  // past the image are only absent blocks, which read as zeros
+  std::vector<unsigned char> tail(3 * kBlockSize, 0xff);
+  ASSERT_EQ(static_cast<int>(tail.size()),
+            ciso.read(tail.data(), tail.size(), blocks * kBlockSize));
+  EXPECT_TRUE(std::all_of(tail.begin(), tail.end(),
+                          [](unsigned char byte) { return byte == 0; }));
+}
+
+TEST(CisoBinaryReaderTest, RejectsOtherImages) {
+  SyntheticImage image(kOptions);
+  EXPECT_FALSE(CisoBinaryReader::detect(&image));
+}
+
+} // namespace
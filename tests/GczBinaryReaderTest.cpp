@@ -0,0 +1,73 @@
+#include <endian.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include "ContainerWriter.h"
+#include "GczBinaryReader.h"
+#include "MemoryReader.h"
+#include "ReaderTest.h"
+#include "SyntheticImage.h"
+#include "ThreadPool.h"
+
+namespace {
+
+// about 2 MiB whose size isn't a multiple of any block size
+const SyntheticImageOptions kOptions = {1, 3, 4, 8, 1000, 24, 250000};
+const uint32_t kBlockSize = 32 * 1024;
+
+// The synthetic image with its second half replaced by noise, which
+// doesn't deflate, so some blocks are stored as is
+std::vector<unsigned char> makeImage() {
+  SyntheticImage image(kOptions);
+  std::vector<unsigned char> data(image.getImageSize());
+  std::mt19937 random(7);
+
+  image.read(data.data(), data.size(), 0);
+  for (size_t i = data.size() / 2; i < data.size(); ++i) {
+    data[i] = random();
+  }
+  return data;
+}
+
+TEST(GczBinaryReaderTest, ReadsBackTheImage) {
+  std::vector<unsigned char> data = makeImage();
+  const uint64_t size = data.size();
+  MemoryReader image(&data);
+  std::vector<unsigned char> file = writeGcz(&image, size, kBlockSize);
+
+  const uint64_t *const pointers = reinterpret_cast<const uint64_t *>(
+      file.data() + sizeof(struct gcz_header));
+  const uint32_t blocks = (size + kBlockSize - 1) / kBlockSize;
+  size_t stored = 0;
+  for (uint32_t i = 0; i < blocks; ++i) {
+    stored += le64toh(pointers[i]) >> 63;
+  }
+  EXPECT_GT(stored, 0u);
+  EXPECT_LT(stored, blocks);
+
+  ThreadPool pool(4);
+  MemoryReader *const container = new MemoryReader(&file);
+  ASSERT_TRUE(GczBinaryReader::detect(container));
+  GczBinaryReader gcz(container, &pool);
+  ASSERT_TRUE(gcz.open());
+  EXPECT_EQ(size, gcz.getDataSize());
+  expectSameContents(&image, &gcz, size);
+  char byte;
+  EXPECT_EQ(0, gcz.read(&byte, 1, size));
+}
+
+TEST(GczBinaryReaderTest, FailsOnACorruptBlock) {
+  SyntheticImage image(kOptions);
+  std::vector<unsigned char> file =
+      writeGcz(&image, image.getImageSize(), kBlockSize);
+  // the last byte belongs to the last block, its adler32 no longer matches
+  file.back() ^= 0xff;
+
+  GczBinaryReader gcz(new MemoryReader(&file), nullptr);
+  ASSERT_TRUE(gcz.open());
+  char buf[16];
+  EXPECT_EQ(static_cast<int>(sizeof(buf)), gcz.read(buf, sizeof(buf), 0));
+  EXPECT_EQ(-1, gcz.read(buf, sizeof(buf), image.getImageSize() - 1));
+}
+
+} // namespace
@@ -0,0 +1,40 @@
+#ifndef __READER_TEST__H_
+#define __READER_TEST__H_
+
+#include <string.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "BinaryReader.h"
+
+// Reads the first size bytes of expected and actual the same ways, all of
+// it in odd sized pieces that straddle every block boundary, then at random
+// offsets and lengths, and expects the same bytes back every time
+inline void expectSameContents(BinaryReader *expected, BinaryReader *actual,
+                               uint64_t size) {
+  const size_t pieceSize = 100003;
+  std::vector<unsigned char> want(pieceSize);
+  std::vector<unsigned char> got(pieceSize);
+
+  for (uint64_t offset = 0; offset < size; offset += pieceSize) {
+    const int length = std::min<uint64_t>(pieceSize, size - offset);
+    ASSERT_EQ(length, expected->read(want.data(), length, offset));
+    ASSERT_EQ(length, actual->read(got.data(), length, offset))
+        << "at " << offset;
+    ASSERT_EQ(0, memcmp(want.data(), got.data(), length)) << "at " << offset;
+  }
+
+  std::mt19937_64 random(42);
+  for (int i = 0; i < 200; ++i) {
+    const uint64_t offset = random() % size;
+    const int length =
+        std::min<uint64_t>(1 + random() % pieceSize, size - offset);
+    ASSERT_EQ(length, expected->read(want.data(), length, offset));
+    ASSERT_EQ(length, actual->read(got.data(), length, offset))
+        << "at " << offset;
+    ASSERT_EQ(0, memcmp(want.data(), got.data(), length)) << "at " << offset;
+  }
+}
+
+#endif
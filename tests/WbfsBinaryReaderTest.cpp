@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "BigEndian.h"
+#include "ContainerWriter.h"
+#include "MemoryReader.h"
+#include "ReaderTest.h"
+#include "SyntheticImage.h"
+#include "WbfsBinaryReader.h"
+
+namespace {
+
+// two discs of different sizes, neither a multiple of the sector size
+const SyntheticImageOptions kFirstOptions = {1, 3, 4, 8, 1000, 24, 250000};
+const SyntheticImageOptions kSecondOptions = {1, 2, 6, 8, 2000, 16, 90000};
+const uint64_t kSectorSize = 32 * 1024;
+
+// the image behind options with its game code changed to gameId
+std::vector<unsigned char> makeImage(const SyntheticImageOptions &options,
+                                     const char *gameId) {
+  SyntheticImage image(options);
+  std::vector<unsigned char> data(image.getImageSize());
+
+  image.read(data.data(), data.size(), 0);
+  memcpy(data.data(), gameId, 6);
+  return data;
+}
+
+TEST(WbfsBinaryReaderTest, ReadsBackEveryDisc) {
+  std::vector<unsigned char> first = makeImage(kFirstOptions, "GSYN01");
+  std::vector<unsigned char> second = makeImage(kSecondOptions, "GSYN02");
+  const uint64_t sizes[] = {first.size(), second.size()};
+  MemoryReader firstImage(&first);
+  MemoryReader secondImage(&second);
+  std::vector<BinaryReader *> images = {&firstImage, &secondImage};
+
+  std::vector<unsigned char> file =
+      writeWbfs(images, std::vector<uint64_t>(sizes, sizes + 2));
+  // the first disc's info follows the header sector, its sector table the
+  // disc header; the DOL body at 0x10000 is all zeros and must be left out
+  const be16_t *const table =
+      reinterpret_cast<const be16_t *>(file.data() + 512 + 0x100);
+  EXPECT_NE(0, table[0]);
+  EXPECT_EQ(0, table[0x10000 / kSectorSize]);
+
+  MemoryReader *const container = new MemoryReader(&file);
+  ASSERT_TRUE(WbfsBinaryReader::detect(container));
+  WbfsBinaryReader wbfs(container);
+  ASSERT_TRUE(wbfs.open());
+  ASSERT_EQ(2u, wbfs.getDiscs().size());
+  EXPECT_EQ("GSYN01", wbfs.getDiscs()[0].gameId);
+  EXPECT_EQ("GSYN02", wbfs.getDiscs()[1].gameId);
+  EXPECT_EQ("Synthetic benchmark image", wbfs.getDiscs()[1].name);
+
+  for (size_t disc = 0; disc < images.size(); ++disc) {
+    SCOPED_TRACE(disc);
+    ASSERT_TRUE(wbfs.select(disc));
+    // the image runs to the end of its last sector, padded with zeros
+    const uint64_t dataSize =
+        (sizes[disc] + kSectorSize - 1) / kSectorSize * kSectorSize;
+    EXPECT_EQ(dataSize, wbfs.getDataSize());
+    expectSameContents(images[disc], &wbfs, sizes[disc]);
+
+    std::vector<unsigned char> tail(dataSize - sizes[disc], 0xff);
+    ASSERT_EQ(static_cast<int>(tail.size()),
+              wbfs.read(tail.data(), tail.size(), sizes[disc]));
+    EXPECT_TRUE(std::all_of(tail.begin(), tail.end(),
+                            [](unsigned char byte) { return byte == 0; }));
+  }
+  EXPECT_FALSE(wbfs.select(images.size()));
+}
+
+} // namespace
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <tuple>
+#include <vector>
+#include "ContainerWriter.h"
+#include "MemoryReader.h"
+#include "ReaderTest.h"
+#include "SyntheticImage.h"
+#include "ThreadPool.h"
+#include "WiaBinaryReader.h"
+
+// Junk regeneration isn't covered: there's no reference disc to check the
+// generator's output against.
+
+namespace {
+
+// about 2 MiB whose size isn't a multiple of the chunk size
+const SyntheticImageOptions kOptions = {1, 3, 4, 8, 1000, 24, 250000};
+const uint32_t kChunkSize = 64 * 1024;
+
+// the codec and whether the image is RVZ
+typedef std::tuple<WiaBinaryReader::Compression, bool> Format;
+
+class WiaBinaryReaderTest : public ::testing::TestWithParam<Format> {};
+
+TEST_P(WiaBinaryReaderTest, ReadsBackTheImage) {
+  const WiaBinaryReader::Compression compression = std::get<0>(GetParam());
+  const bool rvz = std::get<1>(GetParam());
+  SyntheticImage image(kOptions);
+  const uint64_t size = image.getImageSize();
+  std::vector<unsigned char> file =
+      writeWia(&image, size, compression, rvz, kChunkSize, true);
+
+  MemoryReader *const container = new MemoryReader(&file);
+  ASSERT_TRUE(WiaBinaryReader::detect(container));
+  ThreadPool pool(2);
+  WiaBinaryReader wia(container, &pool);
+  ASSERT_TRUE(wia.open());
+  EXPECT_EQ(size, wia.getDataSize());
+  expectSameContents(&image, &wia, size);
+}
+
+TEST_P(WiaBinaryReaderTest, FailsOnATruncatedImage) {
+  const WiaBinaryReader::Compression compression = std::get<0>(GetParam());
+  const bool rvz = std::get<1>(GetParam());
+  SyntheticImage image(kOptions);
+  std::vector<unsigned char> file = writeWia(
+      &image, image.getImageSize(), compression, rvz, kChunkSize, true);
+
+  // the tables sit at the end, without them there's nothing to read
+  file.resize(file.size() - 16);
+  WiaBinaryReader wia(new MemoryReader(&file), nullptr);
+  EXPECT_FALSE(wia.open());
+}
+
+// chunks bigger than a shard of the default cache budget are still only
+// decoded once while they're read
+TEST(WiaBinaryReaderLargeChunkTest, DecodesEveryChunkOnce) {
+  const uint32_t chunkSize = 8 * 1024 * 1024;
+  SyntheticImage image(SyntheticImageOptions{0, 0, 1, 8, 20000000, 0, 0});
+  const uint64_t size = image.getImageSize();
+  std::vector<unsigned char> file = writeWia(
+      &image, size, WiaBinaryReader::COMPRESSION_ZSTD, true, chunkSize);
+
+  WiaBinaryReader wia(new MemoryReader(&file), nullptr);
+  ASSERT_TRUE(wia.open());
+  std::vector<unsigned char> buf(128 * 1024);
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint64_t offset = 0; offset < size; offset += buf.size()) {
+      ASSERT_GT(wia.read(buf.data(), buf.size(), offset), 0);
+    }
+  }
+  EXPECT_EQ((size + chunkSize - 1) / chunkSize, wia.getDecodedChunks());
+}
+
+INSTANTIATE_TEST_CASE_P(
+    Wia, WiaBinaryReaderTest,
+    ::testing::Combine(
+        ::testing::Values(WiaBinaryReader::COMPRESSION_NONE,
+                          WiaBinaryReader::COMPRESSION_PURGE,
+                          WiaBinaryReader::COMPRESSION_BZIP2,
+                          WiaBinaryReader::COMPRESSION_LZMA,
+                          WiaBinaryReader::COMPRESSION_LZMA2,
+                          WiaBinaryReader::COMPRESSION_ZSTD),
+        ::testing::Values(false)));
+
+// RVZ drops PURGE
+INSTANTIATE_TEST_CASE_P(
+    Rvz, WiaBinaryReaderTest,
+    ::testing::Combine(
+        ::testing::Values(WiaBinaryReader::COMPRESSION_NONE,
+                          WiaBinaryReader::COMPRESSION_BZIP2,
+                          WiaBinaryReader::COMPRESSION_LZMA,
+                          WiaBinaryReader::COMPRESSION_LZMA2,
+                          WiaBinaryReader::COMPRESSION_ZSTD),
+        ::testing::Values(true)));
+
+} // namespace
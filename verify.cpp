@@ -0,0 +1,88 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "Crc32.h"
+#include "DiscVerifier.h"
+#include "GamecubeIsoFilesystem.h"
+
+using namespace std;
+
+// Prints the checksums of an image, to compare against redump's, and
+// optionally of every file on it
+
+static const struct option long_opts[] = {
+    {"reader", required_argument, NULL, 'r'},
+    {"disc", required_argument, NULL, 'd'},
+    {"files", no_argument, NULL, 'f'},
+    {"help", no_argument, NULL, 'h'},
+    {0, 0, 0, 0},
+};
+
+static int printHelp() {
+  printf("Computes the CRC-32, MD5 and SHA-1 of a Gamecube ISO file\n\n"
+         "gcverify [options] iso\n\n"
+         "    -r, --reader=type         how to read the ISO, file (default), "
+         "mmap or uring\n"
+         "    -d, --disc=disc           disc of a WBFS container to verify, "
+         "its index or game id\n"
+         "    -f, --files               also list the CRC-32 and SHA-1 of "
+         "every file\n"
+         "    -h, --help                this help menu\n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int ch;
+  GamecubeIsoFilesystem::ReaderType readerType =
+      GamecubeIsoFilesystem::READER_FILE;
+  string disc;
+  bool files = false;
+
+  while ((ch = getopt_long(argc, argv, "r:d:fh", long_opts, NULL)) != -1) {
+    switch (ch) {
+    case 'r':
+      if (!GamecubeIsoFilesystem::parseReaderType(optarg, &readerType)) {
+        fprintf(stderr, "Unknown reader %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'd':
+      disc = optarg;
+      break;
+    case 'f':
+      files = true;
+      break;
+    case 'h':
+      return printHelp();
+    default:
+      return 1;
+    }
+  }
+  if (optind + 1 != argc) {
+    fprintf(stderr, "You need to specify an iso file!\n");
+    return 1;
+  }
+
+  GamecubeIsoFilesystem filesystem(geteuid(), getegid(), "");
+  filesystem.setReaderType(readerType);
+  filesystem.setDisc(disc);
+  if (!filesystem.open(argv[optind])) {
+    fprintf(stderr, "Unable to open %s\n", argv[optind]);
+    return 3;
+  }
+
+  DiscVerifier verifier(filesystem.getReader(), filesystem.getFst());
+  if (!verifier.run()) {
+    fprintf(stderr, "Unable to read %s\n", argv[optind]);
+    return 4;
+  }
+  string report;
+  verifier.writeReport(&report, files);
+  fputs(report.c_str(), stdout);
+  if (!crc32_is_accelerated()) {
+    fprintf(stderr, "CRC-32 isn't accelerated on this processor\n");
+  }
+  return 0;
+}